@@ -0,0 +1,367 @@
+/*
+ *  INA219 voltage and current sensors of the CubeSatSim
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "../wiringPi/wiringPiI2C.h"
+#include "ina219.h"
+#include "status.h"
+
+#define REG_CONFIG      0x00
+#define REG_SHUNT       0x01
+#define REG_BUS         0x02
+#define REG_CALIBRATION 0x05
+
+#define CALIBRATION     4096    // current register equal to the shunt register
+
+// Configuration register fields
+#define BRNG_32V        (1 << 13)
+#define PG_DIV_8        (3 << 11)
+#define BADC(res)       ((res) << 7)
+#define SADC(res)       ((res) << 3)
+#define ADC_12BIT_1S    0x3
+#define ADC_12BIT_32S   0xd
+#define MODE_CONTINUOUS 0x7
+
+#define CONFIG_DEFAULT  (BRNG_32V | PG_DIV_8 | BADC(ADC_12BIT_1S) | SADC(ADC_12BIT_1S) | MODE_CONTINUOUS)
+#define CONFIG_AVERAGED (PG_DIV_8 | BADC(ADC_12BIT_32S) | SADC(ADC_12BIT_32S) | MODE_CONTINUOUS)
+
+#define BUS_LSB         0.004f  // volts
+#define SHUNT_LSB       0.1f    // milliamps through 0.1 ohm at 10 uV
+
+#define MSGS_PER_SENSOR 4       // the bus and shunt registers, each a write and a read
+
+static const int addresses[INA219_PER_BUS] = { 0x40, 0x41, 0x44, 0x45 };
+
+// The values of the bus and shunt registers, most significant byte first
+static void convert(const ina219_t *s, const unsigned char *bus,
+        const unsigned char *shunt, float *volts, float *milliamps) {
+    *volts = (float) (((bus[0] << 8) | bus[1]) >> 3) * BUS_LSB;
+    *milliamps = (float) (short) ((shunt[0] << 8) | shunt[1]) * SHUNT_LSB * s->scale;
+}
+
+// The INA219 sends the most significant byte first, SMBus the least
+static int read_reg(int fd, int reg) {
+    int v = wiringPiI2CReadReg16(fd, reg);
+
+    return (v < 0) ? v : ((v & 0xff) << 8) | ((v >> 8) & 0xff);
+}
+
+static int write_reg(int fd, int reg, int v) {
+    return wiringPiI2CWriteReg16(fd, reg, ((v & 0xff) << 8) | ((v >> 8) & 0xff));
+}
+
+// Writes the calibration and configuration, which also tells whether the
+// sensor is there
+static int setup(ina219_t *s) {
+    s->present = (write_reg(s->fd, REG_CALIBRATION, CALIBRATION) == 0
+            && write_reg(s->fd, REG_CONFIG, s->config) == 0);
+    return s->present ? PQWS_SUCCESS : -PQWS_INVALID_PARAM;
+}
+
+/**
+ * Opens a sensor and sets it up.  The bus is opened here rather than with
+ * wiringPiI2CSetupInterface(), which exits the program when it fails.
+ * @param s the sensor
+ * @param bus the number of the I2C bus, negative if it failed its test
+ * @param addr the address of the sensor
+ * @param averaged nonzero for 32 sample averaging and the 16 V range, the
+ * "c" mode of voltcurrent.py
+ * @return PQWS_SUCCESS, or -PQWS_INVALID_PARAM if the sensor did not answer
+ */
+int ina219_open(ina219_t *s, int bus, int addr, int averaged) {
+    char dev[20];
+
+    s->fd = -1;
+    s->bus = bus;
+    s->addr = addr;
+    s->present = 0;
+    s->config = averaged ? CONFIG_AVERAGED : CONFIG_DEFAULT;
+    s->scale = 1;
+    if (bus < 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    snprintf(dev, sizeof(dev), "/dev/i2c-%d", bus);
+    s->fd = open(dev, O_RDWR);
+    if (s->fd < 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (ioctl(s->fd, I2C_SLAVE, addr) < 0) {
+        ina219_close(s);
+        return -PQWS_INVALID_PARAM;
+    }
+    return setup(s);
+}
+
+/**
+ * Reads the voltage on the load side of the shunt and the current through
+ * it.  The current is taken from the shunt register, which at a
+ * calibration of 4096 holds what the current register would, so a sensor
+ * reset by a sharp load still reads right.  A sensor that did not answer
+ * is set up again first.
+ * @param s the sensor
+ * @param volts where to put the bus voltage
+ * @param milliamps where to put the current
+ * @return PQWS_SUCCESS, or -PQWS_INVALID_PARAM with both values 0 if the
+ * sensor did not answer
+ */
+int ina219_read(ina219_t *s, float *volts, float *milliamps) {
+    unsigned char b[2], sh[2];
+    int bus, shunt;
+
+    *volts = 0;
+    *milliamps = 0;
+    if (s->fd < 0 || (!s->present && setup(s) != PQWS_SUCCESS)) {
+        return -PQWS_INVALID_PARAM;
+    }
+    bus = read_reg(s->fd, REG_BUS);
+    shunt = (bus < 0) ? -1 : read_reg(s->fd, REG_SHUNT);
+    if (shunt < 0) {
+        s->present = 0;
+        return -PQWS_INVALID_PARAM;
+    }
+    b[0] = (unsigned char) (bus >> 8);
+    b[1] = (unsigned char) bus;
+    sh[0] = (unsigned char) (shunt >> 8);
+    sh[1] = (unsigned char) shunt;
+    convert(s, b, sh, volts, milliamps);
+    return PQWS_SUCCESS;
+}
+
+/**
+ * @param s the sensor
+ */
+void ina219_close(ina219_t *s) {
+    if (s->fd >= 0)
+        close(s->fd);
+    s->fd = -1;
+    s->present = 0;
+}
+
+// The messages reading a register: its address written, then its two bytes
+static void read_msgs(struct i2c_msg *m, int addr, unsigned char *reg,
+        unsigned char *value) {
+    m[0].addr = (unsigned short) addr;
+    m[0].flags = 0;
+    m[0].len = 1;
+    m[0].buf = reg;
+    m[1].addr = (unsigned short) addr;
+    m[1].flags = I2C_M_RD;
+    m[1].len = 2;
+    m[1].buf = value;
+}
+
+// One combined transfer, which addresses each message itself, so any open
+// descriptor of the bus will do
+static int transfer(int fd, struct i2c_msg *msgs, int n) {
+    struct i2c_rdwr_ioctl_data data;
+
+    data.msgs = msgs;
+    data.nmsgs = (unsigned int) n;
+    return (ioctl(fd, I2C_RDWR, &data) == n) ? PQWS_SUCCESS : -PQWS_INVALID_PARAM;
+}
+
+// Reads the sensors of a bus: the bus and shunt registers of the ones that
+// answered last time in one I2C_RDWR transfer, or sensor by sensor if that
+// fails, so one sensor gone does not lose the others; then the others by
+// themselves
+static void read_bus(ina219_bank_t *b, int bus, float *voltage, float *current) {
+    unsigned char regs[2] = { REG_BUS, REG_SHUNT };
+    struct i2c_msg msgs[MSGS_PER_SENSOR * INA219_SENSORS];
+    unsigned char raw[INA219_SENSORS][2][2];
+    int queued[INA219_SENSORS], batched[INA219_SENSORS] = { 0 };
+    int i, n = 0, fd = -1, all;
+
+    for (i = 0; i < INA219_SENSORS; i++) {
+        ina219_t *s = &b->sensor[i];
+
+        if (s->fd >= 0 && s->bus == bus && s->present) {
+            read_msgs(&msgs[MSGS_PER_SENSOR * n], s->addr, &regs[0], raw[i][0]);
+            read_msgs(&msgs[MSGS_PER_SENSOR * n + 2], s->addr, &regs[1], raw[i][1]);
+            queued[n++] = i;
+            batched[i] = 1;
+            if (fd < 0)
+                fd = s->fd;
+        }
+    }
+    all = (n > 0) && (transfer(fd, msgs, MSGS_PER_SENSOR * n) == PQWS_SUCCESS);
+    for (i = 0; i < n; i++) {
+        ina219_t *s = &b->sensor[queued[i]];
+
+        if (all || transfer(fd, &msgs[MSGS_PER_SENSOR * i], MSGS_PER_SENSOR) == PQWS_SUCCESS)
+            convert(s, raw[queued[i]][0], raw[queued[i]][1], &voltage[queued[i]], &current[queued[i]]);
+        else
+            s->present = 0;
+    }
+    for (i = 0; i < INA219_SENSORS; i++) {
+        ina219_t *s = &b->sensor[i];
+
+        if (s->fd >= 0 && s->bus == bus && !batched[i])
+            ina219_read(s, &voltage[i], &current[i]);
+    }
+}
+
+// Reads its bus at each sweep until the bank is closed
+static void *run_bus(void *arg) {
+    ina219_worker_t *w = arg;
+    ina219_bank_t *b = w->bank;
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&b->lock);
+    for (;;) {
+        while (!b->stop && b->sweep == seen)
+            pthread_cond_wait(&b->start, &b->lock);
+        if (b->stop)
+            break;
+        seen = b->sweep;
+        pthread_mutex_unlock(&b->lock);
+
+        read_bus(b, w->bus, b->voltage, b->current);
+
+        pthread_mutex_lock(&b->lock);
+        if (--b->pending == 0)
+            pthread_cond_signal(&b->done);
+    }
+    pthread_mutex_unlock(&b->lock);
+    return NULL;
+}
+
+/**
+ * Opens the sensors on two buses and starts a worker for each bus but the
+ * last.  On bus 0 the sensor at 0x45 is the one on the MoPower board, at
+ * INA219_MOPOWER_ADDR on bus 1, whose shunt is a tenth of the others.
+ * @param b the sensors
+ * @param bus0 the number of the first bus, negative if it failed its test
+ * @param bus1 the number of the second bus, negative if it failed its test
+ * @param averaged nonzero for 32 sample averaging and the 16 V range
+ * @return the number of sensors that answered
+ */
+int ina219_bank_open(ina219_bank_t *b, int bus0, int bus1, int averaged) {
+    int buses[2] = { bus0, bus1 };
+    int i, j, present = 0;
+
+    for (i = 0; i < INA219_SENSORS; i++) {
+        int bus = buses[i / INA219_PER_BUS], addr = addresses[i % INA219_PER_BUS];
+        ina219_t *s = &b->sensor[i];
+
+        if (bus == 0 && addr == 0x45) {
+            if (ina219_open(s, 1, INA219_MOPOWER_ADDR, averaged) == PQWS_SUCCESS)
+                present++;
+            s->scale = 10;
+        } else if (ina219_open(s, bus, addr, averaged) == PQWS_SUCCESS) {
+            present++;
+        }
+    }
+
+    // a worker for each bus, the buses do not change once open
+    b->workers = 0;
+    b->sweep = 0;
+    b->pending = 0;
+    b->stop = 0;
+    pthread_mutex_init(&b->lock, NULL);
+    pthread_cond_init(&b->start, NULL);
+    pthread_cond_init(&b->done, NULL);
+    for (i = 0; i < INA219_SENSORS; i++) {
+        if (b->sensor[i].fd < 0)
+            continue;
+        for (j = 0; j < b->workers && b->worker[j].bus != b->sensor[i].bus; j++)
+            ;
+        if (j == b->workers) {
+            b->worker[j].bank = b;
+            b->worker[j].bus = b->sensor[i].bus;
+            b->worker[j].started = 0;
+            b->workers++;
+        }
+    }
+    for (i = 0; i < b->workers - 1; i++)
+        b->worker[i].started = (pthread_create(&b->worker[i].thread, NULL,
+                run_bus, &b->worker[i]) == 0);
+    return present;
+}
+
+/**
+ * Reads every sensor, 0 for the ones that do not answer.  The buses are
+ * independent, so the workers of all but the last bus are woken to read
+ * theirs while the calling thread reads the last, and the readings are
+ * returned when every bus is done: a sweep as long as that of the slowest
+ * bus rather than of all of them.  Each worker writes only the readings of
+ * the sensors on its bus.
+ * @param b the sensors
+ * @param voltage INA219_SENSORS bus voltages
+ * @param current INA219_SENSORS currents in milliamps
+ */
+void ina219_bank_read(ina219_bank_t *b, float *voltage, float *current) {
+    int i;
+
+    for (i = 0; i < INA219_SENSORS; i++) {
+        voltage[i] = 0;
+        current[i] = 0;
+    }
+    if (b->workers == 0)
+        return;
+
+    pthread_mutex_lock(&b->lock);
+    b->voltage = voltage;
+    b->current = current;
+    for (i = 0; i < b->workers; i++)
+        b->pending += b->worker[i].started;
+    b->sweep++;
+    pthread_cond_broadcast(&b->start);
+    pthread_mutex_unlock(&b->lock);
+
+    for (i = 0; i < b->workers; i++) {
+        if (!b->worker[i].started)
+            read_bus(b, b->worker[i].bus, voltage, current);
+    }
+
+    pthread_mutex_lock(&b->lock);
+    while (b->pending > 0)
+        pthread_cond_wait(&b->done, &b->lock);
+    pthread_mutex_unlock(&b->lock);
+}
+
+/**
+ * Stops the workers and closes the sensors
+ * @param b the sensors
+ */
+void ina219_bank_close(ina219_bank_t *b) {
+    int i;
+
+    pthread_mutex_lock(&b->lock);
+    b->stop = 1;
+    pthread_cond_broadcast(&b->start);
+    pthread_mutex_unlock(&b->lock);
+    for (i = 0; i < b->workers; i++) {
+        if (b->worker[i].started)
+            pthread_join(b->worker[i].thread, NULL);
+        b->worker[i].started = 0;
+    }
+    b->workers = 0;
+    pthread_mutex_destroy(&b->lock);
+    pthread_cond_destroy(&b->start);
+    pthread_cond_destroy(&b->done);
+
+    for (i = 0; i < INA219_SENSORS; i++)
+        ina219_close(&b->sensor[i]);
+}
@@ -0,0 +1,84 @@
+/*
+ *  INA219 voltage and current sensors of the CubeSatSim
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef INA219_H_
+#define INA219_H_
+
+#include <pthread.h>
+
+#define INA219_PER_BUS          4
+#define INA219_SENSORS          (2 * INA219_PER_BUS)
+#define INA219_MOPOWER_ADDR     0x4a    // read in place of 0x45 on bus 0
+#define INA219_BUSES            3       // the two buses and the MoPower one
+
+/**
+ * One INA219 with the 0.1 ohm shunt of the CubeSatSim boards, set up as
+ * the Adafruit driver used by voltcurrent.py sets it up: 32 V range, shunt
+ * gain /8 and a calibration of 4096, so that a bit of current is 0.1 mA.
+ */
+typedef struct {
+    int fd;                     //!< -1 if the bus cannot be opened
+    int bus;
+    int addr;
+    int present;                //!< answered the last time it was read
+    unsigned short config;      //!< written to the configuration register
+    float scale;                //!< of the current, 10 for the MoPower board
+} ina219_t;
+
+struct ina219_bank;
+
+/**
+ * Reads the sensors of one bus at each sweep
+ */
+typedef struct {
+    struct ina219_bank *bank;
+    int bus;
+    pthread_t thread;
+    int started;                //!< on a thread of its own, else read inline
+} ina219_worker_t;
+
+/**
+ * The sensors on two buses in the order voltcurrent.py prints them: 0x40,
+ * 0x41, 0x44 and 0x45 on the first bus, then on the second.  The sensors
+ * of a bus are read together in one combined I2C transfer, and the buses
+ * at the same time, each by a worker thread that waits between sweeps.
+ */
+typedef struct ina219_bank {
+    ina219_t sensor[INA219_SENSORS];
+    ina219_worker_t worker[INA219_BUSES];
+    int workers;                //!< buses with a sensor, the last read by the caller
+    pthread_mutex_t lock;
+    pthread_cond_t start;       //!< a sweep began, or the workers are to stop
+    pthread_cond_t done;        //!< the last worker of a sweep finished
+    unsigned int sweep;         //!< sweeps begun
+    int pending;                //!< workers not done with this sweep
+    int stop;
+    float *voltage;             //!< where the sweep puts the readings
+    float *current;
+} ina219_bank_t;
+
+int ina219_open(ina219_t *s, int bus, int addr, int averaged);
+int ina219_read(ina219_t *s, float *volts, float *milliamps);
+void ina219_close(ina219_t *s);
+
+int ina219_bank_open(ina219_bank_t *b, int bus0, int bus1, int averaged);
+void ina219_bank_read(ina219_bank_t *b, float *voltage, float *current);
+void ina219_bank_close(ina219_bank_t *b);
+
+#endif /* INA219_H_ */
@@ -30,6 +30,8 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <pthread.h>
+#include <getopt.h>
 
 // Wiring Pi Library
 // #include <wiringSerial.h>
@@ -45,11 +47,24 @@
 #include "ax5043.h"
 #include "ax25.h"
 #include "spi/ax5043spi.h"
-#include "TelemEncoding.h"
+#include "../foxtlm/foxtlm.h"
+#include "../foxtlm/wave.h"
+#include "../foxtlm/fifo.h"
+#include "../foxtlm/render.h"
+#include "../foxtlm/wod.h"
+#include "../foxtlm/stats.h"
+#include "../foxtlm/txlink.h"
+#include "../foxtlm/sampler.h"
+#include "ina219.h"
+#include "sensors.h"
 
 
 
 #define PORT 8080
+#define TX_RING_BYTES (64 * 1024) // samples kept while rpitx is behind
+#define TX_TIMEOUT_MS 10000 // longest wait for rpitx before reconnecting
+#define SAMPLE_RATE_HZ 10 // voltage and current readings per second between frames
+#define POWER_CHANNELS 16 // sampled: the voltages, then the currents
 
 #define A 1
 #define B 2
@@ -97,24 +112,49 @@ int twosToInt(int val, int len);
 float rnd_float(double min, double max);
 void get_tlm();
 void get_tlm_fox();
-int encodeA(short int * b, int index, int val);
-int encodeB(short int * b, int index, int val);
+void read_tlm_fox(foxtlm_tlm_t * tlm);
+void send_wod(foxtlm_tlm_t * tlm);
+int sample_wod(void * arg, float * values);
+int read_shared(sensors_t * h, sensors_sample_t * shared);
+int read_sensors(float * voltage, float * current, sensors_sample_t * shared);
+int sample_power(void * arg, float * values);
+void send_fox_frame(const unsigned char * bits, int n);
+void run_fox_pipeline(void);
+long clock_ms(void);
+void sim_tlm_init(void);
+void init_min_max(const char * path);
+void min_max_values(float * values, int first, int count, int max);
+int sim_tlm_fox(float * voltage, float * current, float * other);
+void build_tlm_fox(foxtlm_tlm_t * tlm, float * voltage, float * current, float * sensor, float * other,
+  const stats_acc_t * window, int payload_ok, int STEMBoardFailure, int NormalModeFailure);
+int render_fox(int argc, char * argv[]);
+void load_layout(const char * csv);
+void write_wav_header(FILE * out, const wave_t * w, long count);
+int render_chunk(void * arg, const void * samples, int count);
+int render_tlm(void * arg, long frame, foxtlm_tlm_t * tlm);
+double parse_duration(const char * str);
+void write_little_endian(unsigned int word, int num_bytes, FILE *wav_file);
 void config_x25();
 void trans_x25();
 int upper_digit(int number);
 int lower_digit(int number);
 static int init_rf();
-int socket_open = 0;
-int sock = 0;
+txlink_t tx; // samples to rpitx
 int loop = -1, loop_count = 0;
 int firstTime = ON;
 long start;
 int testCount = 0;
 long time_start;
-
-short int buffer[2336400]; // max size for 10 frames count of BPSK
+long virtual_ms = -1; // clock of the simulated telemetry when rendering to a file
 
 #define S_RATE	(48000) // (44100)
+#define IQ_RATE	(96000) // complex baseband sample rate for BPSK
+
+// BPSK goes to rpitx.py as the 3 kHz subcarrier audio for the csdr chain,
+// or as complex baseband straight to sendiq when BPSK_FORMAT=iq is set in
+// the .mode file, which rpitx.py reads too so the two stay in step
+#define BPSK_FORMAT_ENV "BPSK_FORMAT"
+int bpsk_format = WAVE_REAL;
 
 #define AFSK 1
 #define FSK 2
@@ -127,13 +167,52 @@ float amplitude; // = ; // 20000; // 32767/(10%amp+5%amp+100%amp)
 float freq_Hz = 3000; // 1200
 
 int smaller;
-int flip_ctr = 0;
-int phase = 1;
-int ctr = 0;
-int rd = 0;
-int nrd;
 void write_to_buffer(int i, int symbol, int val);
-void write_wave(int i, short int * buffer);
+int send_chunk(void * arg, const void * samples, int count);
+wave_t wave;
+wave_stream_t stream;
+foxtlm_t fox;
+plan_t layout;
+
+#define LAYOUT_DIR "/home/pi/CubeSatSim/spacecraft/FoxTelem_1.09m/"
+
+#define PIPELINE_DEPTH 1 // frames queued between pipeline stages
+
+#define WOD_FILE "/home/pi/CubeSatSim/wod.dat"
+#define WOD_RECORDS 4320 // three days of samples a minute apart
+#define WOD_PERIOD 60 // default seconds between WOD samples
+#define WOD_FRAME_EVERY 4 // BPSK frames per WOD frame while samples are waiting
+#define WOD_SYNC_MS 60000 // longest time samples stay only in memory
+
+#define STATS_FILE "/home/pi/CubeSatSim/stats.dat"
+#define STATS_WINDOW_SECS 5520 // the rolling window, about one orbit
+#define STATS_SYNC_MS 60000
+
+// Statistics channels: the voltages, currents, sensors and other readings
+#define STAT_VOLTAGE 0
+#define STAT_CURRENT 8
+#define STAT_SENSOR 16
+#define STAT_OTHER 33
+#define STAT_CHANNELS 36
+
+stats_t stats;
+long stats_synced;
+
+wod_t wod; // BPSK only, wod.map is NULL when the store is not open
+int wod_period = WOD_PERIOD, wod_frames = 0, wod_compressed = FALSE;
+long wod_synced;
+sampler_t wod_sampler; // takes the WOD samples on their own schedule
+pthread_mutex_t wod_lock = PTHREAD_MUTEX_INITIALIZER; // guards wod, wod_tlm and wod_power
+foxtlm_tlm_t wod_tlm; // the last telemetry built, the base of each WOD sample
+float wod_power[POWER_CHANNELS]; // the last voltages and currents sampled
+int wod_tlm_valid = FALSE, wod_power_valid = FALSE;
+
+typedef struct {
+  int n;
+  unsigned char bits[(FOXTLM_MAX_BITS + 7) / 8];
+} fox_frame_t;
+
+fifo_t tlm_queue, frame_queue;
 int uart_fd;
 
 int reset_count;
@@ -141,7 +220,7 @@ float uptime_sec;
 long int uptime;
 char call[5];
 
-int bitRate, mode, bufLen, rsFrames, payloads, rsFrameLen, dataLen, headerLen, syncBits, syncWord, parityLen, samples, frameCnt, samplePeriod;
+int bitRate, mode, bufLen, samples, frameCnt, samplePeriod;
 float sleepTime;
 int sampleTime = 0, frames_sent = 0;
 int cw_id = ON;
@@ -156,18 +235,25 @@ double eclipse_time;
 
 int test_i2c_bus(int bus);
 
-const char pythonCmd[] = "python3 /home/pi/CubeSatSim/python/voltcurrent.py ";
-char pythonStr[100], pythonConfigStr[100], busStr[10];
+int ina_bus0, ina_bus1, ina219_opened = FALSE;
+ina219_bank_t ina219;
+sensors_t shared_sensors = { -1, NULL, NULL, FALSE }, frame_sensors = { -1, NULL, NULL, FALSE };
+sampler_t sampler;
+int sample_rate = SAMPLE_RATE_HZ;
+int payload_sensord = FALSE; // the payload UART is sensord's
 int map[8] = {0, 1, 2, 3, 4, 5, 6, 7};
 char src_addr[5] = "";
 char dest_addr[5] = "CQ";
-float voltage_min[9], current_min[9], voltage_max[9], current_max[9], sensor_max[17], sensor_min[17], other_max[3], other_min[3];
 
 int main(int argc, char * argv[]) {
 
   mode = FSK;
   frameCnt = 1;
 
+  // Offline rendering of simulated telemetry, no hardware is touched
+  if ((argc > 1) && (strncmp(argv[1], "--", 2) == 0))
+    return render_fox(argc, argv);
+
   if (argc > 1) {
 
     // Sets the transmit modulation type
@@ -201,8 +287,37 @@ int main(int argc, char * argv[]) {
         printf("No CW id\n");
       }
     }
+
+    if (argc > 4) {
+      frameCnt = atoi(argv[4]);
+      if (frameCnt < 1)
+        frameCnt = 1;
+      printf("%d frames per telemetry cycle\n", frameCnt);
+    }
+
+    if (argc > 5) {
+      wod_period = atoi(argv[5]);
+      printf("WOD sample every %d seconds\n", wod_period);
+    }
+
+    if (argc > 6) {
+      if ( * argv[6] == 'z') {
+        wod_compressed = TRUE;
+        printf("Compressed WOD frames\n");
+      }
+    }
+
+    if (argc > 7) {
+      sample_rate = atoi(argv[7]);
+      printf("Sensors sampled %d times a second\n", sample_rate);
+    }
   }
 
+  if ((getenv(BPSK_FORMAT_ENV) != NULL) && (strcmp(getenv(BPSK_FORMAT_ENV), "iq") == 0))
+    bpsk_format = WAVE_IQ_S16;
+  if (mode == BPSK)
+    printf("BPSK sent as %s\n", (bpsk_format == WAVE_REAL) ? "audio" : "IQ");
+
   // Open configuration file with callsign and reset count	
   FILE * config_file = fopen("/home/pi/CubeSatSim/sim.cfg", "r");
 
@@ -347,7 +462,8 @@ int main(int argc, char * argv[]) {
   if (vB4) {
     map[BAT] = BUS;
     map[BUS] = BAT;
-    snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
+    ina_bus0 = test_i2c_bus(1);
+    ina_bus1 = test_i2c_bus(0);
   } 
   else if (vB5) {
     map[MINUS_X] = MINUS_Y;
@@ -356,10 +472,12 @@ int main(int argc, char * argv[]) {
 
     if (access("/dev/i2c-11", W_OK | R_OK) >= 0) { // Test if I2C Bus 11 is present			
       printf("/dev/i2c-11 is present\n\n");
-      snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(11));
+      ina_bus0 = test_i2c_bus(1);
+      ina_bus1 = test_i2c_bus(11);
     } 
     else {
-      snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(3));
+      ina_bus0 = test_i2c_bus(1);
+      ina_bus1 = test_i2c_bus(3);
     }
   } 
   else {
@@ -367,24 +485,26 @@ int main(int argc, char * argv[]) {
     map[BAT] = BUS;
     map[PLUS_Z] = BAT;
     map[MINUS_Z] = PLUS_Z;
-    snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
+    ina_bus0 = test_i2c_bus(1);
+    ina_bus1 = test_i2c_bus(0);
     batteryThreshold = 8.0;
   }
 
-  strcpy(pythonStr, pythonCmd);
-  strcat(pythonStr, busStr);
-  strcat(pythonConfigStr, pythonStr);
-  strcat(pythonConfigStr, " c");
-
-  //   FILE* file1 = popen("python3 /home/pi/CubeSatSim/python/voltcurrent.py 1 11 c", "r");
-  FILE * file1 = popen(pythonConfigStr, "r");
-  char cmdbuffer[1000];
-  fgets(cmdbuffer, 1000, file1);
-  //   printf("pythonStr result: %s\n", cmdbuffer);
-  pclose(file1);
+  // The sensors are left to sensord while it runs
+  sensors_sample_t shared;
+  if (sensors_attach( & shared_sensors, SENSORS_SHM) == PQWS_SUCCESS) {
+    printf("Reading sensors from sensord\n");
+    payload_sensord = (sensors_latest( & shared_sensors, & shared,
+      SENSORS_STALE_PERIODS * sensors_period( & shared_sensors)) == PQWS_SUCCESS) &&
+      (shared.flags & SENSORS_PAYLOAD);
+  }
 
   // Try connecting to Arduino payload using UART
-  if (!ax5043 && !vB3) // don't test if AX5043 is present
+  if (payload_sensord) {
+    payload = ON;
+    printf("Payload is read by sensord\n");
+  }
+  else if (!ax5043 && !vB3) // don't test if AX5043 is present
   {
     payload = OFF;
 
@@ -452,46 +572,7 @@ int main(int argc, char * argv[]) {
     printf("Simulated telemetry mode!\n");
 
     srand((unsigned int)time(0));
-
-    axis[0] = rnd_float(-0.2, 0.2);
-    if (axis[0] == 0)
-      axis[0] = rnd_float(-0.2, 0.2);
-    axis[1] = rnd_float(-0.2, 0.2);
-    axis[2] = (rnd_float(-0.2, 0.2) > 0) ? 1.0 : -1.0;
-
-    angle[0] = (float) atan(axis[1] / axis[2]);
-    angle[1] = (float) atan(axis[2] / axis[0]);
-    angle[2] = (float) atan(axis[1] / axis[0]);
-
-    volts_max[0] = rnd_float(4.5, 5.5) * (float) sin(angle[1]);
-    volts_max[1] = rnd_float(4.5, 5.5) * (float) cos(angle[0]);
-    volts_max[2] = rnd_float(4.5, 5.5) * (float) cos(angle[1] - angle[0]);
-
-    float amps_avg = rnd_float(150, 300);
-
-    amps_max[0] = (amps_avg + rnd_float(-25.0, 25.0)) * (float) sin(angle[1]);
-    amps_max[1] = (amps_avg + rnd_float(-25.0, 25.0)) * (float) cos(angle[0]);
-    amps_max[2] = (amps_avg + rnd_float(-25.0, 25.0)) * (float) cos(angle[1] - angle[0]);
-
-    batt = rnd_float(3.8, 4.3);
-    speed = rnd_float(1.0, 2.5);
-    eclipse = (rnd_float(-1, +4) > 0) ? 1.0 : 0.0;
-    period = rnd_float(150, 300);
-    tempS = rnd_float(20, 55);
-    temp_max = rnd_float(50, 70);
-    temp_min = rnd_float(10, 20);
-
-    #ifdef DEBUG_LOGGING
-    for (int i = 0; i < 3; i++)
-      printf("axis: %f angle: %f v: %f i: %f \n", axis[i], angle[i], volts_max[i], amps_max[i]);
-    printf("batt: %f speed: %f eclipse_time: %f eclipse: %f period: %f temp: %f max: %f min: %f\n", batt, speed, eclipse_time, eclipse, period, tempS, temp_max, temp_min);
-    #endif
-
-    time_start = (long int) millis();
-
-    eclipse_time = (long int)(millis() / 1000.0);
-    if (eclipse == 0.0)
-      eclipse_time -= period / 2; // if starting in eclipse, shorten interval	
+    sim_tlm_init();
   }
 
   //int ret;
@@ -508,20 +589,29 @@ int main(int argc, char * argv[]) {
     fprintf(stderr, " See http://cubesatsim.org/wiki for info about building a CubeSatSim\n\n");
   }
 
-  for (int i = 0; i < 9; i++) {
-    voltage_min[i] = 1000.0;
-    current_min[i] = 1000.0;
-    voltage_max[i] = -1000.0;
-    current_max[i] = -1000.0;
-  }
-  for (int i = 0; i < 17; i++) {
-    sensor_min[i] = 1000.0;
-    sensor_max[i] = -1000.0;
-    printf("Sensor min and max initialized!");
+  init_min_max(STATS_FILE);
+
+  // Set up the Fox encoder once, its running disparity carries over between frames
+  if (mode == FSK)
+    foxtlm_init( & fox, FOXTLM_FSK);
+  else if (mode == BPSK)
+    foxtlm_init( & fox, FOXTLM_BPSK);
+  if ((mode == FSK) || (mode == BPSK)) {
+    load_layout(NULL);
+    if (txlink_init( & tx, "127.0.0.1", PORT, TX_RING_BYTES, TX_TIMEOUT_MS) != PQWS_SUCCESS)
+      fprintf(stderr, "ERROR: Cannot set up the socket to rpitx\n");
   }
-  for (int i = 0; i < 3; i++) {
-    other_min[i] = 1000.0;
-    other_max[i] = -1000.0;
+
+  // Whole orbit data outlives restarts, so samples taken out of sight of a
+  // ground station are still sent later
+  if ((mode == BPSK) && (wod_period > 0)) {
+    if (wod_open( & wod, WOD_FILE, PLAN_VERSION, sizeof(foxtlm_wod_t), WOD_RECORDS) == PQWS_SUCCESS) {
+      printf("WOD store %s has %u samples waiting\n", WOD_FILE, wod_pending( & wod));
+      if (sampler_start_period( & wod_sampler, wod_period * 1000L, 1, sample_wod, NULL) != PQWS_SUCCESS)
+        fprintf(stderr, "ERROR: Failed to start the WOD sampler\n");
+    } else
+      fprintf(stderr, "INFO: Cannot open WOD store %s, no WOD frames\n", WOD_FILE);
+    wod_synced = clock_ms();
   }
 
   // Main loop
@@ -533,6 +623,13 @@ int main(int argc, char * argv[]) {
     #endif
     if ((batteryVoltage > 1.0) && (batteryVoltage < batteryThreshold)) { // no battery INA219 will give 0V, no battery plugged into INA219 will read < 1V
       fprintf(stderr, "Battery voltage too low: %f V - shutting down!\n", batteryVoltage);
+      if (stats.map)
+        stats_sync( & stats);
+      if (wod.map) {
+        pthread_mutex_lock( & wod_lock);
+        wod_sync( & wod);
+        pthread_mutex_unlock( & wod_lock);
+      }
       digitalWrite(txLed, txLedOff);
       digitalWrite(onLed, onLedOff);
       sleep(1);
@@ -550,19 +647,11 @@ int main(int argc, char * argv[]) {
 
     if (mode == FSK) {
       bitRate = 200;
-      rsFrames = 1;
-      payloads = 1;
-      rsFrameLen = 64;
-      headerLen = 6;
-      dataLen = 58;
-      syncBits = 10;
-      syncWord = 0b0011111010;
-      parityLen = 32;
       amplitude = 32767 / 3;
       samples = S_RATE / bitRate;
-      bufLen = (frameCnt * (syncBits + 10 * (headerLen + rsFrames * (rsFrameLen + parityLen))) * samples);
+      bufLen = (frameCnt * (fox.desc->sync_bits + 10 * (fox.desc->header_len + fox.desc->rs_frames * (fox.desc->rs_frame_len + fox.desc->parity_len))) * samples);
 
-      samplePeriod =  (int) (((float)((syncBits + 10 * (headerLen + rsFrames * (rsFrameLen + parityLen)))) / (float) bitRate) * 1000 - 500);
+      samplePeriod =  (int) (((float)((fox.desc->sync_bits + 10 * (fox.desc->header_len + fox.desc->rs_frames * (fox.desc->rs_frame_len + fox.desc->parity_len)))) / (float) bitRate) * 1000 - 500);
       sleepTime = 0.1f;
 
       printf("\n FSK Mode, %d bits per frame, %d bits per second, %d ms sample period\n",
@@ -570,30 +659,41 @@ int main(int argc, char * argv[]) {
     } 
     else if (mode == BPSK) {
       bitRate = 1200;
-      rsFrames = 3;
-      payloads = 6;
-      rsFrameLen = 159;
-      headerLen = 8;
-      dataLen = 78;
-      syncBits = 31;
-      syncWord = 0b1000111110011010010000101011101;
-      parityLen = 32;
       amplitude = 32767;
-      samples = S_RATE / bitRate;
-      bufLen = (frameCnt * (syncBits + 10 * (headerLen + rsFrames * (rsFrameLen + parityLen))) * samples);
+      samples = ((bpsk_format == WAVE_REAL) ? S_RATE : IQ_RATE) / bitRate;
+      bufLen = (frameCnt * (fox.desc->sync_bits + 10 * (fox.desc->header_len + fox.desc->rs_frames * (fox.desc->rs_frame_len + fox.desc->parity_len))) * samples);
 
-      //   samplePeriod = ((float)((syncBits + 10 * (headerLen + rsFrames * (rsFrameLen + parityLen))))/(float)bitRate) * 1000 - 1800;
-      //    samplePeriod = 3000;
-      //    sleepTime = 3.0;
-      samplePeriod = 2200; // reduce dut to python and sensor querying delays
-      sleepTime = 2.2f;
+      // the sensors no longer take seconds to read, so pace the frames by
+      // their air time as FSK does
+      samplePeriod = (int) (((float) foxtlm_frame_bits( & fox) / (float) bitRate) * 1000 - 500);
+      sleepTime = 0.1f;
 
       printf("\n BPSK Mode, bufLen: %d,  %d bits per frame, %d bits per second, %d seconds per frame %d ms sample period\n",
         bufLen, bufLen / (samples * frameCnt), bitRate, bufLen / (samples * frameCnt * bitRate), samplePeriod);
     }
 
+    // With several frames per cycle the sensors are read while the previous
+    // frame is on the air, so the frames only need pacing at their air time
+    if (((mode == FSK) || (mode == BPSK)) && (frameCnt > 1))
+      samplePeriod = (int) (((float) foxtlm_frame_bits( & fox) / (float) bitRate) * 1000);
+
+    // Build the waveform templates once, before the first frame
+    if (((mode == FSK) || (mode == BPSK)) && (wave.samples == 0)) {
+      smaller = (int) (S_RATE / (2 * freq_Hz));
+      if ((wave_init( & wave, (mode == BPSK), amplitude, freq_Hz, (mode == BPSK) ? samples * bitRate : S_RATE, samples, smaller) != PQWS_SUCCESS) ||
+        ((mode == BPSK) && (wave_set_format( & wave, bpsk_format) != PQWS_SUCCESS)))
+        fprintf(stderr, "ERROR: Failed to build waveform templates\n");
+      wave_stream_init( & stream, & wave, send_chunk, NULL);
+    }
+
+    // Sample the voltages and currents between frames from now on
+    if (((mode == FSK) || (mode == BPSK)) && !sim_mode && (sample_rate > 0) && !sampler.started) {
+      if (sampler_start( & sampler, sample_rate, POWER_CHANNELS, sample_power, NULL) != PQWS_SUCCESS)
+        fprintf(stderr, "ERROR: Failed to start the sensor sampler\n");
+    }
+
     //  sleep(1);  // Delay 1 second
-    ctr = 0;
+    stream.ctr = 0;
     #ifdef DEBUG_LOGGING
     fprintf(stderr, "INFO: Getting TLM Data\n");
     #endif
@@ -634,6 +734,18 @@ int main(int argc, char * argv[]) {
     printf("Done sleeping\n");
   }
 
+  sampler_stop( & wod_sampler);
+  if (wod.map)
+    wod_close( & wod);
+  if (stats.map)
+    stats_close( & stats);
+  sampler_stop( & sampler);
+  if (ina219_opened)
+    ina219_bank_close( & ina219);
+  if (shared_sensors.map)
+    sensors_close( & shared_sensors);
+  if (frame_sensors.map)
+    sensors_close( & frame_sensors);
   return 0;
 }
 
@@ -693,53 +805,26 @@ void get_tlm(void) {
     //  Reading I2C voltage and current sensors
 
     int count1;
-    char * token;
-    char cmdbuffer[1000];
-
-    // Calls voltcurrent.py with I2C buses
-    FILE * file = popen(pythonStr, "r");
-    fgets(cmdbuffer, 1000, file);
-    //   printf("result: %s\n", cmdbuffer);
-    pclose(file);
-
-    const char space[2] = " ";
-    token = strtok(cmdbuffer, space);
-
     float voltage[9], current[9];
+    sensors_sample_t shared;
 
     memset(voltage, 0, sizeof(voltage));
     memset(current, 0, sizeof(current));
 
-    // Stores the voltage and current data read by the python script
+    int from_sensord = read_sensors(voltage, current, & shared);
     for (count1 = 0; count1 < 8; count1++) {
-      if (token != NULL) {
-        voltage[count1] = (float) atof(token);
-
-        #ifdef DEBUG_LOGGING
-        //		 printf("voltage: %f ", voltage[count1]);
-        #endif
-
-        token = strtok(NULL, space);
-        if (token != NULL) {
-          current[count1] = (float) atof(token);
-          if ((current[count1] < 0) && (current[count1] > -0.5))
-            current[count1] *= (-1);
-
-          #ifdef DEBUG_LOGGING
-          //		    printf("current: %f\n", current[count1]);
-          #endif
-
-          token = strtok(NULL, space);
-        }
-      }
+      if ((current[count1] < 0) && (current[count1] > -0.5))
+        current[count1] *= (-1);
     }
 
     batteryVoltage = voltage[map[BAT]];
 
-    double cpuTemp;
+    double cpuTemp = 0;
 
-    FILE * cpuTempSensor = fopen("/sys/class/thermal/thermal_zone0/temp", "r");
-    if (cpuTempSensor) {
+    FILE * cpuTempSensor = from_sensord ? NULL : fopen("/sys/class/thermal/thermal_zone0/temp", "r");
+    if (from_sensord)
+      cpuTemp = shared.cpu_temp;
+    else if (cpuTempSensor) {
       fscanf(cpuTempSensor, "%lf", & cpuTemp);
       cpuTemp /= 1000;
 
@@ -747,8 +832,8 @@ void get_tlm(void) {
       printf("CPU Temp Read: %6.1f\n", cpuTemp);
       #endif
 
+      fclose(cpuTempSensor);
     }
-    fclose(cpuTempSensor);
 
     if (sim_mode) {
       // simulated telemetry 
@@ -921,7 +1006,13 @@ void get_tlm(void) {
 
     char sensor_payload[500];
 
-    if (payload == ON) {
+    if ((payload == ON) && from_sensord && (shared.flags & SENSORS_PAYLOAD)) {
+      strcpy(sensor_payload, shared.payload);
+      printf("Payload string: %s", sensor_payload);
+
+      strcat(str, sensor_payload); // append to telemetry string for transmission
+    }
+    else if ((payload == ON) && !payload_sensord) {
       char c;
       int charss = (char) serialDataAvail(uart_fd);
       if (charss != 0)
@@ -1039,703 +1130,896 @@ void get_tlm_fox() {
   #endif
   fclose(uptime_file);
 
-  int i;
-  //	long int sync = SYNC_WORD;
-  long int sync = syncWord;
+  long sent_before = stream.sent;
+  foxtlm_tlm_t tlm;
+  unsigned char bits[(FOXTLM_MAX_BITS + 7) / 8];
 
   smaller = (int) (S_RATE / (2 * freq_Hz));
 
-  //	short int b[DATA_LEN];
-  short int b[dataLen];
-  memset(b, 0, sizeof(b));
-
-  //	short int h[HEADER_LEN];
-  short int h[headerLen];
-  memset(h, 0, sizeof(h));
-
-  memset(buffer, 0xa5, sizeof(buffer));
-
-  //	short int b10[DATA_LEN], h10[HEADER_LEN];
-  //	short int rs_frame[RS_FRAMES][223];
-  //	unsigned char parities[RS_FRAMES][PARITY_LEN],inputByte;
-  //	short int b10[dataLen], h10[headerLen];
-  short int rs_frame[rsFrames][223];
-  unsigned char parities[rsFrames][parityLen], inputByte;
-
-  int id, frm_type = 0x01, STEMBoardFailure = 1, NormalModeFailure = 0, groundCommandCount = 0;
-  int PayloadFailure1 = 0, PayloadFailure2 = 0;
-  int PSUVoltage = 0, PSUCurrent = 0, Resets = 0, Rssi = 2048;
-  int batt_a_v = 0, batt_b_v = 0, batt_c_v = 0, battCurr = 0;
-  int posXv = 0, negXv = 0, posYv = 0, negYv = 0, posZv = 0, negZv = 0;
-  int posXi = 0, negXi = 0, posYi = 0, negYi = 0, posZi = 0, negZi = 0;
-  int head_offset = 0;
-  //  int xAngularVelocity = (-0.69)*(-10)*(-10) + 45.3 * (-10) + 2078, yAngularVelocity = (-0.69)*(-6)*(-6) + 45.3 * (-6) + 2078, zAngularVelocity = (-0.69)*(6)*(6) + 45.3 * (6) + 2078; // XAxisAngularVelocity
-  //  int xAngularVelocity = 2078, yAngularVelocity = 2078, zAngularVelocity = 2078;  // XAxisAngularVelocity Y and Z set to 0
-  // int xAngularVelocity = 2048, yAngularVelocity = 2048, zAngularVelocity = 2048; // XAxisAngularVelocity Y and Z set to 0
-  // int RXTemperature = 0, temp = 0, spin = 0;;
-  // float xAccel = 0.0, yAccel = 0.0, zAccel = 0.0;
-  // float BME280pressure = 0.0, BME280altitude = 0.0, BME280humidity = 0.0, BME280temperature = 0.0;
-  // float XSsensor1 = 0.0, XSsensor2 = 0.0, XSsensor3 = 0.0;
-  // int sensor1 = 0, sensor2 = 2048, sensor3 = 2048;
-
-  short int buffer_test[bufLen];
-  int buffSize;
-  buffSize = (int) sizeof(buffer_test);
-
-  if (mode == FSK)
-    id = 7;
-  else
-    id = 0; // 99 in h[6]
-
-  //  for (int frames = 0; frames < FRAME_CNT; frames++) 
-  for (int frames = 0; frames < frameCnt; frames++) {
+  if (frameCnt > 1) {
+    // Acquire and encode the next frames while this one is on the air
+    run_fox_pipeline();
+  } else {
+    //  for (int frames = 0; frames < FRAME_CNT; frames++) 
+    for (int frames = 0; frames < frameCnt; frames++) {
+      read_tlm_fox( & tlm);
+      send_fox_frame(bits, foxtlm_encode_bits( & fox, & tlm, bits));
+    }
+  }
+  #ifdef DEBUG_LOGGING
+  //	printf("\nValue of ctr after looping: %d Buffer Len: %d\n", ctr, buffSize);
+  //	printf("\ctr/samples = %d ctr/(samples*10) = %d\n\n", ctr/samples, ctr/(samples*10));
+  #endif
 
-    if (firstTime != ON) {
-      // delay for sample period
-      digitalWrite(txLed, txLedOn);
-      #ifdef DEBUG_LOGGING
-      printf("Tx LED On\n");
-      #endif
+  // int count;
+  //  for (count = 0; count < dataLen; count++) {
+  //      printf("%02X", b[count]);
+  //  }
+  //  printf("\n");
 
-      while ((millis() - sampleTime) < (unsigned int)samplePeriod)
-        sleep((unsigned int)sleepTime);
+  // send the last bits of the frame out of the pulse shaping before the gap
+  wave_stream_drain( & stream);
+  wave_stream_flush( & stream);
+  if ((tx.fd >= 0) && transmit) {
+    if (txlink_flush( & tx) != PQWS_SUCCESS)
+      printf("Lost the socket to rpitx, %lld bytes dropped\n", tx.dropped);
+    printf("Streamed %ld samples over socket, %ld ms since the last frame\n", stream.sent - sent_before, (long) millis() - start);
+    printf("Socket: %lld bytes queued, %lld sent, %lld dropped, %ld partial writes, %ld stalls, %d connections\n",
+      tx.queued, tx.sent, tx.dropped, tx.partial, tx.stalls, tx.connections);
+    start = millis();
+  }
+  if (!transmit) {
+    fprintf(stderr, "\nNo CubeSatSim Band Pass Filter detected.  No transmissions after the CW ID.\n");
+    fprintf(stderr, " See http://cubesatsim.org/wiki for info about building a CubeSatSim\n\n");
+  }
+  //    digitalWrite (0, HIGH);
 
-      digitalWrite(txLed, txLedOff);
-      #ifdef DEBUG_LOGGING
-      printf("Tx LED Off\n");
-      #endif
+  if (mode == FSK)
+    firstTime = 0;
+  else if (frames_sent > 0) //5)
+    firstTime = 0;
 
-      printf("Sample period: %d\n", millis() - (unsigned int)sampleTime);
-      sampleTime = (int) millis();
-    } else
-      printf("first time - no sleep\n");
+  return;
+}
 
-    int count1;
-    char * token;
-    char cmdbuffer[1000];
+// Waits out the sample period, then reads every sensor into one telemetry set
+void read_tlm_fox(foxtlm_tlm_t * tlm) {
+  int STEMBoardFailure = 1, NormalModeFailure = 0;
 
-    FILE * file = popen(pythonStr, "r");
-    fgets(cmdbuffer, 1000, file);
-    //  printf("result: %s\n", cmdbuffer);
-    pclose(file);
+  if (firstTime != ON) {
+    // delay for sample period
+    digitalWrite(txLed, txLedOn);
+    #ifdef DEBUG_LOGGING
+    printf("Tx LED On\n");
+    #endif
 
-    const char space[2] = " ";
-    token = strtok(cmdbuffer, space);
+    while ((millis() - sampleTime) < (unsigned int)samplePeriod)
+      usleep((useconds_t)(sleepTime * 1000000));
 
-    float voltage[9], current[9], sensor[17], other[3];
-    memset(voltage, 0, sizeof(voltage));
-    memset(current, 0, sizeof(current));
-    memset(sensor, 0, sizeof(sensor));
-    memset(other, 0, sizeof(other));
+    digitalWrite(txLed, txLedOff);
+    #ifdef DEBUG_LOGGING
+    printf("Tx LED Off\n");
+    #endif
 
+    printf("Sample period: %d\n", millis() - (unsigned int)sampleTime);
+    sampleTime = (int) millis();
+  } else
+    printf("first time - no sleep\n");
+
+  int count1, from_sensord;
+  float voltage[9], current[9], sensor[17], other[3];
+  sensors_sample_t shared;
+  stats_acc_t window[POWER_CHANNELS];
+  static float power[POWER_CHANNELS]; // means of the last samples taken
+  memset(voltage, 0, sizeof(voltage));
+  memset(current, 0, sizeof(current));
+  memset(sensor, 0, sizeof(sensor));
+  memset(other, 0, sizeof(other));
+
+  if (sampler.started) {
+    // the means of the samples since the last frame, or of the last ones
+    // taken if there are none
+    int taken = sampler_take( & sampler, window);
+    for (count1 = 0; (taken > 0) && (count1 < POWER_CHANNELS); count1++)
+      power[count1] = (float)(window[count1].sum / window[count1].count);
+    memcpy(voltage, power, 8 * sizeof(float));
+    memcpy(current, power + 8, 8 * sizeof(float));
+    printf("Sampled %d readings, %ld skipped, %ld late\n", taken, sampler.overruns, sampler.late);
+    from_sensord = read_shared( & frame_sensors, & shared);
+  } else {
+    from_sensord = read_sensors(voltage, current, & shared);
     for (count1 = 0; count1 < 8; count1++) {
-      if (token != NULL) {
-        voltage[count1] = (float) atof(token);
-        #ifdef DEBUG_LOGGING
-        //		printf("voltage: %f ", voltage[count1]);
-        #endif
-        token = strtok(NULL, space);
-        if (token != NULL) {
-          current[count1] = (float) atof(token);
-          if ((current[count1] < 0) && (current[count1] > -0.5))
-            current[count1] *= (-1.0f);
-          #ifdef DEBUG_LOGGING
-          //		 printf("current: %f\n", current[count1]);
-          #endif
-          token = strtok(NULL, space);
-        }
-      }
+      if ((current[count1] < 0) && (current[count1] > -0.5))
+        current[count1] *= (-1.0f);
     }
+  }
 
-    //	 printf("\n"); 	  
+  //	 printf("\n"); 	  
 
-    batteryVoltage = voltage[map[BAT]];
-    if (batteryVoltage < 3.5) {
-      NormalModeFailure = 1;
-      printf("Safe Mode!\n");
-    } else
-      NormalModeFailure = 0;
+  batteryVoltage = voltage[map[BAT]];
+  if (batteryVoltage < 3.5) {
+    NormalModeFailure = 1;
+    printf("Safe Mode!\n");
+  } else
+    NormalModeFailure = 0;
 
-    FILE * cpuTempSensor = fopen("/sys/class/thermal/thermal_zone0/temp", "r");
-    if (cpuTempSensor) {
-      double cpuTemp;
-      fscanf(cpuTempSensor, "%lf", & cpuTemp);
-      cpuTemp /= 1000;
+  FILE * cpuTempSensor = from_sensord ? NULL : fopen("/sys/class/thermal/thermal_zone0/temp", "r");
+  if (from_sensord)
+    other[IHU_TEMP] = shared.cpu_temp;
+  else if (cpuTempSensor) {
+    double cpuTemp;
+    fscanf(cpuTempSensor, "%lf", & cpuTemp);
+    cpuTemp /= 1000;
 
-      #ifdef DEBUG_LOGGING
-      printf("CPU Temp Read: %6.1f\n", cpuTemp);
-      #endif
+    #ifdef DEBUG_LOGGING
+    printf("CPU Temp Read: %6.1f\n", cpuTemp);
+    #endif
 
-      other[IHU_TEMP] = (double)cpuTemp;
+    other[IHU_TEMP] = (double)cpuTemp;
 
-      //    IHUcpuTemp = (int)((cpuTemp * 10.0) + 0.5);
-    }
+    //    IHUcpuTemp = (int)((cpuTemp * 10.0) + 0.5);
     fclose(cpuTempSensor);
+  }
 
-    char sensor_payload[500];
-
-    if (payload == ON) {
-      STEMBoardFailure = 0;
-
-      char c;
-      int charss = (char) serialDataAvail(uart_fd);
-      if (charss != 0)
-        printf("Clearing buffer of %d chars \n", charss);
-      while ((charss--> 0))
-        c = (char) serialGetchar(uart_fd); // clear buffer
+  char sensor_payload[500];
+  sensor_payload[0] = '\0';
 
-      unsigned int waitTime;
-      int i = 0;
-      serialPutchar(uart_fd, '?');
-      printf("Querying payload with ?\n");
-      waitTime = millis() + 500;
-      int end = FALSE;
-      //     int retry = FALSE;
-      while ((millis() < waitTime) && !end) {
-        int chars = (char) serialDataAvail(uart_fd);
-        while ((chars--> 0) && !end) {
-          c = (char) serialGetchar(uart_fd);
-          //	  printf ("%c", c);
-          //	  fflush(stdout);
-          if (c != '\n') {
-            sensor_payload[i++] = c;
-          } else {
-            end = TRUE;
-          }
-        }
-      }
-      sensor_payload[i++] = ' ';
-      //    sensor_payload[i++] = '\n';
-      sensor_payload[i] = '\0';
-      printf("Payload string: %s \n", sensor_payload);
-
-      if ((sensor_payload[0] == 'O') && (sensor_payload[1] == 'K')) // only process if valid payload response
-      {
-        int count1;
-        char * token;
-        //   char cmdbuffer[1000];
-
-        //	FILE *file = popen("python3 /home/pi/CubeSatSim/python/voltcurrent.py 1 11", "r");	
-        //    	fgets(cmdbuffer, 1000, file);
-        //	printf("result: %s\n", cmdbuffer);
-        //    	pclose(file);
-
-        const char space[2] = " ";
-        token = strtok(sensor_payload, space);
-        for (count1 = 0; count1 < 17; count1++) {
-          if (token != NULL) {
-            sensor[count1] = (float) atof(token);
-            #ifdef DEBUG_LOGGING
-            printf("sensor: %f ", sensor[count1]);
-            #endif
-            token = strtok(NULL, space);
-          }
+  if ((payload == ON) && from_sensord && (shared.flags & SENSORS_PAYLOAD)) {
+    STEMBoardFailure = 0;
+    snprintf(sensor_payload, sizeof(sensor_payload), "%s ", shared.payload);
+    printf("Payload string: %s \n", sensor_payload);
+  }
+  else if ((payload == ON) && !payload_sensord) {
+    STEMBoardFailure = 0;
+
+    char c;
+    int charss = (char) serialDataAvail(uart_fd);
+    if (charss != 0)
+      printf("Clearing buffer of %d chars \n", charss);
+    while ((charss--> 0))
+      c = (char) serialGetchar(uart_fd); // clear buffer
+
+    unsigned int waitTime;
+    int i = 0;
+    serialPutchar(uart_fd, '?');
+    printf("Querying payload with ?\n");
+    waitTime = millis() + 500;
+    int end = FALSE;
+    //     int retry = FALSE;
+    while ((millis() < waitTime) && !end) {
+      int chars = (char) serialDataAvail(uart_fd);
+      while ((chars--> 0) && !end) {
+        c = (char) serialGetchar(uart_fd);
+        //	  printf ("%c", c);
+        //	  fflush(stdout);
+        if (c != '\n') {
+          sensor_payload[i++] = c;
+        } else {
+          end = TRUE;
         }
-        printf("\n");
-
       }
-
     }
+    sensor_payload[i++] = ' ';
+    //    sensor_payload[i++] = '\n';
+    sensor_payload[i] = '\0';
+    printf("Payload string: %s \n", sensor_payload);
+  }
 
-    if (sim_mode) {
-      // simulated telemetry 
+  if (payload == ON) {
+    if ((sensor_payload[0] == 'O') && (sensor_payload[1] == 'K')) // only process if valid payload response
+    {
+      int count1;
+      char * token;
+      //   char cmdbuffer[1000];
 
-      double time = ((long int)millis() - time_start) / 1000.0;
+      //	FILE *file = popen("python3 /home/pi/CubeSatSim/python/voltcurrent.py 1 11", "r");	
+      //    	fgets(cmdbuffer, 1000, file);
+      //	printf("result: %s\n", cmdbuffer);
+      //    	pclose(file);
 
-      if ((time - eclipse_time) > period) {
-        eclipse = (eclipse == 1) ? 0 : 1;
-        eclipse_time = time;
-        printf("\n\nSwitching eclipse mode! \n\n");
+      const char space[2] = " ";
+      token = strtok(sensor_payload, space);
+      for (count1 = 0; count1 < 17; count1++) {
+        if (token != NULL) {
+          sensor[count1] = (float) atof(token);
+          #ifdef DEBUG_LOGGING
+          printf("sensor: %f ", sensor[count1]);
+          #endif
+          token = strtok(NULL, space);
+        }
       }
+      printf("\n");
 
-      /*
-        double Xi = eclipse * amps_max[0] * sin(2.0 * 3.14 * time / (46.0 * speed)) * fabs(sin(2.0 * 3.14 * time / (46.0 * speed))) + rnd_float(-2, 2);	  
-        double Yi = eclipse * amps_max[1] * sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14/2.0)) * fabs(sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14/2.0))) + rnd_float(-2, 2);	  
-        double Zi = eclipse * amps_max[2] * sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2])  * fabs(sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2])) + rnd_float(-2, 2);
-      */
-      double Xi = eclipse * amps_max[0] * (float) sin(2.0 * 3.14 * time / (46.0 * speed)) + rnd_float(-2, 2);
-      double Yi = eclipse * amps_max[1] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14 / 2.0)) + rnd_float(-2, 2);
-      double Zi = eclipse * amps_max[2] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2]) + rnd_float(-2, 2);
+    }
 
-      double Xv = eclipse * volts_max[0] * (float) sin(2.0 * 3.14 * time / (46.0 * speed)) + rnd_float(-0.2, 0.2);
-      double Yv = eclipse * volts_max[1] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14 / 2.0)) + rnd_float(-0.2, 0.2);
-      double Zv = 2.0 * eclipse * volts_max[2] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2]) + rnd_float(-0.2, 0.2);
+  }
 
-      // printf("Yi: %f Zi: %f %f %f Zv: %f \n", Yi, Zi, amps_max[2], angle[2], Zv);
+  if (sim_mode)
+    NormalModeFailure = sim_tlm_fox(voltage, current, other);
 
-      current[map[PLUS_X]] = (Xi >= 0) ? Xi : 0;
-      current[map[MINUS_X]] = (Xi >= 0) ? 0 : ((-1.0f) * Xi);
-      current[map[PLUS_Y]] = (Yi >= 0) ? Yi : 0;
-      current[map[MINUS_Y]] = (Yi >= 0) ? 0 : ((-1.0f) * Yi);
-      current[map[PLUS_Z]] = (Zi >= 0) ? Zi : 0;
-      current[map[MINUS_Z]] = (Zi >= 0) ? 0 : ((-1.0f) * Zi);
+  FILE * uptime_file = fopen("/proc/uptime", "r");
+  fscanf(uptime_file, "%f", & uptime_sec);
+  uptime = (int) uptime_sec;
+  fclose(uptime_file);
+  printf("Reset Count: %d Uptime since Reset: %ld \n", reset_count, uptime);
 
-      voltage[map[PLUS_X]] = (Xv >= 1) ? Xv : rnd_float(0.9, 1.1);
-      voltage[map[MINUS_X]] = (Xv <= -1) ? ((-1.0f) * Xv) : rnd_float(0.9, 1.1);
-      voltage[map[PLUS_Y]] = (Yv >= 1) ? Yv : rnd_float(0.9, 1.1);
-      voltage[map[MINUS_Y]] = (Yv <= -1) ? ((-1.0f) * Yv) : rnd_float(0.9, 1.1);
-      voltage[map[PLUS_Z]] = (Zv >= 1) ? Zv : rnd_float(0.9, 1.1);
-      voltage[map[MINUS_Z]] = (Zv <= -1) ? ((-1.0f) * Zv) : rnd_float(0.9, 1.1);
+  build_tlm_fox(tlm, voltage, current, sensor, other, sampler.started ? window : NULL,
+    (sensor_payload[0] == 'O') && (sensor_payload[1] == 'K'), STEMBoardFailure, NormalModeFailure);
+  send_wod(tlm);
+}
 
-      // printf("temp: %f Time: %f Eclipse: %d : %f %f | %f %f | %f %f\n",tempS, time, eclipse, voltage[map[PLUS_X]], voltage[map[MINUS_X]], voltage[map[PLUS_Y]], voltage[map[MINUS_Y]], current[map[PLUS_Z]], current[map[MINUS_Z]]);
+// Takes the latest readings of sensord through h, attaching to it first if
+// it has started since.  Returns FALSE when sensord is not running.
+int read_shared(sensors_t * h, sensors_sample_t * shared) {
+  if (!h->map && (sensors_attach(h, SENSORS_SHM) != PQWS_SUCCESS))
+    return FALSE;
+  if (sensors_latest(h, shared, SENSORS_STALE_PERIODS * sensors_period(h)) == PQWS_SUCCESS)
+    return TRUE;
+  // sensord stopped, a new one publishes in a new object
+  fprintf(stderr, "INFO: No recent readings from sensord\n");
+  sensors_close(h);
+  return FALSE;
+}
 
-      tempS += (eclipse > 0) ? ((temp_max - tempS) / 50.0f) : ((temp_min - tempS) / 50.0f);
-      tempS += +rnd_float(-1.0, 1.0);
-      //  IHUcpuTemp = (int)((tempS + rnd_float(-1.0, 1.0)) * 10 + 0.5);
-      other[IHU_TEMP] = tempS;
+// Reads the voltage and current sensors, or takes them from the latest
+// readings of sensord while it runs.  Returns TRUE with those readings, with
+// the CPU temperature and payload line, in shared when they came from
+// sensord.  Only the sampler thread calls this once it has started.
+int read_sensors(float * voltage, float * current, sensors_sample_t * shared) {
+  if (read_shared( & shared_sensors, shared)) {
+    memcpy(voltage, shared->voltage, sizeof(shared->voltage));
+    memcpy(current, shared->current, sizeof(shared->current));
+    return TRUE;
+  }
 
-      voltage[map[BUS]] = rnd_float(5.0, 5.005);
-      current[map[BUS]] = rnd_float(158, 171);
+  if (!ina219_opened) {
+    // Sets up the voltage and current sensors with 32 sample averaging
+    printf("INA219 sensors found: %d\n", ina219_bank_open( & ina219, ina_bus0, ina_bus1, TRUE));
+    ina219_opened = TRUE;
+  }
+  ina219_bank_read( & ina219, voltage, current);
+  return FALSE;
+}
 
-      //  float charging = current[map[PLUS_X]] + current[map[MINUS_X]] + current[map[PLUS_Y]] + current[map[MINUS_Y]] + current[map[PLUS_Z]] + current[map[MINUS_Z]];
-      float charging = eclipse * (fabs(amps_max[0] * 0.707) + fabs(amps_max[1] * 0.707) + rnd_float(-4.0, 4.0));
+// Sampler thread: reads the voltages and currents, or takes them from
+// sensord when it has published new ones
+int sample_power(void * arg, float * values) {
+  static unsigned long long last = 0;
+  sensors_sample_t shared;
+  (void) arg;
+
+  if (read_sensors(values, values + 8, & shared)) {
+    if (shared.count == last)
+      return 0;
+    last = shared.count;
+  }
+  for (int i = 8; i < POWER_CHANNELS; i++) {
+    if ((values[i] < 0) && (values[i] > -0.5))
+      values[i] *= (-1.0f);
+  }
+  pthread_mutex_lock( & wod_lock);
+  memcpy(wod_power, values, sizeof(wod_power));
+  wod_power_valid = TRUE;
+  pthread_mutex_unlock( & wod_lock);
+  return 1;
+}
 
-      current[map[BAT]] = ((current[map[BUS]] * voltage[map[BUS]]) / batt) - charging;
+// WOD sampler thread: stores the last telemetry built, with the voltages
+// and currents sampled since, so the samples keep to wod_period however
+// often frames are built
+int sample_wod(void * arg, float * values) {
+  foxtlm_wod_t sample;
+  float up = 0;
+  FILE * uptime_file = fopen("/proc/uptime", "r");
+  (void) arg;
+  (void) values;
 
-      //  printf("charging: %f bat curr: %f bus curr: %f bat volt: %f bus volt: %f \n",charging, current[map[BAT]], current[map[BUS]], batt, voltage[map[BUS]]);
+  if (uptime_file) {
+    if (fscanf(uptime_file, "%f", & up) != 1)
+      up = 0;
+    fclose(uptime_file);
+  }
 
-      batt -= (batt > 3.5) ? current[map[BAT]] / 30000 : current[map[BAT]] / 3000;
-      if (batt < 3.0) {
-        batt = 3.0;
-        NormalModeFailure = 1;
-        printf("Safe Mode!\n");
-      } else
-        NormalModeFailure = 0;
+  pthread_mutex_lock( & wod_lock);
+  if (wod_tlm_valid) {
+    if (wod_power_valid) {
+      for (int k = 0; k < FOXTLM_POWER_CHANNELS; k++) {
+        wod_tlm.voltage[k] = wod_power[map[k]];
+        wod_tlm.current[k] = wod_power[8 + map[k]];
+      }
+    }
+    if (up > 0)
+      wod_tlm.uptime = (long) up;
+    foxtlm_values( & wod_tlm, sample.value);
+    wod_append( & wod, & sample);
+  }
+  pthread_mutex_unlock( & wod_lock);
+  return 0;
+}
 
-      if (batt > 4.5)
-        batt = 4.5;
+// Hands the telemetry built to the WOD sampler, and turns every
+// WOD_FRAME_EVERY-th frame into a WOD frame while samples are waiting
+void send_wod(foxtlm_tlm_t * tlm) {
+  long now = clock_ms();
+
+  if (!wod.map)
+    return;
+
+  pthread_mutex_lock( & wod_lock);
+  wod_tlm = * tlm;
+  wod_tlm_valid = TRUE;
+
+  if ((++wod_frames % WOD_FRAME_EVERY == 0) && (wod_pending( & wod) > 0)) {
+    if (wod_compressed) {
+      // only the samples that fit leave the store
+      tlm->wod_count = wod_peek( & wod, tlm->wod, FOXTLM_MAX_WOD);
+      tlm->wod_count = foxtlm_wod_fit( & fox, tlm);
+      if (tlm->wod_count > 0)
+        wod_consume( & wod, tlm->wod_count);
+    } else {
+      tlm->wod_count = wod_drain( & wod, tlm->wod, FOXTLM_MAX_PAYLOADS);
+    }
+    if (tlm->wod_count > 0) {
+      tlm->frame_type = wod_compressed ? FOXTLM_WODZ_FRAME : FOXTLM_WOD_FRAME;
+      printf("Sending %sWOD frame with %d samples, %u waiting\n", wod_compressed ? "compressed " : "",
+        tlm->wod_count, wod_pending( & wod));
+    }
+  }
 
-      voltage[map[BAT]] = batt + rnd_float(-0.01, 0.01);
+  if (now - wod_synced >= WOD_SYNC_MS) {
+    if (wod_sync( & wod) != PQWS_SUCCESS)
+      fprintf(stderr, "INFO: Failed to write the WOD store\n");
+    wod_synced = now;
+  }
+  pthread_mutex_unlock( & wod_lock);
+}
 
-      // end of simulated telemetry
-    }
+// Milliseconds on the clock of the simulated telemetry: real time, or the
+// air time rendered so far with --render
+long clock_ms(void) {
+  if (virtual_ms >= 0)
+    return virtual_ms;
+  return (long) millis();
+}
 
-    for (count1 = 0; count1 < 8; count1++) {
-      if (voltage[count1] < voltage_min[count1])
-        voltage_min[count1] = voltage[count1];
-      if (current[count1] < current_min[count1])
-        current_min[count1] = current[count1];
+// Opens the minimum, maximum and mean readings sent in MIN and MAX frames.
+// They are kept in path for the whole mission, or only in memory when path
+// is NULL.
+void init_min_max(const char * path) {
+  if (stats_open( & stats, path, STAT_CHANNELS, STATS_WINDOW_SECS / STATS_BINS, reset_count) == PQWS_SUCCESS)
+    printf("Telemetry statistics in %s\n", path ? path : "memory");
+  else if ((path == NULL) || (stats_open( & stats, NULL, STAT_CHANNELS, STATS_WINDOW_SECS / STATS_BINS, reset_count) != PQWS_SUCCESS))
+    fprintf(stderr, "ERROR: Cannot keep telemetry statistics\n");
+  else
+    fprintf(stderr, "INFO: Cannot open %s, telemetry statistics only in memory\n", path);
+  stats_synced = clock_ms();
+}
 
-      if (voltage[count1] > voltage_max[count1])
-        voltage_max[count1] = voltage[count1];
-      if (current[count1] > current_max[count1])
-        current_max[count1] = current[count1];
+// Replaces count readings with their minimum or maximum over the mission,
+// leaving readings that have never been taken alone
+void min_max_values(float * values, int first, int count, int max) {
+  stats_value_t v;
 
-      printf("Vmin %f Vmax %f Imin %f Imax %f \n", voltage_min[count1], voltage_max[count1], current_min[count1], current_max[count1]);
-    }
+  for (int i = 0; i < count; i++)
+    if ((stats_get( & stats, STATS_MISSION, first + i, & v) == PQWS_SUCCESS) && (v.count > 0))
+      values[i] = max ? v.max : v.min;
+}
 
-    if ((sensor_payload[0] == 'O') && (sensor_payload[1] == 'K')) {
-      for (count1 = 0; count1 < 17; count1++) {
-        if (sensor[count1] < sensor_min[count1])
-          sensor_min[count1] = sensor[count1];
-        if (sensor[count1] > sensor_max[count1])
-          sensor_max[count1] = sensor[count1];
+// Picks the orbit, attitude and battery of the simulated satellite
+void sim_tlm_init(void) {
+  axis[0] = rnd_float(-0.2, 0.2);
+  if (axis[0] == 0)
+    axis[0] = rnd_float(-0.2, 0.2);
+  axis[1] = rnd_float(-0.2, 0.2);
+  axis[2] = (rnd_float(-0.2, 0.2) > 0) ? 1.0 : -1.0;
 
-        printf("Smin %f Smax %f \n", sensor_min[count1], sensor_max[count1]);
-      }
-    }
+  angle[0] = (float) atan(axis[1] / axis[2]);
+  angle[1] = (float) atan(axis[2] / axis[0]);
+  angle[2] = (float) atan(axis[1] / axis[0]);
 
-    for (count1 = 0; count1 < 3; count1++) {
-      if (other[count1] < other_min[count1])
-        other_min[count1] = other[count1];
-      if (other[count1] > other_max[count1])
-        other_max[count1] = other[count1];
+  volts_max[0] = rnd_float(4.5, 5.5) * (float) sin(angle[1]);
+  volts_max[1] = rnd_float(4.5, 5.5) * (float) cos(angle[0]);
+  volts_max[2] = rnd_float(4.5, 5.5) * (float) cos(angle[1] - angle[0]);
 
-      printf("Other min %f max %f \n", other_min[count1], other_max[count1]);
-    }
+  float amps_avg = rnd_float(150, 300);
 
-   if (mode == FSK) {	  
-    if (loop % 8 == 0) {
-      printf("Sending MIN frame \n");
-      frm_type = 0x03;
-      for (count1 = 0; count1 < 17; count1++) {
-        if (count1 < 3)
-          other[count1] = other_min[count1];
-        if (count1 < 8) {
-          voltage[count1] = voltage_min[count1];
-          current[count1] = current_min[count1];
-        }
-        if (sensor_min[count1] != 1000.0) // make sure values are valid
-          sensor[count1] = sensor_min[count1];
-      }
-    }
-    if ((loop + 4) % 8 == 0) {
-      printf("Sending MAX frame \n");
-      frm_type = 0x02;
-      for (count1 = 0; count1 < 17; count1++) {
-        if (count1 < 3)
-          other[count1] = other_max[count1];
-        if (count1 < 8) {
-          voltage[count1] = voltage_max[count1];
-          current[count1] = current_max[count1];
-        }
-        if (sensor_max[count1] != -1000.0) // make sure values are valid
-          sensor[count1] = sensor_max[count1];
-      }
-    }
-   }
-    memset(rs_frame, 0, sizeof(rs_frame));
-    memset(parities, 0, sizeof(parities));
+  amps_max[0] = (amps_avg + rnd_float(-25.0, 25.0)) * (float) sin(angle[1]);
+  amps_max[1] = (amps_avg + rnd_float(-25.0, 25.0)) * (float) cos(angle[0]);
+  amps_max[2] = (amps_avg + rnd_float(-25.0, 25.0)) * (float) cos(angle[1] - angle[0]);
 
-    FILE * uptime_file = fopen("/proc/uptime", "r");
-    fscanf(uptime_file, "%f", & uptime_sec);
-    uptime = (int) uptime_sec;
-    fclose(uptime_file);
-    printf("Reset Count: %d Uptime since Reset: %ld \n", reset_count, uptime);
-
-    h[0] = (short int) ((h[0] & 0xf8) | (id & 0x07)); // 3 bits
-    //    printf("h[0] %x\n", h[0]);
-    h[0] = (short int) ((h[0] & 0x07) | ((reset_count & 0x1f) << 3));
-    //    printf("h[0] %x\n", h[0]);
-    h[1] = (short int) ((reset_count >> 5) & 0xff);
-    //    printf("h[1] %x\n", h[1]);
-    h[2] = (short int) ((h[2] & 0xf8) | ((reset_count >> 13) & 0x07));
-    //    printf("h[2] %x\n", h[2]);
-    h[2] = (short int) ((h[2] & 0x0e) | ((uptime & 0x1f) << 3));
-    //    printf("h[2] %x\n", h[2]);
-    h[3] = (short int) ((uptime >> 5) & 0xff);
-    h[4] = (short int) ((uptime >> 13) & 0xff);
-    h[5] = (short int) ((h[5] & 0xf0) | ((uptime >> 21) & 0x0f));
-    h[5] = (short int) ((h[5] & 0x0f) | (frm_type << 4));
-
-    if (mode == BPSK)
-      h[6] = 99;
-
-    posXi = (int)(current[map[PLUS_X]] + 0.5) + 2048;
-    posYi = (int)(current[map[PLUS_Y]] + 0.5) + 2048;
-    posZi = (int)(current[map[PLUS_Z]] + 0.5) + 2048;
-    negXi = (int)(current[map[MINUS_X]] + 0.5) + 2048;
-    negYi = (int)(current[map[MINUS_Y]] + 0.5) + 2048;
-    negZi = (int)(current[map[MINUS_Z]] + 0.5) + 2048;
-
-    posXv = (int)(voltage[map[PLUS_X]] * 100);
-    posYv = (int)(voltage[map[PLUS_Y]] * 100);
-    posZv = (int)(voltage[map[PLUS_Z]] * 100);
-    negXv = (int)(voltage[map[MINUS_X]] * 100);
-    negYv = (int)(voltage[map[MINUS_Y]] * 100);
-    negZv = (int)(voltage[map[MINUS_Z]] * 100);
-
-    batt_c_v = (int)(voltage[map[BAT]] * 100);
-
-    battCurr = (int)(current[map[BAT]] + 0.5) + 2048;
-    PSUVoltage = (int)(voltage[map[BUS]] * 100);
-    PSUCurrent = (int)(current[map[BUS]] + 0.5) + 2048;
-
-    if (payload == ON)
-      STEMBoardFailure = 0;
-
-    //  if (payload == ON)
-    //	  STEMBoardFailure = 0;
+  batt = rnd_float(3.8, 4.3);
+  speed = rnd_float(1.0, 2.5);
+  eclipse = (rnd_float(-1, +4) > 0) ? 1.0 : 0.0;
+  period = rnd_float(150, 300);
+  tempS = rnd_float(20, 55);
+  temp_max = rnd_float(50, 70);
+  temp_min = rnd_float(10, 20);
 
-    // read payload sensor if available
+  #ifdef DEBUG_LOGGING
+  for (int i = 0; i < 3; i++)
+    printf("axis: %f angle: %f v: %f i: %f \n", axis[i], angle[i], volts_max[i], amps_max[i]);
+  printf("batt: %f speed: %f eclipse_time: %f eclipse: %f period: %f temp: %f max: %f min: %f\n", batt, speed, eclipse_time, eclipse, period, tempS, temp_max, temp_min);
+  #endif
 
-    encodeA(b, 0 + head_offset, batt_a_v);
-    encodeB(b, 1 + head_offset, batt_b_v);
-    encodeA(b, 3 + head_offset, batt_c_v);
+  time_start = clock_ms();
 
-    //  encodeB(b, 4 + head_offset, (int)(xAccel * 100 + 0.5) + 2048);	  // Xaccel
-    //  encodeA(b, 6 + head_offset, (int)(yAccel * 100 + 0.5) + 2048);	  // Yaccel
-    //  encodeB(b, 7 + head_offset, (int)(zAccel * 100 + 0.5) + 2048);	  // Zaccel
+  eclipse_time = (long int)(clock_ms() / 1000.0);
+  if (eclipse == 0.0)
+    eclipse_time -= period / 2; // if starting in eclipse, shorten interval	
+}
 
-    encodeB(b, 4 + head_offset, (int)(sensor[ACCEL_X] * 100 + 0.5) + 2048); // Xaccel
-    encodeA(b, 6 + head_offset, (int)(sensor[ACCEL_Y] * 100 + 0.5) + 2048); // Yaccel
-    encodeB(b, 7 + head_offset, (int)(sensor[ACCEL_Z] * 100 + 0.5) + 2048); // Zaccel
+// Advances the simulated satellite to the current clock and writes its
+// solar panel, bus and battery readings.  Returns 1 in safe mode.
+int sim_tlm_fox(float * voltage, float * current, float * other) {
+  int failure;
 
-    encodeA(b, 9 + head_offset, battCurr);
+  double time = (clock_ms() - time_start) / 1000.0;
 
-    //  encodeB(b, 10 + head_offset,(int)(BME280temperature * 10 + 0.5));	// Temp
-    encodeB(b, 10 + head_offset, (int)(sensor[TEMP] * 10 + 0.5)); // Temp	  
+  if ((time - eclipse_time) > period) {
+    eclipse = (eclipse == 1) ? 0 : 1;
+    eclipse_time = time;
+    printf("\n\nSwitching eclipse mode! \n\n");
+  }
 
-    if (mode == FSK) {
-      encodeA(b, 12 + head_offset, posXv);
-      encodeB(b, 13 + head_offset, negXv);
-      encodeA(b, 15 + head_offset, posYv);
-      encodeB(b, 16 + head_offset, negYv);
-      encodeA(b, 18 + head_offset, posZv);
-      encodeB(b, 19 + head_offset, negZv);
-
-      encodeA(b, 21 + head_offset, posXi);
-      encodeB(b, 22 + head_offset, negXi);
-      encodeA(b, 24 + head_offset, posYi);
-      encodeB(b, 25 + head_offset, negYi);
-      encodeA(b, 27 + head_offset, posZi);
-      encodeB(b, 28 + head_offset, negZi);
-    } else // BPSK
-    {
-      encodeA(b, 12 + head_offset, posXv);
-      encodeB(b, 13 + head_offset, posYv);
-      encodeA(b, 15 + head_offset, posZv);
-      encodeB(b, 16 + head_offset, negXv);
-      encodeA(b, 18 + head_offset, negYv);
-      encodeB(b, 19 + head_offset, negZv);
-
-      encodeA(b, 21 + head_offset, posXi);
-      encodeB(b, 22 + head_offset, posYi);
-      encodeA(b, 24 + head_offset, posZi);
-      encodeB(b, 25 + head_offset, negXi);
-      encodeA(b, 27 + head_offset, negYi);
-      encodeB(b, 28 + head_offset, negZi);
-    }
+  /*
+    double Xi = eclipse * amps_max[0] * sin(2.0 * 3.14 * time / (46.0 * speed)) * fabs(sin(2.0 * 3.14 * time / (46.0 * speed))) + rnd_float(-2, 2);	  
+    double Yi = eclipse * amps_max[1] * sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14/2.0)) * fabs(sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14/2.0))) + rnd_float(-2, 2);	  
+    double Zi = eclipse * amps_max[2] * sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2])  * fabs(sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2])) + rnd_float(-2, 2);
+  */
+  double Xi = eclipse * amps_max[0] * (float) sin(2.0 * 3.14 * time / (46.0 * speed)) + rnd_float(-2, 2);
+  double Yi = eclipse * amps_max[1] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14 / 2.0)) + rnd_float(-2, 2);
+  double Zi = eclipse * amps_max[2] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2]) + rnd_float(-2, 2);
 
-    encodeA(b, 30 + head_offset, PSUVoltage);
-    //  encodeB(b, 31 + head_offset,(spin * 10) + 2048);	  
-    encodeB(b, 31 + head_offset, ((int)(other[SPIN] * 10)) + 2048);
+  double Xv = eclipse * volts_max[0] * (float) sin(2.0 * 3.14 * time / (46.0 * speed)) + rnd_float(-0.2, 0.2);
+  double Yv = eclipse * volts_max[1] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + (3.14 / 2.0)) + rnd_float(-0.2, 0.2);
+  double Zv = 2.0 * eclipse * volts_max[2] * (float) sin((2.0 * 3.14 * time / (46.0 * speed)) + 3.14 + angle[2]) + rnd_float(-0.2, 0.2);
 
-    //  encodeA(b, 33 + head_offset,(int)(BME280pressure + 0.5));  // Pressure
-    //  encodeB(b, 34 + head_offset,(int)(BME280altitude + 0.5));   // Altitude
+  // printf("Yi: %f Zi: %f %f %f Zv: %f \n", Yi, Zi, amps_max[2], angle[2], Zv);
 
-    encodeA(b, 33 + head_offset, (int)(sensor[PRES] + 0.5)); // Pressure
-    encodeB(b, 34 + head_offset, (int)(sensor[ALT] * 10.0 + 0.5)); // Altitude
+  current[map[PLUS_X]] = (Xi >= 0) ? Xi : 0;
+  current[map[MINUS_X]] = (Xi >= 0) ? 0 : ((-1.0f) * Xi);
+  current[map[PLUS_Y]] = (Yi >= 0) ? Yi : 0;
+  current[map[MINUS_Y]] = (Yi >= 0) ? 0 : ((-1.0f) * Yi);
+  current[map[PLUS_Z]] = (Zi >= 0) ? Zi : 0;
+  current[map[MINUS_Z]] = (Zi >= 0) ? 0 : ((-1.0f) * Zi);
 
-    encodeA(b, 36 + head_offset, Resets);
-    //  encodeB(b, 37 + head_offset,  Rssi);	
-    encodeB(b, 37 + head_offset, (int)(other[RSSI] + 0.5) + 2048);
+  voltage[map[PLUS_X]] = (Xv >= 1) ? Xv : rnd_float(0.9, 1.1);
+  voltage[map[MINUS_X]] = (Xv <= -1) ? ((-1.0f) * Xv) : rnd_float(0.9, 1.1);
+  voltage[map[PLUS_Y]] = (Yv >= 1) ? Yv : rnd_float(0.9, 1.1);
+  voltage[map[MINUS_Y]] = (Yv <= -1) ? ((-1.0f) * Yv) : rnd_float(0.9, 1.1);
+  voltage[map[PLUS_Z]] = (Zv >= 1) ? Zv : rnd_float(0.9, 1.1);
+  voltage[map[MINUS_Z]] = (Zv <= -1) ? ((-1.0f) * Zv) : rnd_float(0.9, 1.1);
 
-    //  encodeA(b, 39 + head_offset,  IHUcpuTemp);
-    encodeA(b, 39 + head_offset, (int)(other[IHU_TEMP] * 10 + 0.5));
+  // printf("temp: %f Time: %f Eclipse: %d : %f %f | %f %f | %f %f\n",tempS, time, eclipse, voltage[map[PLUS_X]], voltage[map[MINUS_X]], voltage[map[PLUS_Y]], voltage[map[MINUS_Y]], current[map[PLUS_Z]], current[map[MINUS_Z]]);
 
-    //  encodeB(b, 40 + head_offset,  xAngularVelocity);
-    //  encodeA(b, 42 + head_offset,  yAngularVelocity);
-    //  encodeB(b, 43 + head_offset,  zAngularVelocity);
+  tempS += (eclipse > 0) ? ((temp_max - tempS) / 50.0f) : ((temp_min - tempS) / 50.0f);
+  tempS += +rnd_float(-1.0, 1.0);
+  //  IHUcpuTemp = (int)((tempS + rnd_float(-1.0, 1.0)) * 10 + 0.5);
+  other[IHU_TEMP] = tempS;
 
-    encodeB(b, 40 + head_offset, (int)(sensor[GYRO_X] + 0.5) + 2048);
-    encodeA(b, 42 + head_offset, (int)(sensor[GYRO_Y] + 0.5) + 2048);
-    encodeB(b, 43 + head_offset, (int)(sensor[GYRO_Z] + 0.5) + 2048);
+  voltage[map[BUS]] = rnd_float(5.0, 5.005);
+  current[map[BUS]] = rnd_float(158, 171);
 
-    //  encodeA(b, 45 + head_offset, (int)(BME280humidity + 0.5));  // in place of sensor1
-    encodeA(b, 45 + head_offset, (int)(sensor[HUMI] + 0.5)); // in place of sensor1
+  //  float charging = current[map[PLUS_X]] + current[map[MINUS_X]] + current[map[PLUS_Y]] + current[map[MINUS_Y]] + current[map[PLUS_Z]] + current[map[MINUS_Z]];
+  float charging = eclipse * (fabs(amps_max[0] * 0.707) + fabs(amps_max[1] * 0.707) + rnd_float(-4.0, 4.0));
 
-    encodeB(b, 46 + head_offset, PSUCurrent);
-    //  encodeA(b, 48 + head_offset, (int)(XSsensor2) + 2048);
-    //  encodeB(b, 49 + head_offset, (int)(XSsensor3 * 100 + 0.5) + 2048);
+  current[map[BAT]] = ((current[map[BUS]] * voltage[map[BUS]]) / batt) - charging;
 
-    encodeA(b, 48 + head_offset, (int)(sensor[XS2]) + 2048);
-    encodeB(b, 49 + head_offset, (int)(sensor[XS3] * 100 + 0.5) + 2048);
+  //  printf("charging: %f bat curr: %f bus curr: %f bat volt: %f bus volt: %f \n",charging, current[map[BAT]], current[map[BUS]], batt, voltage[map[BUS]]);
 
-    // camera = ON;
+  batt -= (batt > 3.5) ? current[map[BAT]] / 30000 : current[map[BAT]] / 3000;
+  if (batt < 3.0) {
+    batt = 3.0;
+    failure = 1;
+    printf("Safe Mode!\n");
+  } else
+    failure = 0;
 
-    int status = STEMBoardFailure + NormalModeFailure * 2 + PayloadFailure1 * 4 + PayloadFailure2 * 8 +
-      (i2c_bus0 == OFF) * 16 + (i2c_bus1 == OFF) * 32 + (i2c_bus3 == OFF) * 64 + (camera == OFF) * 128 + groundCommandCount * 256;
+  if (batt > 4.5)
+    batt = 4.5;
 
-    encodeA(b, 51 + head_offset, status);
-    //  encodeA(b, 51 + head_offset, STEMBoardFailure + NormalModeFailure * 2 + (i2c_bus0 == OFF) * 16 + (i2c_bus1 == OFF) * 32 + (i2c_bus3 == OFF) * 64  + (0) * 128 + 1 * 256 + 1 * 512 + 1 * 1024 + 1*2048); 
-    encodeB(b, 52 + head_offset, rxAntennaDeployed + txAntennaDeployed * 2);
+  voltage[map[BAT]] = batt + rnd_float(-0.01, 0.01);
 
-    if (txAntennaDeployed == 0) {
-      txAntennaDeployed = 1;
-      printf("TX Antenna Deployed!\n");
-    }
-    
-    if (mode == BPSK) {  // WOD field experiments
-      encodeA(b, 63 + head_offset, 0xff);  
-      encodeB(b, 74 + head_offset, 0xff);	
+  return failure;
+}
+
+// Adds the readings to the statistics and fills in one telemetry set,
+// sending the minimum or maximum values instead every 8 FSK frames.  The
+// voltages and currents sampled since the last frame, when there is a
+// window of them, go to the statistics in place of their means.
+void build_tlm_fox(foxtlm_tlm_t * tlm, float * voltage, float * current, float * sensor, float * other,
+  const stats_acc_t * window, int payload_ok, int STEMBoardFailure, int NormalModeFailure) {
+  int frm_type = 0x01;
+
+  if (stats.map) {
+    if (window) {
+      stats_merge( & stats, uptime, STAT_VOLTAGE, window, 8);
+      stats_merge( & stats, uptime, STAT_CURRENT, window + 8, 8);
+    } else {
+      stats_add( & stats, uptime, STAT_VOLTAGE, voltage, 8);
+      stats_add( & stats, uptime, STAT_CURRENT, current, 8);
     }
-    short int data10[headerLen + rsFrames * (rsFrameLen + parityLen)];
-    short int data8[headerLen + rsFrames * (rsFrameLen + parityLen)];
-
-    int ctr1 = 0;
-    int ctr3 = 0;
-    for (i = 0; i < rsFrameLen; i++) {
-      for (int j = 0; j < rsFrames; j++) {
-        if (!((i == (rsFrameLen - 1)) && (j == 2))) // skip last one for BPSK
-        {
-          if (ctr1 < headerLen) {
-            rs_frame[j][i] = h[ctr1];
-            update_rs(parities[j], h[ctr1]);
-            //      				printf("header %d rs_frame[%d][%d] = %x \n", ctr1, j, i, h[ctr1]);
-            data8[ctr1++] = rs_frame[j][i];
-            //				printf ("data8[%d] = %x \n", ctr1 - 1, rs_frame[j][i]);
-          } else {
-            rs_frame[j][i] = b[ctr3 % dataLen];
-            update_rs(parities[j], b[ctr3 % dataLen]);
-            //  				printf("%d rs_frame[%d][%d] = %x %d \n", 
-            //  					ctr1, j, i, b[ctr3 % DATA_LEN], ctr3 % DATA_LEN);
-            data8[ctr1++] = rs_frame[j][i];
-            //			printf ("data8[%d] = %x \n", ctr1 - 1, rs_frame[j][i]);
-            ctr3++;
-          }
-        }
-      }
+    if (payload_ok)
+      stats_add( & stats, uptime, STAT_SENSOR, sensor, 17);
+    stats_add( & stats, uptime, STAT_OTHER, other, 3);
+    if (clock_ms() - stats_synced >= STATS_SYNC_MS) {
+      stats_sync( & stats);
+      stats_synced = clock_ms();
     }
+  }
 
-    #ifdef DEBUG_LOGGING
-    //	printf("\nAt end of data8 write, %d ctr1 values written\n\n", ctr1);
-    /*
-    	  printf("Parities ");
-    		for (int m = 0; m < parityLen; m++) {
-    		 	printf("%d ", parities[0][m]);
-    		}
-    		printf("\n");
-    */
-    #endif
+  if ((mode == FSK) && ((loop % 8 == 0) || ((loop + 4) % 8 == 0))) {
+    int max = ((loop + 4) % 8 == 0);
 
-    int ctr2 = 0;
-    memset(data10, 0, sizeof(data10));
+    printf("Sending %s frame \n", max ? "MAX" : "MIN");
+    frm_type = max ? 0x02 : 0x03;
+    min_max_values(voltage, STAT_VOLTAGE, 8, max);
+    min_max_values(current, STAT_CURRENT, 8, max);
+    min_max_values(sensor, STAT_SENSOR, 17, max);
+    min_max_values(other, STAT_OTHER, 3, max);
+  }
 
-    for (i = 0; i < dataLen * payloads + headerLen; i++) // 476 for BPSK
-    {
-      data10[ctr2] = (Encode_8b10b[rd][((int) data8[ctr2])] & 0x3ff);
-      nrd = (Encode_8b10b[rd][((int) data8[ctr2])] >> 10) & 1;
-      //		printf ("data10[%d] = encoded data8[%d] = %x \n",
-      //		 	ctr2, ctr2, data10[ctr2]); 
+  tlm->frame_type = frm_type;
+  tlm->reset_count = reset_count;
+  tlm->uptime = uptime;
+  for (int k = 0; k < FOXTLM_POWER_CHANNELS; k++) {
+    tlm->voltage[k] = voltage[map[k]];
+    tlm->current[k] = current[map[k]];
+  }
+  tlm->accel[0] = sensor[ACCEL_X];
+  tlm->accel[1] = sensor[ACCEL_Y];
+  tlm->accel[2] = sensor[ACCEL_Z];
+  tlm->gyro[0] = sensor[GYRO_X];
+  tlm->gyro[1] = sensor[GYRO_Y];
+  tlm->gyro[2] = sensor[GYRO_Z];
+  tlm->temp = sensor[TEMP];
+  tlm->pressure = sensor[PRES];
+  tlm->altitude = sensor[ALT];
+  tlm->humidity = sensor[HUMI];
+  tlm->xs2 = sensor[XS2];
+  tlm->xs3 = sensor[XS3];
+  tlm->spin = other[SPIN];
+  tlm->rssi = other[RSSI];
+  tlm->ihu_temp = other[IHU_TEMP];
+  tlm->stem_board_failure = STEMBoardFailure;
+  tlm->normal_mode_failure = NormalModeFailure;
+  tlm->i2c_bus0 = (i2c_bus0 != OFF);
+  tlm->i2c_bus1 = (i2c_bus1 != OFF);
+  tlm->i2c_bus3 = (i2c_bus3 != OFF);
+  tlm->camera = (camera != OFF);
+  tlm->rx_antenna_deployed = rxAntennaDeployed;
+  tlm->tx_antenna_deployed = txAntennaDeployed;
+
+  if (txAntennaDeployed == 0) {
+    txAntennaDeployed = 1;
+    printf("TX Antenna Deployed!\n");
+  }
+}
 
-      rd = nrd; // ^ nrd;
-      ctr2++;
-    }
-    for (i = 0; i < parityLen; i++) {
-      for (int j = 0; j < rsFrames; j++) {
-        data10[ctr2++] = (Encode_8b10b[rd][((int) parities[j][i])] & 0x3ff);
-        nrd = (Encode_8b10b[rd][((int) parities[j][i])] >> 10) & 1;
-        //	printf ("data10[%d] = encoded parities[%d][%d] = %x \n",
-        //		 ctr2 - 1, j, i, data10[ctr2 - 1]); 
-
-        rd = nrd;
-      }
+// Streams the bits of one frame to rpitx, opening the socket if needed
+void send_fox_frame(const unsigned char * bits, int n) {
+  int i;
+
+  // Open the socket to rpitx before the first chunk is ready, and again at
+  // the start of a frame after rpitx has gone away
+  if ((tx.fd < 0) && transmit) {
+    printf("Opening socket!\n");
+    if (txlink_connect( & tx) != PQWS_SUCCESS) {
+      printf("\nConnection Failed \n");
+      printf("Error: %s \n", strerror(errno));
     }
-    #ifdef DEBUG_LOGGING
-    // 	printf("\nAt end of data10 write, %d ctr2 values written\n\n", ctr2);
-    #endif
+  }
 
-    int data;
-    int val;
-    //int offset = 0;
+  // Each bit period is synthesized and streamed out in chunks by send_chunk()
+  for (i = 0; i < n; i++)
+    wave_stream_bit( & stream, foxtlm_bit(bits, i));
+}
 
-    #ifdef DEBUG_LOGGING
-    //	printf("\nAt start of buffer loop, syncBits %d samples %d ctr %d\n", syncBits, samples, ctr);
-    #endif
+// Sensor stage of the pipeline: one telemetry set per frame
+void * fox_sensor_stage(void * arg) {
+  foxtlm_tlm_t tlm;
+  (void) arg;
 
-    for (i = 1; i <= syncBits * samples; i++) {
-      write_wave(ctr, buffer);
-      //		printf("%d ",ctr);
-      if ((i % samples) == 0) {
-        int bit = syncBits - i / samples + 1;
-        val = sync;
-        data = val & 1 << (bit - 1);
-        //   	printf ("%d i: %d new frame %d sync bit %d = %d \n",
-        //  		 ctr/SAMPLES, i, frames, bit, (data > 0) );
-        if (mode == FSK) {
-          phase = ((data != 0) * 2) - 1;
-          //		printf("Sending a %d\n", phase);
-        } else {
-          if (data == 0) {
-            phase *= -1;
-            if ((ctr - smaller) > 0) {
-              for (int j = 1; j <= smaller; j++)
-                buffer[ctr - j] = buffer[ctr - j] * 0.4;
-            }
-            flip_ctr = ctr;
-          }
-        }
-      }
-    }
-    #ifdef DEBUG_LOGGING
-    //	printf("\n\nValue of ctr after header: %d Buffer Len: %d\n\n", ctr, buffSize);
-    #endif
-    for (i = 1; i <= (10 * (headerLen + dataLen * payloads + rsFrames * parityLen) * samples); i++) // 572   
-    {
-      write_wave(ctr, buffer);
-      if ((i % samples) == 0) {
-        int symbol = (int)((i - 1) / (samples * 10));
-        int bit = 10 - (i - symbol * samples * 10) / samples + 1;
-        val = data10[symbol];
-        data = val & 1 << (bit - 1);
-        //		printf ("%d i: %d new frame %d data10[%d] = %x bit %d = %d \n",
-        //	    		 ctr/SAMPLES, i, frames, symbol, val, bit, (data > 0) );
-        if (mode == FSK) {
-          phase = ((data != 0) * 2) - 1;
-          //			printf("Sending a %d\n", phase);
-        } else {
-          if (data == 0) {
-            phase *= -1;
-            if ((ctr - smaller) > 0) {
-              for (int j = 1; j <= smaller; j++)
-                buffer[ctr - j] = buffer[ctr - j] * 0.4;
-            }
-            flip_ctr = ctr;
-          }
-        }
-      }
-    }
+  for (int frames = 0; frames < frameCnt; frames++) {
+    read_tlm_fox( & tlm);
+    if (fifo_push( & tlm_queue, & tlm) != PQWS_SUCCESS)
+      break;
   }
-  #ifdef DEBUG_LOGGING
-  //	printf("\nValue of ctr after looping: %d Buffer Len: %d\n", ctr, buffSize);
-  //	printf("\ctr/samples = %d ctr/(samples*10) = %d\n\n", ctr/samples, ctr/(samples*10));
-  #endif
+  fifo_close( & tlm_queue);
+  return NULL;
+}
 
-  int error = 0;
-  // int count;
-  //  for (count = 0; count < dataLen; count++) {
-  //      printf("%02X", b[count]);
-  //  }
-  //  printf("\n");
+// Encode stage of the pipeline: frames stay in order, so the 8b10b running
+// disparity chains exactly as in the sequential loop
+void * fox_encode_stage(void * arg) {
+  foxtlm_tlm_t tlm;
+  fox_frame_t frame;
+  (void) arg;
+
+  while (fifo_pop( & tlm_queue, & tlm)) {
+    frame.n = foxtlm_encode_bits( & fox, & tlm, frame.bits);
+    if (fifo_push( & frame_queue, & frame) != PQWS_SUCCESS)
+      break;
+  }
+  fifo_close( & frame_queue);
+  return NULL;
+}
 
-  // socket write
+// Runs the sensor, encode and transmit stages of frameCnt frames on their
+// own threads, joined by bounded queues; transmit runs on this thread
+void run_fox_pipeline(void) {
+  pthread_t sensor_thread, encode_thread;
+  int sensor_started, encode_started;
+  fox_frame_t frame;
 
-  if (!socket_open && transmit) {
-    printf("Opening socket!\n");
- //   struct sockaddr_in address;
- //   int valread;
-    struct sockaddr_in serv_addr;
-    //    char *hello = "Hello from client"; 
-    //    char buffer[1024] = {0}; 
-    if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-      printf("\n Socket creation error \n");
-      error = 1;
-    }
+  if (fifo_init( & tlm_queue, PIPELINE_DEPTH, sizeof(foxtlm_tlm_t)) != PQWS_SUCCESS) {
+    fprintf(stderr, "ERROR: Failed to set up the frame pipeline\n");
+    return;
+  }
+  if (fifo_init( & frame_queue, PIPELINE_DEPTH, sizeof(fox_frame_t)) != PQWS_SUCCESS) {
+    fprintf(stderr, "ERROR: Failed to set up the frame pipeline\n");
+    fifo_free( & tlm_queue);
+    return;
+  }
 
-    memset( & serv_addr, '0', sizeof(serv_addr));
+  sensor_started = (pthread_create( & sensor_thread, NULL, fox_sensor_stage, NULL) == 0);
+  if (!sensor_started) {
+    fprintf(stderr, "ERROR: Failed to start the sensor stage\n");
+    fifo_close( & tlm_queue);
+  }
+  encode_started = (pthread_create( & encode_thread, NULL, fox_encode_stage, NULL) == 0);
+  if (!encode_started) {
+    fprintf(stderr, "ERROR: Failed to start the encode stage\n");
+    fifo_close( & tlm_queue);
+    fifo_close( & frame_queue);
+  }
 
-    serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
+  while (fifo_pop( & frame_queue, & frame))
+    send_fox_frame(frame.bits, frame.n);
 
-    // Convert IPv4 and IPv6 addresses from text to binary form 
-    if (inet_pton(AF_INET, "127.0.0.1", & serv_addr.sin_addr) <= 0) {
-      printf("\nInvalid address/ Address not supported \n");
-      error = 1;
-    }
+  if (sensor_started)
+    pthread_join(sensor_thread, NULL);
+  if (encode_started)
+    pthread_join(encode_thread, NULL);
+  fifo_free( & frame_queue);
+  fifo_free( & tlm_queue);
+}
 
-    if (connect(sock, (struct sockaddr * ) & serv_addr, sizeof(serv_addr)) < 0) {
-      printf("\nConnection Failed \n");
-      printf("Error: %s \n", strerror(errno));
-      error = 1;
-    }
-    if (error == 1)
-    ; //rpitxStatus = -1;
-    else
-      socket_open = 1;
+// Packs the payload with the layout of a FoxTelem CSV file, by default the
+// one for the mode, instead of the built-in copy.  The compiled plan is kept
+// in a .plan file next to sim.cfg so later starts skip the CSV.
+void load_layout(const char * csv) {
+  const char * cache = (fox.desc -> mode == FOXTLM_BPSK) ? "/home/pi/CubeSatSim/bpsk_layout.plan" : "/home/pi/CubeSatSim/fsk_layout.plan";
+
+  if (csv == NULL)
+    csv = (fox.desc -> mode == FOXTLM_BPSK) ? LAYOUT_DIR "CubeSatSim_PSK_rttelemetry.csv" : LAYOUT_DIR "CubeSatSim_rttelemetry.csv";
+  else
+    cache = NULL;
+  if (plan_load( & layout, csv, cache) == PQWS_SUCCESS) {
+    fox.plan = & layout;
+    printf("Payload layout from %s, %d bits\n", csv, layout.bits);
+  } else {
+    fprintf(stderr, "INFO: Cannot read %s, using the built-in payload layout\n", csv);
   }
+}
 
-  if (!error && transmit) {
-    //	digitalWrite (0, LOW);
-    printf("Sending %d buffer bytes over socket after %d ms!\n", ctr, (long unsigned int)millis() - start);
-    start = millis();
-    int sock_ret = send(sock, buffer, (unsigned int)(ctr * 2 + 2), 0);
-    printf("Millis5: %d Result of socket send: %d \n", (unsigned int)millis() - start, sock_ret);
+// Writes the header of a WAV file of count samples in the format of the
+// templates: 16 bit mono audio, or I and Q as the left and right channels
+void write_wav_header(FILE * out, const wave_t * w, long count) {
+  unsigned int bytes = (unsigned int)(count * w -> width);
+
+  fwrite("RIFF", 1, 4, out);
+  write_little_endian(36 + bytes, 4, out);
+  fwrite("WAVEfmt ", 1, 8, out);
+  write_little_endian(16, 4, out); // format chunk size
+  write_little_endian((w -> format == WAVE_IQ_F32) ? 3 : 1, 2, out); // IEEE float or PCM
+  write_little_endian(w -> channels, 2, out);
+  write_little_endian(w -> s_rate, 4, out);
+  write_little_endian(w -> s_rate * w -> width, 4, out);
+  write_little_endian(w -> width, 2, out);
+  write_little_endian(8 * w -> width / w -> channels, 2, out);
+  fwrite("data", 1, 4, out);
+  write_little_endian(bytes, 4, out);
+}
 
-    if (sock_ret < (ctr * 2 + 2)) {
-      printf("Not resending\n");
-      //	 	sock_ret = send(sock, buffer[sock_ret], ctr * 2 + 2 - sock_ret, 0);
-      //       		printf("Millis10: %d Result of socket send: %d \n", millis() - start, sock_ret);
-    }
+// Writes rendered samples to the output file
+int render_chunk(void * arg, const void * samples, int count) {
+  FILE * out = arg;
 
-    if (sock_ret == -1) {
-      printf("Error: %s \n", strerror(errno));
-      socket_open = 0;
-      //rpitxStatus = -1;
+  if (fwrite(samples, (size_t) wave.width, (size_t) count, out) != (size_t) count)
+    return -1;
+  return count * wave.width;
+}
+
+// Simulated telemetry of a rendered frame, read on the virtual clock at the
+// moment the frame goes on the air
+int render_tlm(void * arg, long frame, foxtlm_tlm_t * tlm) {
+  double frame_secs = * (double * ) arg;
+  float voltage[9], current[9], sensor[17], other[3];
+
+  memset(voltage, 0, sizeof(voltage));
+  memset(current, 0, sizeof(current));
+  memset(sensor, 0, sizeof(sensor));
+  memset(other, 0, sizeof(other));
+
+  // one pass of the main loop per telemetry cycle
+  if (frame % frameCnt == 0)
+    loop--;
+  virtual_ms = (long)(frame * frame_secs * 1000);
+  uptime = virtual_ms / 1000;
+
+  int failure = sim_tlm_fox(voltage, current, other);
+  build_tlm_fox(tlm, voltage, current, sensor, other, NULL, FALSE, 1, failure);
+  return 0;
+}
+
+// Parses a duration such as 90, 45s, 30m, 6h or 2d into seconds
+double parse_duration(const char * str) {
+  char * end;
+  double secs = strtod(str, & end);
+
+  if (( * end == 'm') || ( * end == 'M'))
+    secs *= 60;
+  else if (( * end == 'h') || ( * end == 'H'))
+    secs *= 3600;
+  else if (( * end == 'd') || ( * end == 'D'))
+    secs *= 86400;
+  else if (( * end != 's') && ( * end != 'S') && ( * end != '\0'))
+    return -1;
+  return secs;
+}
+
+// Renders hours of simulated FSK or BPSK telemetry to a WAV or raw file as
+// fast as the CPUs allow.  Frames are encoded and synthesized on every core
+// but come out in the order, and with the 8b10b running disparity chain, of
+// a real time run with the same telemetry.
+//
+//   radioafsk --render out.wav --duration 6h [--mode fsk|bpsk]
+//             [--frames n] [--threads n] [--rolloff 0.5]
+//             [--iq s16|f32] [--rate 96000] [--layout file.csv] [--raw]
+//
+// --iq writes BPSK as complex baseband, I and Q as a stereo WAV file or
+// interleaved raw samples, instead of audio on the subcarrier.
+int render_fox(int argc, char * argv[]) {
+  static const struct option options[] = {
+    { "render", required_argument, NULL, 'o' },
+    { "duration", required_argument, NULL, 'd' },
+    { "mode", required_argument, NULL, 'm' },
+    { "frames", required_argument, NULL, 'f' },
+    { "threads", required_argument, NULL, 'j' },
+    { "raw", no_argument, NULL, 'r' },
+    { "rolloff", required_argument, NULL, 'b' },
+    { "iq", required_argument, NULL, 'q' },
+    { "rate", required_argument, NULL, 's' },
+    { "layout", required_argument, NULL, 'l' },
+    { NULL, 0, NULL, 0 }
+  };
+  const char * file_name = NULL, * layout_csv = NULL;
+  double duration = 0, frame_secs, secs;
+  float rolloff = WAVE_ROLLOFF;
+  int format = WAVE_REAL, rate = 0;
+  int threads = (int) sysconf(_SC_NPROCESSORS_ONLN), raw = FALSE, c;
+  struct timespec t0, t1;
+
+  while ((c = getopt_long(argc, argv, "", options, NULL)) != -1) {
+    switch (c) {
+    case 'o':
+      file_name = optarg;
+      break;
+    case 'd':
+      duration = parse_duration(optarg);
+      break;
+    case 'm':
+      mode = ( * optarg == 'b') ? BPSK : FSK;
+      break;
+    case 'f':
+      frameCnt = atoi(optarg);
+      break;
+    case 'j':
+      threads = atoi(optarg);
+      break;
+    case 'r':
+      raw = TRUE;
+      break;
+    case 'b':
+      rolloff = (float) atof(optarg);
+      break;
+    case 'q':
+      format = (strcmp(optarg, "f32") == 0) ? WAVE_IQ_F32 : WAVE_IQ_S16;
+      break;
+    case 's':
+      rate = atoi(optarg);
+      break;
+    case 'l':
+      layout_csv = optarg;
+      break;
+    default:
+      file_name = NULL;
+      break;
     }
   }
-  if (!transmit) {
-    fprintf(stderr, "\nNo CubeSatSim Band Pass Filter detected.  No transmissions after the CW ID.\n");
-    fprintf(stderr, " See http://cubesatsim.org/wiki for info about building a CubeSatSim\n\n");
+  if (rate == 0)
+    rate = (format == WAVE_REAL) ? S_RATE : IQ_RATE;
+  if ((format != WAVE_REAL) && (mode != BPSK)) {
+    fprintf(stderr, "ERROR: --iq is for BPSK only\n");
+    return 1;
   }
-  //    digitalWrite (0, HIGH);
-
-  if (mode == FSK)
-    firstTime = 0;
-  else if (frames_sent > 0) //5)
-    firstTime = 0;
+  if ((file_name == NULL) || (duration <= 0) || (frameCnt < 1) || (rate < 1)) {
+    fprintf(stderr, "Usage: radioafsk --render out.wav --duration 6h [--mode fsk|bpsk] [--frames n] [--threads n]\n"
+      "                 [--rolloff 0.5] [--iq s16|f32] [--rate 96000]\n"
+      "                 [--layout file.csv] [--raw]\n");
+    return 1;
+  }
+  if ((strlen(file_name) > 4) && (strcmp(file_name + strlen(file_name) - 4, ".raw") == 0))
+    raw = TRUE;
 
-  return;
+  if (mode == BPSK) {
+    bitRate = 1200;
+    amplitude = 32767;
+    foxtlm_init( & fox, FOXTLM_BPSK);
+  } else {
+    bitRate = 200;
+    amplitude = 32767 / 3;
+    foxtlm_init( & fox, FOXTLM_FSK);
+  }
+  load_layout(layout_csv);
+  samples = rate / bitRate;
+  smaller = (int)(rate / (2 * freq_Hz));
+  frame_secs = (double) foxtlm_frame_bits( & fox) / bitRate;
+
+  long frames = (long) ceil(duration / frame_secs);
+  if (!raw && ((double) frames * foxtlm_frame_bits( & fox) * samples * ((format == WAVE_IQ_F32) ? 8 : (format == WAVE_IQ_S16) ? 4 : 2) > 0xffffffffu - 36)) {
+    fprintf(stderr, "ERROR: %.0f s does not fit in a WAV file, use --raw\n", duration);
+    return 1;
+  }
+  if (wave_init( & wave, (mode == BPSK), amplitude, freq_Hz, samples * bitRate, samples, smaller) != PQWS_SUCCESS) {
+    fprintf(stderr, "ERROR: Failed to build waveform templates\n");
+    return 1;
+  }
+  if ((mode == BPSK) && (wave_shape( & wave, rolloff, WAVE_SPAN) != PQWS_SUCCESS)) {
+    fprintf(stderr, "ERROR: BPSK rolloff must be above 0 and at most 1\n");
+    return 1;
+  }
+  if (wave_set_format( & wave, format) != PQWS_SUCCESS) {
+    fprintf(stderr, "ERROR: Failed to build the IQ carrier\n");
+    return 1;
+  }
+  FILE * out = fopen(file_name, "wb");
+  if (out == NULL) {
+    fprintf(stderr, "ERROR: cannot open %s: %s\n", file_name, strerror(errno));
+    return 1;
+  }
+  if (!raw)
+    write_wav_header(out, & wave, 0);
+
+  // Simulated telemetry on a virtual clock that starts with the first frame
+  sim_mode = TRUE;
+  virtual_ms = 0;
+  srand((unsigned int) time(0));
+  sim_tlm_init();
+  init_min_max(NULL);
+
+  printf("Rendering %ld %s frames, %.1f hours, on %d threads to %s\n", frames, (mode == BPSK) ? "BPSK" : "FSK",
+    frames * frame_secs / 3600, threads, file_name);
+  clock_gettime(CLOCK_MONOTONIC, & t0);
+  wave_stream_init( & stream, & wave, render_chunk, out);
+  long done = render_frames( & fox, & stream, frames, frameCnt, threads, render_tlm, & frame_secs);
+  wave_stream_drain( & stream);
+  wave_stream_flush( & stream);
+  clock_gettime(CLOCK_MONOTONIC, & t1);
+  secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+
+  if (!raw && (fseek(out, 0, SEEK_SET) == 0))
+    write_wav_header(out, & wave, stream.sent);
+  if ((fclose(out) != 0) || (done != frames)) {
+    fprintf(stderr, "ERROR: only %ld of %ld frames written to %s\n", (done > 0) ? done : 0, frames, file_name);
+    wave_free( & wave);
+    return 1;
+  }
+  printf("Rendered %ld samples, %.1f s of audio in %.1f s, %.0f times real time\n", stream.sent,
+    (double) stream.sent / wave.s_rate, secs, (double) stream.sent / wave.s_rate / secs);
+  wave_free( & wave);
+  return 0;
 }
 
 
@@ -1821,100 +2105,6 @@ void get_tlm_fox() {
 //#include "Fox.h"
 //#include "TelemEncoding.h"
 
-#ifndef NULL
-#define NULL ((void *)0)
-#endif
-
-#define NN (0xff) // Frame size in symbols
-#define A0 (NN)   // special value for log(0)
-
-
-// GF Antilog lookup table table
-static unsigned char CCSDS_alpha_to[NN+1] = {
-0x01,0x02,0x04,0x08,0x10,0x20,0x40,0x80,0x87,0x89,0x95,0xad,0xdd,0x3d,0x7a,0xf4,
-0x6f,0xde,0x3b,0x76,0xec,0x5f,0xbe,0xfb,0x71,0xe2,0x43,0x86,0x8b,0x91,0xa5,0xcd,
-0x1d,0x3a,0x74,0xe8,0x57,0xae,0xdb,0x31,0x62,0xc4,0x0f,0x1e,0x3c,0x78,0xf0,0x67,
-0xce,0x1b,0x36,0x6c,0xd8,0x37,0x6e,0xdc,0x3f,0x7e,0xfc,0x7f,0xfe,0x7b,0xf6,0x6b,
-0xd6,0x2b,0x56,0xac,0xdf,0x39,0x72,0xe4,0x4f,0x9e,0xbb,0xf1,0x65,0xca,0x13,0x26,
-0x4c,0x98,0xb7,0xe9,0x55,0xaa,0xd3,0x21,0x42,0x84,0x8f,0x99,0xb5,0xed,0x5d,0xba,
-0xf3,0x61,0xc2,0x03,0x06,0x0c,0x18,0x30,0x60,0xc0,0x07,0x0e,0x1c,0x38,0x70,0xe0,
-0x47,0x8e,0x9b,0xb1,0xe5,0x4d,0x9a,0xb3,0xe1,0x45,0x8a,0x93,0xa1,0xc5,0x0d,0x1a,
-0x34,0x68,0xd0,0x27,0x4e,0x9c,0xbf,0xf9,0x75,0xea,0x53,0xa6,0xcb,0x11,0x22,0x44,
-0x88,0x97,0xa9,0xd5,0x2d,0x5a,0xb4,0xef,0x59,0xb2,0xe3,0x41,0x82,0x83,0x81,0x85,
-0x8d,0x9d,0xbd,0xfd,0x7d,0xfa,0x73,0xe6,0x4b,0x96,0xab,0xd1,0x25,0x4a,0x94,0xaf,
-0xd9,0x35,0x6a,0xd4,0x2f,0x5e,0xbc,0xff,0x79,0xf2,0x63,0xc6,0x0b,0x16,0x2c,0x58,
-0xb0,0xe7,0x49,0x92,0xa3,0xc1,0x05,0x0a,0x14,0x28,0x50,0xa0,0xc7,0x09,0x12,0x24,
-0x48,0x90,0xa7,0xc9,0x15,0x2a,0x54,0xa8,0xd7,0x29,0x52,0xa4,0xcf,0x19,0x32,0x64,
-0xc8,0x17,0x2e,0x5c,0xb8,0xf7,0x69,0xd2,0x23,0x46,0x8c,0x9f,0xb9,0xf5,0x6d,0xda,
-0x33,0x66,0xcc,0x1f,0x3e,0x7c,0xf8,0x77,0xee,0x5b,0xb6,0xeb,0x51,0xa2,0xc3,0x00,
-};
-
-// GF log lookup table. Special value represents log(0)
-static unsigned char CCSDS_index_of[NN+1] = {
- A0,  0,  1, 99,  2,198,100,106,  3,205,199,188,101,126,107, 42,
-  4,141,206, 78,200,212,189,225,102,221,127, 49,108, 32, 43,243,
-  5, 87,142,232,207,172, 79,131,201,217,213, 65,190,148,226,180,
-103, 39,222,240,128,177, 50, 53,109, 69, 33, 18, 44, 13,244, 56,
-  6,155, 88, 26,143,121,233,112,208,194,173,168, 80,117,132, 72,
-202,252,218,138,214, 84, 66, 36,191,152,149,249,227, 94,181, 21,
-104, 97, 40,186,223, 76,241, 47,129,230,178, 63, 51,238, 54, 16,
-110, 24, 70,166, 34,136, 19,247, 45,184, 14, 61,245,164, 57, 59,
-  7,158,156,157, 89,159, 27,  8,144,  9,122, 28,234,160,113, 90,
-209, 29,195,123,174, 10,169,145, 81, 91,118,114,133,161, 73,235,
-203,124,253,196,219, 30,139,210,215,146, 85,170, 67, 11, 37,175,
-192,115,153,119,150, 92,250, 82,228,236, 95, 74,182,162, 22,134,
-105,197, 98,254, 41,125,187,204,224,211, 77,140,242, 31, 48,220,
-130,171,231, 86,179,147, 64,216, 52,176,239, 38, 55, 12, 17, 68,
-111,120, 25,154, 71,116,167,193, 35, 83,137,251, 20, 93,248,151,
- 46, 75,185, 96, 15,237, 62,229,246,135,165, 23, 58,163, 60,183,
-};
-
-// Only half the coefficients are given here because the
-// generator polynomial is palindromic; G0 = G32, G1 = G31, etc.
-// Only G16 is unique
-static unsigned char CCSDS_poly[] = {
-  0,249,  59, 66,  4,  43,126,251, 97,  30,   3,213, 50, 66,170,   5,
-  24,
-};
-
-static inline int modnn(int x){
-  while (x >= NN) {
-    x -= NN;
-    x = (x >> 8) + (x & NN);
-  }
-  return x;
-}
-
-// Update Reed-Solomon encoder
-// parity -> 32-byte reed-solomon encoder state; clear this to zero before each frame
-void update_rs(
-   unsigned char parity[32], // 32-byte encoder state; zero before each frame
-   unsigned char c)          // Current data byte to update
-{
-  unsigned char feedback;
-  int j,t;
-
-  assert(parity != NULL);
-  feedback = CCSDS_index_of[c ^ parity[0]];
-  if(feedback != A0){ // only if feedback is non-zero
-    // Take advantage of palindromic polynomial to halve the multiplies
-    // Do G1...G15, which is the same as G17...G31
-    for(j=1;j<NP/2;j++){
-      t = CCSDS_alpha_to[modnn(feedback + CCSDS_poly[j])];
-      parity[j] ^= t;
-      parity[NP-j] ^= t;
-    }
-    // Do G16, which is used in only parity[16]
-    t = CCSDS_alpha_to[modnn(feedback + CCSDS_poly[j])];
-    parity[j] ^= t;
-  }
-  // shift left
-  memmove(&parity[0],&parity[1],NP-1);
-  // G0 is 1 in alpha form, 0 in index form; don't need to multiply by it
-  parity[NP-1] = CCSDS_alpha_to[feedback];
-  //taskYIELD();
-}
-
 #define SYNC  (0x0fa) // K.28.5, RD=-1 
  
 void write_little_endian(unsigned int word, int num_bytes, FILE *wav_file)
@@ -1929,38 +2119,18 @@ void write_little_endian(unsigned int word, int num_bytes, FILE *wav_file)
 }
 
 
-void write_wave(int i, short int *buffer)
+// Sends one chunk of samples to rpitx over the socket as soon as it is ready
+int send_chunk(void *arg, const void *samples, int count)
 {
-		if (mode == FSK)
-		{
-			if ((ctr - flip_ctr) < smaller)
-				buffer[ctr++] = (short int)(0.1 * phase * (ctr - flip_ctr) / smaller);
-			else
-				buffer[ctr++] = (short int)(0.25 * amplitude * phase);
-		}
-		else
-		{
-			if ((ctr - flip_ctr) < smaller)
-  		 		buffer[ctr++] = (short int)(amplitude * 0.4 * phase * sin((float)(2*M_PI*i*freq_Hz/S_RATE))); 					
- 			else
- 		 		buffer[ctr++] = (short int)(amplitude * phase * sin((float)(2*M_PI*i*freq_Hz/S_RATE)));
- 		 } 			
-//		printf("%d %d \n", i, buffer[ctr - 1]);
+	(void) arg;
+	if ((tx.fd < 0) || !transmit)
+		return 0;
 
-}
-
-int encodeA(short int  *b, int index, int val) {
-//    printf("Encoding A\n");
-    b[index] = val & 0xff;
-    b[index + 1] = (short int) ((b[index + 1] & 0xf0) | ((val >> 8) & 0x0f));
-    return 0;	
-}
+	int ret = txlink_write(&tx, samples, (size_t) count * wave.width);
 
-int encodeB(short int  *b, int index, int val) {
-//    printf("Encoding B\n");
-    b[index] =  (short int) ((b[index] & 0x0f)  |  ((val << 4) & 0xf0));
-    b[index + 1] = (val >> 4 ) & 0xff;
-    return 0;	
+	if (ret < 0)
+		printf("Lost the socket to rpitx: %s, %lld bytes dropped\n", (ret == -PQWS_TIMEOUT) ? "timed out" : strerror(errno), tx.dropped);
+	return ret;
 }
 
 int twosToInt(int val,int len) {   // Convert twos compliment to integer
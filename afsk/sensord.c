@@ -0,0 +1,211 @@
+/*
+ *  Sensor daemon of the CubeSatSim
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Owns the I2C buses, and the payload UART when asked, reads every sensor
+// at a fixed rate and publishes the readings in the SENSORS_SHM shared
+// memory object, where radioafsk and any other process read the latest of
+// them without touching the hardware.
+//
+//   sensord [-a bus] [-b bus] [-i period_ms] [-u]
+//
+// The buses default to the ones radioafsk reads on the board it finds: 1
+// and 11, or 1 and 3 where there is no bus 11, on a vB5, and 1 and 0 on
+// the others.  On a bus 0, the sensor at 0x45 is the one on the MoPower
+// board.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include "../wiringPi/wiringPi.h"
+#include "../wiringPi/wiringSerial.h"
+#include "ina219.h"
+#include "sensors.h"
+#include "status.h"
+
+#define DEFAULT_PERIOD_MS       1000
+#define PAYLOAD_UART            "/dev/ttyAMA0"
+#define PAYLOAD_WAIT_MS         500
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int sig) {
+    (void) sig;
+    running = 0;
+}
+
+// Sends query to the payload and reads its answer up to a newline, which
+// is left out.  Returns the number of characters read.
+static int query_payload(int fd, char query, char *line, int len) {
+    long long wait = sensors_now_ms() + PAYLOAD_WAIT_MS;
+    int i = 0, c;
+
+    serialFlush(fd);
+    serialPutchar(fd, (unsigned char) query);
+    while (sensors_now_ms() < wait) {
+        if (serialDataAvail(fd) <= 0) {
+            usleep(1000);
+            continue;
+        }
+        c = serialGetchar(fd);
+        if (c < 0 || c == '\n')
+            break;
+        if (i < len - 1)
+            line[i++] = (char) c;
+    }
+    line[i] = '\0';
+    return i;
+}
+
+// Resets the payload as radioafsk does, returns nonzero if it answered OK
+static int open_payload(int fd) {
+    char line[SENSORS_PAYLOAD_LEN];
+    int i;
+
+    for (i = 0; i < 2; i++) {
+        query_payload(fd, 'R', line, sizeof(line));
+        if (strstr(line, "OK"))
+            return 1;
+    }
+    return 0;
+}
+
+static void read_sample(ina219_bank_t *bank, int uart_fd, sensors_sample_t *s) {
+    FILE *f;
+    double value;
+
+    memset(s, 0, sizeof(*s));
+    ina219_bank_read(bank, s->voltage, s->current);
+    s->time_ms = sensors_now_ms();
+
+    f = fopen("/sys/class/thermal/thermal_zone0/temp", "r");
+    if (f) {
+        if (fscanf(f, "%lf", &value) == 1)
+            s->cpu_temp = (float) (value / 1000);
+        fclose(f);
+    }
+    f = fopen("/proc/uptime", "r");
+    if (f) {
+        if (fscanf(f, "%lf", &value) == 1)
+            s->uptime_sec = (float) value;
+        fclose(f);
+    }
+    if (uart_fd >= 0) {
+        s->flags |= SENSORS_PAYLOAD;
+        query_payload(uart_fd, '?', s->payload, sizeof(s->payload));
+        if ((s->payload[0] == 'O') && (s->payload[1] == 'K'))
+            s->flags |= SENSORS_PAYLOAD_OK;
+    }
+}
+
+// The second bus, told by the pins that are pulled low on each board as
+// radioafsk tells them
+static int board_bus(void) {
+    int pins[3] = { 2, 3, 26 }, low[3], i;
+
+    wiringPiSetup();
+    for (i = 0; i < 3; i++) {
+        pinMode(pins[i], INPUT);
+        pullUpDnControl(pins[i], PUD_UP);
+        low[i] = (digitalRead(pins[i]) != HIGH);
+    }
+    if (low[0] || low[1] || !low[2])
+        return 0;   // vB3 or vB4, or older
+    return (access("/dev/i2c-11", W_OK | R_OK) >= 0) ? 11 : 3;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-a bus] [-b bus] [-i period_ms] [-u]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    static ina219_bank_t bank;
+    static sensors_t shm;
+    sensors_sample_t sample;
+    struct timespec next;
+    long long next_ms;
+    int bus0 = 1, bus1 = -1;
+    int period_ms = DEFAULT_PERIOD_MS, uart = 0, uart_fd = -1, c;
+
+    while ((c = getopt(argc, argv, "a:b:i:u")) != -1) {
+        switch (c) {
+        case 'a':
+            bus0 = atoi(optarg);
+            break;
+        case 'b':
+            bus1 = atoi(optarg);
+            break;
+        case 'i':
+            period_ms = atoi(optarg);
+            break;
+        case 'u':
+            uart = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (period_ms <= 0) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (bus1 < 0)
+        bus1 = board_bus();
+
+    printf("INA219 sensors found on buses %d and %d: %d\n", bus0, bus1,
+            ina219_bank_open(&bank, bus0, bus1, 1));
+    if (uart) {
+        if ((uart_fd = serialOpen(PAYLOAD_UART, 9600)) < 0) {
+            fprintf(stderr, "Unable to open UART: %s\n", strerror(errno));
+        } else {
+            printf("Payload is %spresent\n", open_payload(uart_fd) ? "" : "not ");
+        }
+    }
+    if (sensors_create(&shm, SENSORS_SHM, period_ms) != PQWS_SUCCESS) {
+        fprintf(stderr, "Cannot create %s: %s\n", SENSORS_SHM, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    next_ms = sensors_now_ms();
+    while (running) {
+        read_sample(&bank, uart_fd, &sample);
+        sensors_publish(&shm, &sample);
+
+        // keep to the schedule, but do not catch up on readings missed
+        next_ms += period_ms;
+        if (next_ms < sensors_now_ms())
+            next_ms = sensors_now_ms();
+        next.tv_sec = (time_t) (next_ms / 1000);
+        next.tv_nsec = (long) (next_ms % 1000) * 1000000L;
+        while (running && clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+    }
+
+    sensors_close(&shm);
+    ina219_bank_close(&bank);
+    if (uart_fd >= 0)
+        serialClose(uart_fd);
+    return EXIT_SUCCESS;
+}
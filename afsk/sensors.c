@@ -0,0 +1,202 @@
+/*
+ *  Sensor readings of the CubeSatSim shared between processes
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sensors.h"
+#include "status.h"
+
+#define SENSORS_MAGIC   0x534e4553u     // "SENS"
+#define SENSORS_VERSION 1               // bump when sensors_page_t changes
+#define READ_TRIES      1000            // before a writer is taken for dead
+
+// The shared memory object
+struct sensors_page {
+    unsigned int magic;
+    unsigned int version;
+    int period_ms;                      //!< between readings
+    unsigned int seq;                   //!< odd while the reading is written
+    sensors_sample_t sample;
+};
+
+/**
+ * @return milliseconds on CLOCK_MONOTONIC
+ */
+long long sensors_now_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int map_page(sensors_t *s, const char *name, int writer) {
+    struct stat st;
+    void *map;
+
+    memset(s, 0, sizeof(*s));
+    s->fd = shm_open(name, writer ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (s->fd < 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (writer && ftruncate(s->fd, (off_t) sizeof(sensors_page_t)) != 0) {
+        sensors_close(s);
+        return -PQWS_INVALID_PARAM;
+    }
+    if (fstat(s->fd, &st) != 0 || st.st_size != (off_t) sizeof(sensors_page_t)) {
+        sensors_close(s);
+        return -PQWS_INVALID_PARAM;
+    }
+    map = mmap(NULL, sizeof(sensors_page_t), writer ? PROT_READ | PROT_WRITE : PROT_READ,
+            MAP_SHARED, s->fd, 0);
+    if (map == MAP_FAILED) {
+        sensors_close(s);
+        return -PQWS_INVALID_PARAM;
+    }
+    s->map = map;
+    s->name = name;
+    s->writer = writer;
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Creates the shared memory object, or takes over the one a writer before
+ * left, so that readers already attached keep reading it
+ * @param s the readings
+ * @param name the object, SENSORS_SHM
+ * @param period_ms milliseconds between readings
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int sensors_create(sensors_t *s, const char *name, int period_ms) {
+    sensors_page_t *m;
+
+    if (!s || !name || period_ms <= 0 || map_page(s, name, 1) != PQWS_SUCCESS) {
+        return -PQWS_INVALID_PARAM;
+    }
+    m = s->map;
+    if (m->magic != SENSORS_MAGIC || m->version != SENSORS_VERSION) {
+        __atomic_store_n(&m->magic, 0, __ATOMIC_RELAXED);
+        memset(&m->sample, 0, sizeof(m->sample));
+        m->version = SENSORS_VERSION;
+        m->seq = 0;
+    }
+    // a writer that died while writing left the sequence number odd
+    m->seq &= ~1u;
+    m->period_ms = period_ms;
+    __atomic_store_n(&m->magic, SENSORS_MAGIC, __ATOMIC_RELEASE);
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Opens the shared memory object for reading
+ * @param s the readings
+ * @param name the object, SENSORS_SHM
+ * @return PQWS_SUCCESS, or -PQWS_INVALID_PARAM if there is no writer of this
+ * version
+ */
+int sensors_attach(sensors_t *s, const char *name) {
+    if (!s || !name || map_page(s, name, 0) != PQWS_SUCCESS) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (__atomic_load_n(&s->map->magic, __ATOMIC_ACQUIRE) != SENSORS_MAGIC
+            || s->map->version != SENSORS_VERSION) {
+        sensors_close(s);
+        return -PQWS_INVALID_PARAM;
+    }
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Unmaps the object.  The writer also removes it, so that readers attaching
+ * later know there is no writer; readers still attached see the readings
+ * grow old.
+ * @param s the readings
+ */
+void sensors_close(sensors_t *s) {
+    if (s->map)
+        munmap(s->map, sizeof(sensors_page_t));
+    s->map = NULL;
+    if (s->fd >= 0)
+        close(s->fd);
+    s->fd = -1;
+    if (s->writer)
+        shm_unlink(s->name);
+    s->writer = 0;
+}
+
+/**
+ * Publishes a reading
+ * @param s the readings, created by this process
+ * @param sample the reading, whose count is set here
+ */
+void sensors_publish(sensors_t *s, sensors_sample_t *sample) {
+    sensors_page_t *m = s->map;
+    unsigned int seq = m->seq;
+
+    sample->count = m->sample.count + 1;
+    __atomic_store_n(&m->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&m->sample, sample, sizeof(*sample));
+    __atomic_store_n(&m->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/**
+ * Copies the latest reading
+ * @param s the readings
+ * @param sample where to put the reading
+ * @param max_age_ms the oldest reading to take
+ * @return PQWS_SUCCESS, -PQWS_TIMEOUT if there is no reading as recent, or
+ * -PQWS_INVALID_PARAM if not attached
+ */
+int sensors_latest(const sensors_t *s, sensors_sample_t *sample, int max_age_ms) {
+    const sensors_page_t *m;
+    unsigned int before, after;
+    int i;
+
+    if (!s || !s->map || !sample) {
+        return -PQWS_INVALID_PARAM;
+    }
+    m = s->map;
+    for (i = 0; i < READ_TRIES; i++) {
+        before = __atomic_load_n(&m->seq, __ATOMIC_ACQUIRE);
+        if (before & 1)
+            continue;
+        memcpy(sample, &m->sample, sizeof(*sample));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(&m->seq, __ATOMIC_RELAXED);
+        if (before == after)
+            break;
+    }
+    if (i == READ_TRIES || sample->count == 0
+            || sensors_now_ms() - sample->time_ms > max_age_ms) {
+        return -PQWS_TIMEOUT;
+    }
+    return PQWS_SUCCESS;
+}
+
+/**
+ * @param s the readings
+ * @return milliseconds between readings, or 0 if not attached
+ */
+int sensors_period(const sensors_t *s) {
+    return (s && s->map) ? s->map->period_ms : 0;
+}
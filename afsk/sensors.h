@@ -0,0 +1,71 @@
+/*
+ *  Sensor readings of the CubeSatSim shared between processes
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SENSORS_H_
+#define SENSORS_H_
+
+#include "ina219.h"
+
+#define SENSORS_SHM             "/cubesatsim-sensors"
+#define SENSORS_PAYLOAD_LEN     256
+#define SENSORS_STALE_PERIODS   3       // readings older than this many periods are not used
+
+// sensors_sample_t flags
+#define SENSORS_PAYLOAD         1       // the daemon owns the payload UART
+#define SENSORS_PAYLOAD_OK      2       // and the payload answered
+
+/**
+ * One reading of every sensor
+ */
+typedef struct {
+    unsigned long long count;           //!< readings published before this one
+    long long time_ms;                  //!< CLOCK_MONOTONIC, the same in every process
+    float voltage[INA219_SENSORS];      //!< in the order voltcurrent.py prints them
+    float current[INA219_SENSORS];      //!< milliamps
+    float cpu_temp;
+    float uptime_sec;
+    int flags;
+    char payload[SENSORS_PAYLOAD_LEN];  //!< the line of the payload, without the newline
+} sensors_sample_t;
+
+typedef struct sensors_page sensors_page_t;
+
+/**
+ * The latest reading, in a POSIX shared memory object written by one
+ * process and read by any number.  The reading is guarded by a sequence
+ * number that is odd while it is written: a reader copies it and tries
+ * again if the number was odd or changed meanwhile, so readers never wait
+ * on the writer or hold it up, and take no locks.
+ */
+typedef struct {
+    int fd;
+    sensors_page_t *map;
+    const char *name;
+    int writer;                         //!< created the object and may publish
+} sensors_t;
+
+int sensors_create(sensors_t *s, const char *name, int period_ms);
+int sensors_attach(sensors_t *s, const char *name);
+void sensors_close(sensors_t *s);
+void sensors_publish(sensors_t *s, sensors_sample_t *sample);
+int sensors_latest(const sensors_t *s, sensors_sample_t *sample, int max_age_ms);
+int sensors_period(const sensors_t *s);
+long long sensors_now_ms(void);
+
+#endif /* SENSORS_H_ */
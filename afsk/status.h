@@ -31,7 +31,8 @@ typedef enum {
     PQWS_MAX_SPI_TRANSFER_ERROR, //!< The requested SPI data transfer was larger than supported
     PQWS_NO_RF_FOUND,                     //!< No suitable RF chip found
     PQWS_AX5043_AUTORANGING_ERROR,        //!< Auto ranging failed on AX5043
-    PQWS_TIMEOUT                          //!< A timeout occurred
+    PQWS_TIMEOUT,                         //!< A timeout occurred
+    PQWS_UNCORRECTABLE                    //!< Too many errors to correct
 } pqws_error_t;
 
 #endif /* STATUS_H_ */
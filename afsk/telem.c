@@ -10,6 +10,8 @@
 #include <string.h>
 #include <wiringPiI2C.h>
 #include <wiringPi.h>
+#include "sensors.h"
+#include "status.h"
 
 #define PLUS_X 0
 #define PLUS_Y 1
@@ -37,6 +39,17 @@ int main(int argc, char *argv[]) {
   wiringPiSetup ();
 		
   printf("\n");
+
+  // sensord owns the I2C buses when it is running, so read its latest
+  // readings rather than probing the buses and running voltcurrent.py
+  sensors_t shm = { -1, NULL, NULL, 0 };
+  sensors_sample_t shared;
+  int from_sensord = (sensors_attach(&shm, SENSORS_SHM) == PQWS_SUCCESS) &&
+    (sensors_latest(&shm, &shared, SENSORS_STALE_PERIODS * sensors_period(&shm)) == PQWS_SUCCESS);
+  sensors_close(&shm);
+  if (from_sensord) {
+    printf("Reading sensors from sensord\n");
+  }
 	
     pinMode (2, INPUT);
     pullUpDnControl (2, PUD_UP);
@@ -49,8 +62,10 @@ int main(int argc, char *argv[]) {
   	  map[PLUS_Z] = BAT;
   	  map[MINUS_Z] = PLUS_Z;
 	    
-	  snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
-	  printf("New Bus String: %s \n", busStr);
+	  if (!from_sensord) {
+	    snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
+	    printf("New Bus String: %s \n", busStr);
+	  }
 /*	    
  	  if (access("/dev/i2c-0", W_OK | R_OK) >= 0)  {   // Test if I2C Bus 0 is present			
 	  	printf("/dev/i2c-0 is present\n\n");	    
@@ -91,9 +106,10 @@ int main(int argc, char *argv[]) {
 	  map[BAT] = BUS;
 	  map[BUS] = BAT;
 		
-	  snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
-			
-	  printf("New Bus String: %s \n", busStr);
+	  if (!from_sensord) {
+	    snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
+	    printf("New Bus String: %s \n", busStr);
+	  }
 		
  // 	  strcpy(busStr,"1 0");
   	}
@@ -108,9 +124,10 @@ int main(int argc, char *argv[]) {
 			map[MINUS_X] = MINUS_Y;
 			map[PLUS_Z] = MINUS_X;	
 			map[MINUS_Y] = PLUS_Z;			
-			snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(3));
-			
-			printf("New Bus String: %s \n", busStr);
+			if (!from_sensord) {
+			  snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(3));
+			  printf("New Bus String: %s \n", busStr);
+			}
 /*			
 			if (test_i2c_b0) != OFF)
 				strcpy(busStr,"1 ");
@@ -184,9 +201,10 @@ int main(int argc, char *argv[]) {
   			map[PLUS_Z] = BAT;
   			map[MINUS_Z] = PLUS_Z;
 			
-			snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
-			
-			printf("New Bus String: %s \n", busStr);
+			if (!from_sensord) {
+			  snprintf(busStr, 10, "%d %d", test_i2c_bus(1), test_i2c_bus(0));
+			  printf("New Bus String: %s \n", busStr);
+			}
 /*			
  	  if (access("/dev/i2c-0", W_OK | R_OK) >= 0)  {   // Test if I2C Bus 0 is present			
 	  	printf("/dev/i2c-0 is present\n\n");	    
@@ -222,53 +240,64 @@ int main(int argc, char *argv[]) {
 //  Reading I2C voltage and current sensors
 //   printf("Starting\n");
 
-   strcpy(pythonStr, pythonCmd);
-   strcat(pythonStr, busStr);
-   strcat(pythonConfigStr, pythonStr);
-   strcat(pythonConfigStr, " c");
+    float voltage[9], current[9];	
+    memset(voltage, 0, sizeof(voltage));
+    memset(current, 0, sizeof(current));	 
+
+  if (from_sensord) {
+    int count1;
+
+    memcpy(voltage, shared.voltage, sizeof(shared.voltage));
+    memcpy(current, shared.current, sizeof(shared.current));
+    for (count1 = 0; count1 < 8; count1++) {
+      if ((current[count1] < 0) && (current[count1] > -1))
+        current[count1] *= (-1.0);
+    }
+  } else {
+     strcpy(pythonStr, pythonCmd);
+     strcat(pythonStr, busStr);
+     strcat(pythonConfigStr, pythonStr);
+     strcat(pythonConfigStr, " c");
 	
-   FILE* file1 = popen(pythonConfigStr, "r");
-   char cmdbuffer[1000];
-   fgets(cmdbuffer, 1000, file1);
-//   printf("pythonStr result: %s\n", cmdbuffer);
-   pclose(file1);	
+     FILE* file1 = popen(pythonConfigStr, "r");
+     char cmdbuffer[1000];
+     fgets(cmdbuffer, 1000, file1);
+  //   printf("pythonStr result: %s\n", cmdbuffer);
+     pclose(file1);	
 	
-   int count1;
-   char *token;
+     int count1;
+     char *token;
 	
-   FILE* file = popen(pythonStr, "r");
-   fgets(cmdbuffer, 1000, file);
-//  printf("result: %s\n", cmdbuffer);
-    pclose(file);
+     FILE* file = popen(pythonStr, "r");
+     fgets(cmdbuffer, 1000, file);
+  //  printf("result: %s\n", cmdbuffer);
+      pclose(file);
 	
-    const char space[2] = " ";
-    token = strtok(cmdbuffer, space);
+      const char space[2] = " ";
+      token = strtok(cmdbuffer, space);
 
-    float voltage[9], current[9];	
-    memset(voltage, 0, sizeof(voltage));
-    memset(current, 0, sizeof(current));	 
-	  
-    for (count1 = 0; count1 < 8; count1++)
-    {
-	    if (token != NULL)
-	    {
-	        voltage[count1] = atof(token);				      
-//    #ifdef DEBUG_LOGGING
-//		 printf("voltage: %f ", voltage[count1]);
-//    #endif
-		token = strtok(NULL, space);	
-	    	if (token != NULL)
-	    	{
-	            current[count1] = atof(token);
-		    if ((current[count1] < 0) && (current[count1] > -1))
-			 current[count1] *= (-1.0);
-//    #ifdef DEBUG_LOGGING
-//		    printf("current: %f\n", current[count1]);
-//    #endif
-		    token = strtok(NULL, space);	
-		}
-	  }
-    }	
+      for (count1 = 0; count1 < 8; count1++)
+      {
+  	    if (token != NULL)
+  	    {
+  	        voltage[count1] = atof(token);				      
+  //    #ifdef DEBUG_LOGGING
+  //		 printf("voltage: %f ", voltage[count1]);
+  //    #endif
+  		token = strtok(NULL, space);	
+  	    	if (token != NULL)
+  	    	{
+  	            current[count1] = atof(token);
+  		    if ((current[count1] < 0) && (current[count1] > -1))
+  			 current[count1] *= (-1.0);
+  //    #ifdef DEBUG_LOGGING
+  //		    printf("current: %f\n", current[count1]);
+  //    #endif
+  		    token = strtok(NULL, space);	
+  		}
+  	  }
+      }	
+  }
   printf("\n");
 	
   printf("+X  | % 4.2f V % 5.0f mA \n", voltage[map[PLUS_X]], current[map[PLUS_X]]);
@@ -0,0 +1,269 @@
+/*
+ *  Benchmark for the CubeSatSim ground demodulators
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Synthesizes FSK and BPSK telemetry in memory with libfoxtlm, as radioafsk
+// sends it, and times the demodulators and frame decoder on it: the BPSK
+// demodulator with and without the vector mixer, then every mode on 1 to N
+// channels decoded in parallel.  The frame decoder is also timed on its
+// own, fed the encoder's bitstream directly with some bits flipped.  Fails
+// if any frame is lost.
+//
+//   bench_rx [frames] [max threads]
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "fskdemod.h"
+#include "bpskdemod.h"
+#include "foxdec.h"
+#include "../foxtlm/foxtlm.h"
+#include "../foxtlm/wave.h"
+
+#define S_RATE          48000
+#define FREQ_HZ         3000
+#define BLOCK_SAMPLES   4096
+#define MAX_THREADS     16
+#define LOOPBACK_FRAMES 2000
+#define FLIP_EVERY      397     // bit errors in the loopback bitstream
+
+typedef struct {
+    short int *samples;
+    long count, size;
+} audio_t;
+
+// One channel being decoded
+typedef struct {
+    const audio_t *audio;
+    foxtlm_mode_t mode;
+    int simd;
+    long frames;
+} channel_t;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int append(void *arg, const void *samples, int count) {
+    audio_t *a = arg;
+
+    if (a->count + count > a->size) {
+        long size = 2 * (a->count + count);
+        short int *p = realloc(a->samples, size * sizeof(short int));
+
+        if (!p)
+            return -1;
+        a->samples = p;
+        a->size = size;
+    }
+    memcpy(&a->samples[a->count], samples, count * sizeof(short int));
+    a->count += count;
+    return count * (int) sizeof(short int);
+}
+
+// Frames back to back, each one with its own reset count
+static int synthesize(foxtlm_mode_t mode, int frames, audio_t *a) {
+    int bpsk = (mode == FOXTLM_BPSK), bit_rate = bpsk ? 1200 : 200;
+    unsigned char bits[(FOXTLM_MAX_BITS + 7) / 8];
+    short int silence[S_RATE / 10] = { 0 };
+    foxtlm_tlm_t tlm;
+    foxtlm_t fox;
+    wave_t wave;
+    wave_stream_t stream;
+    int f, i, n;
+
+    memset(a, 0, sizeof(*a));
+    if (foxtlm_init(&fox, mode) != 0 || wave_init(&wave, bpsk, bpsk ? 32767 : 32767 / 3, FREQ_HZ,
+            S_RATE, S_RATE / bit_rate, S_RATE / (2 * FREQ_HZ)) != 0)
+        return -1;
+    wave_stream_init(&stream, &wave, append, a);
+    for (f = 0; f < frames; f++) {
+        memset(&tlm, 0, sizeof(tlm));
+        tlm.frame_type = 1;
+        tlm.reset_count = f;
+        tlm.uptime = 3600 + 4 * f;
+        n = foxtlm_encode_bits(&fox, &tlm, bits);
+        stream.ctr = 0;
+        for (i = 0; i < n; i++)
+            wave_stream_bit(&stream, foxtlm_bit(bits, i));
+        wave_stream_flush(&stream);
+    }
+    wave_stream_drain(&stream);
+    wave_stream_flush(&stream);
+    append(a, silence, S_RATE / 10);
+    wave_free(&wave);
+    return 0;
+}
+
+// The encoder's bitstream fed straight to the frame decoder, packed and one
+// bit per byte
+static int loopback(foxtlm_mode_t mode, const char *name) {
+    unsigned char frame[(FOXTLM_MAX_BITS + 7) / 8];
+    foxtlm_tlm_t tlm;
+    foxtlm_t fox;
+    foxdec_t dec;
+    long bits, i;
+    int f, n, lost = 0;
+
+    if (foxtlm_init(&fox, mode) != 0)
+        return 1;
+    n = foxtlm_frame_bits(&fox);
+    bits = (long) n * LOOPBACK_FRAMES;
+    unsigned char *packed = calloc((bits + 7) / 8 + 1, 1);
+    unsigned char *unpacked = malloc(bits);
+    if (!packed || !unpacked) {
+        free(packed);
+        free(unpacked);
+        return 1;
+    }
+    for (f = 0; f < LOOPBACK_FRAMES; f++) {
+        memset(&tlm, 0, sizeof(tlm));
+        tlm.reset_count = f;
+        foxtlm_encode_bits(&fox, &tlm, frame);
+        for (i = 0; i < n; i++)
+            unpacked[(long) f * n + i] = (unsigned char) foxtlm_bit(frame, (int) i);
+    }
+    // errors everywhere but in the sync words
+    for (i = FLIP_EVERY; i < bits; i += FLIP_EVERY)
+        if (i % n >= fox.desc->sync_bits)
+            unpacked[i] ^= 1;
+    for (i = 0; i < bits; i++)
+        packed[i >> 3] |= (unsigned char) (unpacked[i] << (7 - (i & 7)));
+
+    foxdec_init(&dec, mode, NULL, NULL);
+    double start = now();
+    foxdec_packed(&dec, packed, bits);
+    double packed_secs = now() - start;
+    lost |= (dec.frames != LOOPBACK_FRAMES);
+
+    foxdec_init(&dec, mode, NULL, NULL);
+    start = now();
+    for (i = 0; i < bits; i += BLOCK_SAMPLES)
+        foxdec_bits(&dec, &unpacked[i], (bits - i < BLOCK_SAMPLES) ? (int) (bits - i) : BLOCK_SAMPLES);
+    double bit_secs = now() - start;
+    lost |= (dec.frames != LOOPBACK_FRAMES);
+
+    printf("%s frame decoder: %ld frames of %ld, %.0f frames/s packed, %.0f frames/s one bit per byte\n",
+            name, dec.frames, (long) LOOPBACK_FRAMES, LOOPBACK_FRAMES / packed_secs, LOOPBACK_FRAMES / bit_secs);
+    free(packed);
+    free(unpacked);
+    return lost;
+}
+
+static void *decode(void *arg) {
+    channel_t *c = arg;
+    static __thread unsigned char bits[BLOCK_SAMPLES];
+    fskdemod_t fsk;
+    bpskdemod_t *bpsk = malloc(sizeof(bpskdemod_t));
+    foxdec_t dec;
+    long i;
+
+    if (!bpsk)
+        return NULL;
+    foxdec_init(&dec, c->mode, NULL, NULL);
+    if (c->mode == FOXTLM_BPSK) {
+        bpskdemod_init(bpsk, S_RATE, 1200, FREQ_HZ);
+        bpsk->simd = c->simd;
+    } else {
+        fskdemod_init(&fsk, S_RATE, 200);
+    }
+    for (i = 0; i < c->audio->count; i += BLOCK_SAMPLES) {
+        int n = (c->audio->count - i < BLOCK_SAMPLES) ? (int) (c->audio->count - i) : BLOCK_SAMPLES;
+
+        if (c->mode == FOXTLM_BPSK)
+            n = bpskdemod_process(bpsk, &c->audio->samples[i], n, bits);
+        else
+            n = fskdemod_process(&fsk, &c->audio->samples[i], n, bits);
+        foxdec_bits(&dec, bits, n);
+    }
+    if (c->mode == FOXTLM_BPSK)
+        bpskdemod_free(bpsk);
+    free(bpsk);
+    c->frames = dec.frames;
+    return NULL;
+}
+
+// Decodes the audio on several channels at once
+static double run(const audio_t *a, foxtlm_mode_t mode, int simd, int threads, int frames, int *lost) {
+    pthread_t tid[MAX_THREADS];
+    channel_t ch[MAX_THREADS];
+    int i;
+
+    double start = now();
+    for (i = 0; i < threads; i++) {
+        ch[i].audio = a;
+        ch[i].mode = mode;
+        ch[i].simd = simd;
+        ch[i].frames = 0;
+        pthread_create(&tid[i], NULL, decode, &ch[i]);
+    }
+    for (i = 0; i < threads; i++) {
+        pthread_join(tid[i], NULL);
+        if (ch[i].frames != frames) {
+            printf("ERROR: %ld of %d frames decoded\n", ch[i].frames, frames);
+            *lost = 1;
+        }
+    }
+    return now() - start;
+}
+
+int main(int argc, char *argv[]) {
+    int frames = (argc > 1) ? atoi(argv[1]) : 20;
+    int max_threads = (argc > 2) ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    audio_t fsk, bpsk;
+    int lost = 0, t;
+    double secs;
+
+    if (max_threads < 1)
+        max_threads = 1;
+    if (max_threads > MAX_THREADS)
+        max_threads = MAX_THREADS;
+    if (frames < 1 || synthesize(FOXTLM_FSK, frames, &fsk) != 0 || synthesize(FOXTLM_BPSK, frames, &bpsk) != 0) {
+        fprintf(stderr, "ERROR: cannot synthesize the test audio\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("bpsk: %d frames, %.1f s of audio\n", frames, (double) bpsk.count / S_RATE);
+    secs = run(&bpsk, FOXTLM_BPSK, 0, 1, frames, &lost);
+    printf("  scalar mixer %12.0f samples/s\n", bpsk.count / secs);
+    if (bpskdemod_simd_supported()) {
+        secs = run(&bpsk, FOXTLM_BPSK, 1, 1, frames, &lost);
+        printf("  vector mixer %12.0f samples/s\n", bpsk.count / secs);
+    }
+    for (t = 1; t <= max_threads; t++) {
+        secs = run(&bpsk, FOXTLM_BPSK, 1, t, frames, &lost);
+        printf("  %2d channels  %12.0f samples/s\n", t, t * bpsk.count / secs);
+    }
+
+    printf("fsk: %d frames, %.1f s of audio\n", frames, (double) fsk.count / S_RATE);
+    for (t = 1; t <= max_threads; t++) {
+        secs = run(&fsk, FOXTLM_FSK, 0, t, frames, &lost);
+        printf("  %2d channels  %12.0f samples/s\n", t, t * fsk.count / secs);
+    }
+    free(fsk.samples);
+    free(bpsk.samples);
+
+    lost |= loopback(FOXTLM_FSK, "fsk");
+    lost |= loopback(FOXTLM_BPSK, "bpsk");
+    return lost ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,325 @@
+/*
+ *  Demodulator for the CubeSatSim 1200 bps BPSK telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "bpskdemod.h"
+#include "../afsk/status.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define BPSKDEMOD_HAVE_SSE2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BPSKDEMOD_HAVE_NEON 1
+#endif
+
+#define GARDNER_GAIN    0.05f   // timing correction, symbols per unit error
+#define COSTAS_ALPHA    0.1f    // carrier phase gain
+#define COSTAS_BETA     0.0025f // carrier frequency gain
+#define POWER_SHIFT     16.0f   // symbol power time constant, symbols
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * Sets up a demodulator
+ * @param d the demodulator
+ * @param s_rate the sample rate of the audio
+ * @param bit_rate the bit rate, 1200 for BPSK
+ * @param freq_Hz the subcarrier frequency
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int bpskdemod_init(bpskdemod_t *d, int s_rate, int bit_rate, float freq_Hz) {
+    int f = (int) (freq_Hz + 0.5f);
+    int i;
+
+    if (!d || bit_rate <= 0 || f <= 0 || 2 * f >= s_rate) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(d, 0, sizeof(*d));
+    d->s_rate = s_rate;
+    d->bit_rate = bit_rate;
+    d->freq_Hz = freq_Hz;
+    d->simd = bpskdemod_simd_supported();
+    d->sps = (double) s_rate / bit_rate / BPSKDEMOD_DECIM;
+    d->taps = (int) (d->sps + 0.5);
+    d->lo_len = s_rate / gcd(s_rate, f);
+    if (d->taps < 2 || d->taps > BPSKDEMOD_MAX_TAPS || d->lo_len > BPSKDEMOD_MAX_LO) {
+        return -PQWS_INVALID_PARAM;
+    }
+
+    // one subcarrier period, then enough of the next ones that a whole
+    // chunk can be mixed from any starting index
+    d->lo_cos = malloc((d->lo_len + BPSKDEMOD_CHUNK) * sizeof(float));
+    d->lo_sin = malloc((d->lo_len + BPSKDEMOD_CHUNK) * sizeof(float));
+    if (!d->lo_cos || !d->lo_sin) {
+        bpskdemod_free(d);
+        return -PQWS_INVALID_PARAM;
+    }
+    for (i = 0; i < d->lo_len + BPSKDEMOD_CHUNK; i++) {
+        double a = 2 * M_PI * (double) f * (i % d->lo_len) / s_rate;
+
+        d->lo_cos[i] = (float) cos(a);
+        d->lo_sin[i] = (float) -sin(a);
+    }
+    d->next = d->sps;
+    return PQWS_SUCCESS;
+}
+
+void bpskdemod_free(bpskdemod_t *d) {
+    free(d->lo_cos);
+    free(d->lo_sin);
+    d->lo_cos = d->lo_sin = NULL;
+}
+
+/**
+ * @return 1 if the vector mixer is compiled in for this CPU, otherwise 0
+ */
+int bpskdemod_simd_supported(void) {
+#if defined(BPSKDEMOD_HAVE_SSE2) || defined(BPSKDEMOD_HAVE_NEON)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @param d the demodulator
+ * @param n a number of samples
+ * @return the most bits bpskdemod_process() can return for n samples
+ */
+int bpskdemod_max_bits(const bpskdemod_t *d, int n) {
+    return (int) ((double) (n + d->pending) / BPSKDEMOD_DECIM / d->sps) + 2;
+}
+
+// Mixes blocks of samples down to baseband and sums each block
+static void mix_scalar(const short int *x, const float *c, const float *s,
+        int blocks, float *bi, float *bq) {
+    int b, j;
+
+    for (b = 0; b < blocks; b++) {
+        float si = 0, sq = 0;
+
+        for (j = 0; j < BPSKDEMOD_DECIM; j++) {
+            si += x[j] * c[j];
+            sq += x[j] * s[j];
+        }
+        bi[b] = si;
+        bq[b] = sq;
+        x += BPSKDEMOD_DECIM;
+        c += BPSKDEMOD_DECIM;
+        s += BPSKDEMOD_DECIM;
+    }
+}
+
+#ifdef BPSKDEMOD_HAVE_SSE2
+// The eight products of a block reduced to four lanes
+static inline __m128 mix_block_sse2(const short int *x, const float *lo) {
+    __m128i v = _mm_loadu_si128((const __m128i *) x);
+    __m128 lo4 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+    __m128 hi4 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+
+    return _mm_add_ps(_mm_mul_ps(lo4, _mm_loadu_ps(lo)),
+            _mm_mul_ps(hi4, _mm_loadu_ps(lo + 4)));
+}
+
+// Sums the four lanes of each of four vectors
+static inline __m128 hsum4_sse2(__m128 a, __m128 b, __m128 c, __m128 d) {
+    _MM_TRANSPOSE4_PS(a, b, c, d);
+    return _mm_add_ps(_mm_add_ps(a, b), _mm_add_ps(c, d));
+}
+
+static void mix_sse2(const short int *x, const float *c, const float *s,
+        int blocks, float *bi, float *bq) {
+    int b = 0;
+
+    for (; b + 4 <= blocks; b += 4) {
+        const int k = BPSKDEMOD_DECIM;
+
+        _mm_storeu_ps(&bi[b], hsum4_sse2(mix_block_sse2(x, c), mix_block_sse2(x + k, c + k),
+                mix_block_sse2(x + 2 * k, c + 2 * k), mix_block_sse2(x + 3 * k, c + 3 * k)));
+        _mm_storeu_ps(&bq[b], hsum4_sse2(mix_block_sse2(x, s), mix_block_sse2(x + k, s + k),
+                mix_block_sse2(x + 2 * k, s + 2 * k), mix_block_sse2(x + 3 * k, s + 3 * k)));
+        x += 4 * k;
+        c += 4 * k;
+        s += 4 * k;
+    }
+    mix_scalar(x, c, s, blocks - b, &bi[b], &bq[b]);
+}
+#endif
+
+#ifdef BPSKDEMOD_HAVE_NEON
+static void mix_neon(const short int *x, const float *c, const float *s,
+        int blocks, float *bi, float *bq) {
+    int b;
+
+    for (b = 0; b < blocks; b++) {
+        int16x8_t v = vld1q_s16(x);
+        float32x4_t lo4 = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+        float32x4_t hi4 = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+        float32x4_t ai = vmlaq_f32(vmulq_f32(lo4, vld1q_f32(c)), hi4, vld1q_f32(c + 4));
+        float32x4_t aq = vmlaq_f32(vmulq_f32(lo4, vld1q_f32(s)), hi4, vld1q_f32(s + 4));
+        float32x2_t pi = vadd_f32(vget_low_f32(ai), vget_high_f32(ai));
+        float32x2_t pq = vadd_f32(vget_low_f32(aq), vget_high_f32(aq));
+        float32x2_t sum = vpadd_f32(pi, pq);
+
+        bi[b] = vget_lane_f32(sum, 0);
+        bq[b] = vget_lane_f32(sum, 1);
+        x += BPSKDEMOD_DECIM;
+        c += BPSKDEMOD_DECIM;
+        s += BPSKDEMOD_DECIM;
+    }
+}
+#endif
+
+static void mix(const bpskdemod_t *d, const short int *x, int blocks) {
+    const float *c = &d->lo_cos[d->lo_pos];
+    const float *s = &d->lo_sin[d->lo_pos];
+    float *bi = (float *) d->blk_i, *bq = (float *) d->blk_q;
+
+#ifdef BPSKDEMOD_HAVE_SSE2
+    if (d->simd) {
+        mix_sse2(x, c, s, blocks, bi, bq);
+        return;
+    }
+#endif
+#ifdef BPSKDEMOD_HAVE_NEON
+    if (d->simd) {
+        mix_neon(x, c, s, blocks, bi, bq);
+        return;
+    }
+#endif
+    mix_scalar(x, c, s, blocks, bi, bq);
+}
+
+// The matched filter output at a fractional block time
+static void interp(const bpskdemod_t *d, double t, float *i, float *q) {
+    long k = (long) floor(t);
+    float frac = (float) (t - k);
+    int a = k & (BPSKDEMOD_HIST - 1), b = (k + 1) & (BPSKDEMOD_HIST - 1);
+
+    *i = d->hist_i[a] + frac * (d->hist_i[b] - d->hist_i[a]);
+    *q = d->hist_q[a] + frac * (d->hist_q[b] - d->hist_q[a]);
+}
+
+static float clamp1(float x) {
+    return (x > 1) ? 1 : (x < -1) ? -1 : x;
+}
+
+// Runs the symbol loops over the blocks of one mixing pass
+static int symbols(bpskdemod_t *d, int blocks, unsigned char *bits) {
+    int b, k, nbits = 0;
+
+    for (b = 0; b < blocks; b++) {
+        float mi = 0, mq = 0;
+        int t = d->n % d->taps;
+        int h = d->n & (BPSKDEMOD_HIST - 1);
+
+        d->tap_i[t] = d->blk_i[b];
+        d->tap_q[t] = d->blk_q[b];
+        for (k = 0; k < d->taps; k++) {
+            mi += d->tap_i[k];
+            mq += d->tap_q[k];
+        }
+        d->hist_i[h] = mi;
+        d->hist_q[h] = mq;
+
+        while (d->next < d->n) {
+            float yi, yq, hi, hq, si, sq, e, p;
+            int decision;
+
+            interp(d, d->next, &yi, &yq);
+            interp(d, d->next - d->sps / 2, &hi, &hq);
+            p = yi * yi + yq * yq;
+            if (d->power == 0)
+                d->power = p + 1;
+            d->power += (p - d->power) / POWER_SHIFT;
+
+            // Gardner: the midpoint between two symbols of opposite sign
+            // is zero when the clock is right, whatever the carrier phase
+            e = clamp1(((yi - d->prev_i) * hi + (yq - d->prev_q) * hq) / d->power);
+            d->next += d->sps * (1 - GARDNER_GAIN * e);
+            d->prev_i = yi;
+            d->prev_q = yq;
+
+            // Costas: rotate onto the real axis, decision directed
+            si = yi * cosf(d->theta) + yq * sinf(d->theta);
+            sq = yq * cosf(d->theta) - yi * sinf(d->theta);
+            e = clamp1(((si > 0) ? sq : -sq) / sqrtf(d->power));
+            d->freq += COSTAS_BETA * e;
+            d->theta += d->freq + COSTAS_ALPHA * e;
+            if (d->theta > (float) M_PI)
+                d->theta -= 2 * (float) M_PI;
+            else if (d->theta < (float) -M_PI)
+                d->theta += 2 * (float) M_PI;
+
+            decision = (si > 0);
+            bits[nbits++] = (unsigned char) (decision == d->last);
+            d->last = decision;
+        }
+        d->n++;
+    }
+    return nbits;
+}
+
+/**
+ * Demodulates a block of samples.  State is kept between calls, so a
+ * recording can be fed in blocks of any size.
+ * @param d the demodulator
+ * @param in the samples
+ * @param n the number of samples
+ * @param bits where to write the bits, one per byte, at least
+ * bpskdemod_max_bits() of them
+ * @return the number of bits written
+ */
+int bpskdemod_process(bpskdemod_t *d, const short int *in, int n,
+        unsigned char *bits) {
+    int nbits = 0;
+
+    while (n > 0) {
+        int take = BPSKDEMOD_CHUNK - d->pending;
+        int blocks;
+
+        if (take > n)
+            take = n;
+        memcpy(&d->buf[d->pending], in, take * sizeof(short int));
+        d->pending += take;
+        in += take;
+        n -= take;
+
+        blocks = d->pending / BPSKDEMOD_DECIM;
+        mix(d, d->buf, blocks);
+        d->lo_pos = (d->lo_pos + blocks * BPSKDEMOD_DECIM) % d->lo_len;
+        nbits += symbols(d, blocks, &bits[nbits]);
+
+        d->pending -= blocks * BPSKDEMOD_DECIM;
+        memmove(d->buf, &d->buf[blocks * BPSKDEMOD_DECIM], d->pending * sizeof(short int));
+    }
+    return nbits;
+}
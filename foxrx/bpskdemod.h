@@ -0,0 +1,74 @@
+/*
+ *  Demodulator for the CubeSatSim 1200 bps BPSK telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BPSKDEMOD_H_
+#define BPSKDEMOD_H_
+
+#define BPSKDEMOD_DECIM         8       // samples summed into each block
+#define BPSKDEMOD_CHUNK         4096    // samples mixed per pass
+#define BPSKDEMOD_MAX_LO        4096    // longest subcarrier period, samples
+#define BPSKDEMOD_MAX_TAPS      32      // matched filter length, blocks
+#define BPSKDEMOD_HIST          64      // filter outputs kept, power of two
+
+/**
+ * Demodulator state.  The audio is mixed down with a fixed subcarrier
+ * table and summed in blocks of BPSKDEMOD_DECIM samples, the only stage
+ * running at the full sample rate, which is vectorized.  The matched
+ * filter, Gardner timing recovery and the Costas loop run on the blocks.
+ *
+ * write_wave() flips the phase for a zero bit, so the bits are recovered
+ * by comparing each symbol decision with the one before, which also makes
+ * the 180 degree ambiguity of the Costas loop harmless.
+ */
+typedef struct {
+    int s_rate;
+    int bit_rate;
+    float freq_Hz;
+    int simd;                   //!< use the vector mixer if compiled in
+    int lo_len;                 //!< subcarrier period in samples
+    int lo_pos;                 //!< subcarrier index of the next sample
+    float *lo_cos;              //!< lo_len + BPSKDEMOD_CHUNK entries
+    float *lo_sin;
+    int pending;                //!< samples waiting in buf[]
+    short int buf[BPSKDEMOD_CHUNK];
+    float blk_i[BPSKDEMOD_CHUNK / BPSKDEMOD_DECIM];
+    float blk_q[BPSKDEMOD_CHUNK / BPSKDEMOD_DECIM];
+    int taps;                   //!< blocks in the matched filter
+    float tap_i[BPSKDEMOD_MAX_TAPS];
+    float tap_q[BPSKDEMOD_MAX_TAPS];
+    float hist_i[BPSKDEMOD_HIST];       //!< matched filter output
+    float hist_q[BPSKDEMOD_HIST];
+    long n;                     //!< blocks seen
+    double sps;                 //!< blocks per symbol
+    double next;                //!< block time of the next symbol
+    float prev_i, prev_q;       //!< the last symbol
+    float power;                //!< mean symbol power
+    float theta;                //!< carrier phase, radians
+    float freq;                 //!< carrier frequency offset, radians/symbol
+    int last;                   //!< the last symbol decision
+} bpskdemod_t;
+
+int bpskdemod_init(bpskdemod_t *d, int s_rate, int bit_rate, float freq_Hz);
+void bpskdemod_free(bpskdemod_t *d);
+int bpskdemod_simd_supported(void);
+int bpskdemod_max_bits(const bpskdemod_t *d, int n);
+int bpskdemod_process(bpskdemod_t *d, const short int *in, int n,
+        unsigned char *bits);
+
+#endif /* BPSKDEMOD_H_ */
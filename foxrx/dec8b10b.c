@@ -0,0 +1,91 @@
+/*
+ *  8b10b decoder for the Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <pthread.h>
+#include "dec8b10b.h"
+#include "../foxtlm/TelemEncoding.h"
+
+#define RD_SHIFT        11      // the running disparity after the word
+
+// [running disparity][10-bit word]: the data byte, the DEC8B10B_ flags,
+// and the running disparity the word leaves behind in bit RD_SHIFT
+static unsigned short int table[2][1 << CHARACTER_BITS];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+static void table_build(void) {
+    int rd, other, w, b;
+
+    for (rd = 0; rd < 2; rd++) {
+        for (w = 0; w < (1 << CHARACTER_BITS); w++) {
+            // Encode_8b10b[0][] holds the words with more ones, sent while
+            // the disparity is negative.  Outside the code the disparity
+            // follows the balance of the word.
+            int ones = __builtin_popcount(w);
+            int next = (ones > 5) ? 1 : (ones < 5) ? 0 : rd;
+
+            table[rd][w] = DEC8B10B_INVALID | (next << RD_SHIFT);
+        }
+    }
+    for (rd = 0; rd < 2; rd++) {
+        for (b = 0; b < 256; b++) {
+            w = Encode_8b10b[rd][b];
+            table[rd][w & CHARACTER_MASK] = (unsigned short int) (b | (((w >> 10) & 1) << RD_SHIFT));
+        }
+    }
+    // words only valid at the other disparity still decode, flagged
+    for (rd = 0; rd < 2; rd++) {
+        other = !rd;
+        for (w = 0; w < (1 << CHARACTER_BITS); w++)
+            if ((table[other][w] & DEC8B10B_INVALID) && !(table[rd][w] & DEC8B10B_INVALID))
+                table[other][w] = table[rd][w] | DEC8B10B_DISPARITY;
+    }
+}
+
+/**
+ * Starts decoding a frame, at an unknown running disparity
+ * @param d the decoder
+ */
+void dec8b10b_init(dec8b10b_t *d) {
+    pthread_once(&table_once, table_build);
+    d->rd = DEC8B10B_RD_UNKNOWN;
+}
+
+/**
+ * Decodes one 10-bit word and moves the running disparity on.  A word that
+ * is not in the code or that the encoder could not have sent at the current
+ * disparity is flagged, as the byte is probably wrong; the RS decoder can
+ * then take it as an erasure.
+ * @param d the decoder
+ * @param word the 10-bit word
+ * @return the data byte, or'ed with DEC8B10B_INVALID or DEC8B10B_DISPARITY
+ */
+int dec8b10b(dec8b10b_t *d, int word) {
+    int v;
+
+    word &= CHARACTER_MASK;
+    if (d->rd == DEC8B10B_RD_UNKNOWN) {
+        v = table[0][word];
+        if (v & (DEC8B10B_INVALID | DEC8B10B_DISPARITY))
+            v = table[1][word];
+    } else {
+        v = table[d->rd][word];
+    }
+    d->rd = (v >> RD_SHIFT) & 1;
+    return v & (0xff | DEC8B10B_INVALID | DEC8B10B_DISPARITY);
+}
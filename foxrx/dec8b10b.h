@@ -0,0 +1,38 @@
+/*
+ *  8b10b decoder for the Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef DEC8B10B_H_
+#define DEC8B10B_H_
+
+#define DEC8B10B_RD_UNKNOWN     -1      // before the first symbol of a frame
+#define DEC8B10B_INVALID        0x100   // not a code word
+#define DEC8B10B_DISPARITY      0x200   // a code word of the other disparity
+
+/**
+ * Decoder state: the running disparity, 0 or 1 as the index of
+ * Encode_8b10b[][], or DEC8B10B_RD_UNKNOWN
+ */
+typedef struct {
+    int rd;
+} dec8b10b_t;
+
+void dec8b10b_init(dec8b10b_t *d);
+int dec8b10b(dec8b10b_t *d, int word);
+
+#endif /* DEC8B10B_H_ */
@@ -0,0 +1,311 @@
+/*
+ *  Fox telemetry frame decoder for the CubeSatSim ground station
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include "foxdec.h"
+#include "foxsync.h"
+#include "dec8b10b.h"
+#include "../foxtlm/TelemEncoding.h"
+#include "../afsk/status.h"
+
+/**
+ * Sets up a decoder for one frame format
+ * @param d the decoder
+ * @param mode FOXTLM_FSK or FOXTLM_BPSK
+ * @param sink the function receiving each frame
+ * @param arg passed back to the sink
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int foxdec_init(foxdec_t *d, foxtlm_mode_t mode, foxdec_sink_t sink,
+        void *arg) {
+    if (!d) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(d, 0, sizeof(*d));
+    switch (mode) {
+    case FOXTLM_FSK:
+        d->desc = &foxtlm_fsk;
+        break;
+    case FOXTLM_BPSK:
+        // a 31-bit sync word with three errors still comes up by chance
+        // only once in a few minutes of noise
+        d->desc = &foxtlm_bpsk;
+        d->sync_errors = 3;
+        break;
+    default:
+        return -PQWS_INVALID_PARAM;
+    }
+    d->sink = sink;
+    d->arg = arg;
+    d->alt = -1;
+    rs_init();
+    return PQWS_SUCCESS;
+}
+
+static int frame_symbols(const foxtlm_desc_t *desc) {
+    return desc->header_len + desc->payloads * desc->data_len
+            + desc->rs_frames * desc->parity_len;
+}
+
+/**
+ * Decodes the symbols following a sync word into a frame: 8b10b decoding,
+ * deinterleaving and RS decoding.  Symbols that are not 8b10b code words,
+ * or not at the running disparity, are passed to the RS decoder as
+ * erasures.
+ * @param desc the frame layout
+ * @param symbols the 10-bit symbols
+ * @param inverted non-zero if the symbols are inverted
+ * @param frame the frame to fill in
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int foxdec_symbols(const foxtlm_desc_t *desc, const short int *symbols,
+        int inverted, foxdec_frame_t *frame) {
+    int erasures[RS_MAX_DEPTH][RS_PARITY_LEN];
+    int n_erasures[RS_MAX_DEPTH] = { 0 };
+    int cw_len[RS_MAX_DEPTH];
+    int flip = inverted ? CHARACTER_MASK : 0;
+    int i, j, n = 0, v;
+    const unsigned char *h;
+    dec8b10b_t dec;
+
+    if (!desc || !symbols || !frame) {
+        return -PQWS_INVALID_PARAM;
+    }
+    dec8b10b_init(&dec);
+    frame->desc = desc;
+    frame->inverted = inverted;
+    frame->symbol_errors = 0;
+    frame->disparity_errors = 0;
+    frame->corrected = 0;
+    frame->rs_errors = 0;
+    frame->len = desc->header_len + desc->payloads * desc->data_len;
+    for (j = 0; j < desc->rs_frames; j++)
+        cw_len[j] = (frame->len - j + desc->rs_frames - 1) / desc->rs_frames;
+
+    // a codeword with more erasures than parity bytes cannot be corrected
+    // anyway, so only the first RS_PARITY_LEN of them are kept
+    for (i = 0; i < frame->len; i++) {
+        v = dec8b10b(&dec, symbols[n++] ^ flip);
+        if (v & (DEC8B10B_INVALID | DEC8B10B_DISPARITY)) {
+            j = i % desc->rs_frames;
+            frame->symbol_errors += !!(v & DEC8B10B_INVALID);
+            frame->disparity_errors += !!(v & DEC8B10B_DISPARITY);
+            if (n_erasures[j] < RS_PARITY_LEN)
+                erasures[j][n_erasures[j]++] = i / desc->rs_frames;
+        }
+        frame->data8[i] = (unsigned char) v;
+    }
+    for (i = 0; i < desc->parity_len; i++) {
+        for (j = 0; j < desc->rs_frames; j++) {
+            v = dec8b10b(&dec, symbols[n++] ^ flip);
+            if (v & (DEC8B10B_INVALID | DEC8B10B_DISPARITY)) {
+                frame->symbol_errors += !!(v & DEC8B10B_INVALID);
+                frame->disparity_errors += !!(v & DEC8B10B_DISPARITY);
+                if (n_erasures[j] < RS_PARITY_LEN)
+                    erasures[j][n_erasures[j]++] = cw_len[j] + i;
+            }
+            frame->parities[j][i] = (unsigned char) v;
+        }
+    }
+
+    for (j = 0; j < desc->rs_frames; j++) {
+        v = rs_decode(&frame->data8[j], cw_len[j], desc->rs_frames, frame->parities[j],
+                erasures[j], n_erasures[j]);
+        if (v < 0)
+            frame->rs_errors++;
+        else
+            frame->corrected += v;
+    }
+
+    // the header, least significant bit first
+    h = frame->data8;
+    frame->id = h[0] & 0x07;
+    frame->reset_count = (h[0] >> 3) | (h[1] << 5) | ((h[2] & 0x07) << 13);
+    frame->uptime = (h[2] >> 3) | (h[3] << 5) | ((long) h[4] << 13)
+            | ((long) (h[5] & 0x0f) << 21);
+    frame->frame_type = h[5] >> 4;
+    return PQWS_SUCCESS;
+}
+
+// write_wave() sends every bit one bit period late, so the last bit of a
+// lone frame is whatever the receiver made of the gap after it; the RS
+// decoder corrects it like any other error.  A frame that fails while a
+// later sync word was seen inside it is not reported, as it is tried again
+// from there.
+static int end_frame(foxdec_t *d) {
+    foxdec_frame_t frame;
+
+    foxdec_symbols(d->desc, d->symbols, d->inverted, &frame);
+    if (frame.rs_errors && d->alt >= d->base)
+        return 0;
+    frame.bit = d->bit - (long) frame_symbols(d->desc) * CHARACTER_BITS;
+    if (frame.rs_errors == 0)
+        d->frames++;
+    else
+        d->failed++;
+    if (d->sink)
+        d->sink(d->arg, &frame);
+    return 1;
+}
+
+static void start_frame(foxdec_t *d, int inverted) {
+    d->collecting = frame_symbols(d->desc) * CHARACTER_BITS;
+    d->inverted = inverted;
+    d->symbol = 0;
+    d->nbits = 0;
+    d->nsymbols = 0;
+    d->alt = -1;
+}
+
+// Decodes the bits of buf[] from pos to have
+static int process(foxdec_t *d) {
+    const foxtlm_desc_t *desc = d->desc;
+    unsigned long long sync = (unsigned long long) desc->sync_word;
+    int done = 0, inverted;
+    long p, end;
+
+    while (d->pos < d->have) {
+        if (!d->collecting) {
+            p = foxsync_find(d->buf, (d->pos > desc->sync_bits - 1) ? d->pos : desc->sync_bits - 1,
+                    d->have, sync, desc->sync_bits, d->sync_errors, &inverted);
+            if (p < 0) {
+                d->pos = d->have;
+                break;
+            }
+            start_frame(d, inverted);
+            d->pos = p + 1;
+            continue;
+        }
+
+        // the sync word never shows up inside the 8b10b symbols of a good
+        // frame, so one that does means either that the frame being
+        // collected started on a false sync in the noise before the real
+        // one, or that a bit error made one up.  The first one is kept in
+        // case the frame fails.  Errors in the sync word are only allowed
+        // while hunting, as near misses inside a frame are too common.
+        end = (d->have - d->pos < d->collecting) ? d->have : d->pos + d->collecting;
+        if (d->alt < 0) {
+            p = foxsync_find(d->buf, d->pos, end, sync, desc->sync_bits, 0, &inverted);
+            if (p >= 0) {
+                d->alt = d->base + p + 1;
+                d->alt_inverted = inverted;
+            }
+        }
+        while (d->pos < end) {
+            int take = CHARACTER_BITS - d->nbits;
+
+            if (take > end - d->pos)
+                take = (int) (end - d->pos);
+            d->symbol = (d->symbol << take) | (int) foxsync_get(d->buf, d->pos, take);
+            d->nbits += take;
+            d->pos += take;
+            d->collecting -= take;
+            if (d->nbits == CHARACTER_BITS) {
+                d->symbols[d->nsymbols++] = (short int) d->symbol;
+                d->symbol = 0;
+                d->nbits = 0;
+            }
+        }
+        if (d->collecting == 0) {
+            d->bit = d->base + d->pos;
+            if (end_frame(d)) {
+                done++;
+            } else {
+                p = d->alt - d->base;
+                start_frame(d, d->alt_inverted);
+                d->pos = p;
+            }
+        }
+    }
+    d->bit = d->base + d->have;
+    return done;
+}
+
+// Makes room in a full buf[], keeping the bits a frame may be tried again
+// from and those the sync search looks back on
+static void compact(foxdec_t *d) {
+    memmove(d->buf, &d->buf[(FOXDEC_BUF_BITS - FOXDEC_KEEP_BITS) / 8], FOXDEC_KEEP_BITS / 8);
+    d->base += FOXDEC_BUF_BITS - FOXDEC_KEEP_BITS;
+    d->have = FOXDEC_KEEP_BITS;
+    d->pos = FOXDEC_KEEP_BITS;
+}
+
+/**
+ * Feeds demodulated bits to the decoder
+ * @param d the decoder
+ * @param bits the bits, one per byte
+ * @param n the number of bits
+ * @return the number of frames completed
+ */
+int foxdec_bits(foxdec_t *d, const unsigned char *bits, int n) {
+    int i, done = 0;
+
+    for (i = 0; i < n; i++) {
+        if (d->have == FOXDEC_BUF_BITS) {
+            done += process(d);
+            compact(d);
+        }
+        if ((d->have & 7) == 0)
+            d->buf[d->have >> 3] = 0;
+        d->buf[d->have >> 3] |= (unsigned char) ((bits[i] & 1) << (7 - (d->have & 7)));
+        d->have++;
+    }
+    return done + process(d);
+}
+
+/**
+ * Feeds a packed bitstream to the decoder, most significant bit first as
+ * foxtlm_bits() writes it
+ * @param d the decoder
+ * @param bits the bitstream
+ * @param n the number of bits
+ * @return the number of frames completed
+ */
+int foxdec_packed(foxdec_t *d, const unsigned char *bits, long n) {
+    long i = 0, k, bytes;
+    int done = 0, shift;
+
+    while (i < n) {
+        if (d->have == FOXDEC_BUF_BITS) {
+            done += process(d);
+            compact(d);
+        }
+        if ((d->have & 7) || n - i < 8) {
+            if ((d->have & 7) == 0)
+                d->buf[d->have >> 3] = 0;
+            d->buf[d->have >> 3] |= (unsigned char) (((bits[i >> 3] >> (7 - (i & 7))) & 1) << (7 - (d->have & 7)));
+            d->have++;
+            i++;
+            continue;
+        }
+        bytes = (FOXDEC_BUF_BITS - d->have) / 8;
+        if (bytes > (n - i) / 8)
+            bytes = (n - i) / 8;
+        shift = (int) (i & 7);
+        for (k = 0; k < bytes; k++) {
+            const unsigned char *b = &bits[(i >> 3) + k];
+
+            d->buf[(d->have >> 3) + k] = shift ? (unsigned char) ((b[0] << shift) | (b[1] >> (8 - shift))) : b[0];
+        }
+        d->have += 8 * bytes;
+        i += 8 * bytes;
+    }
+    return done + process(d);
+}
@@ -0,0 +1,91 @@
+/*
+ *  Fox telemetry frame decoder for the CubeSatSim ground station
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FOXDEC_H_
+#define FOXDEC_H_
+
+#include "../foxtlm/foxtlm.h"
+
+#define FOXDEC_BUF_BITS         16384   // bits searched at a time, bytes * 8
+#define FOXDEC_KEEP_BITS        6144    // history kept, above the longest frame
+
+/**
+ * A received frame.  data8[] holds the header and payloads in the same
+ * order as the encoder's data8[].
+ */
+typedef struct {
+    const foxtlm_desc_t *desc;
+    long bit;                   //!< stream bit index of the end of the sync word
+    int inverted;               //!< the bits arrived with the wrong polarity
+    int symbol_errors;          //!< 10-bit words that are not 8b10b code words
+    int disparity_errors;       //!< code words of the wrong running disparity
+    int corrected;              //!< bytes the RS decoder corrected
+    int rs_errors;              //!< codewords the RS decoder could not correct
+    int id;
+    int reset_count;
+    long uptime;
+    int frame_type;
+    int len;                    //!< bytes in data8[]
+    unsigned char data8[FOXTLM_MAX_BYTES];
+    unsigned char parities[RS_MAX_DEPTH][RS_PARITY_LEN];
+} foxdec_frame_t;
+
+/**
+ * Receives every frame found after its sync word, good or bad
+ */
+typedef void (*foxdec_sink_t)(void *arg, const foxdec_frame_t *frame);
+
+/**
+ * Decoder state.  Bits are fed in as they come out of a demodulator, one
+ * per byte, or packed; the decoder packs them into buf[], hunts for the
+ * sync word 64 positions at a time, collects the symbols of a frame and
+ * hands the decoded frame to the sink.  buf[] keeps a frame's worth of
+ * bits, so that a frame that fails can be tried again from a later sync.
+ */
+typedef struct {
+    const foxtlm_desc_t *desc;
+    foxdec_sink_t sink;
+    void *arg;
+    int sync_errors;            //!< sync bits that may be wrong when hunting
+    unsigned char buf[FOXDEC_BUF_BITS / 8 + 8];    //!< packed, 8 bytes slack
+    long base;                  //!< stream index of the first bit in buf[]
+    long have;                  //!< bits in buf[]
+    long pos;                   //!< bits of buf[] already decoded
+    int collecting;             //!< bits of a frame still to come, or 0
+    int inverted;
+    int symbol;                 //!< bits of the current symbol
+    int nbits;                  //!< bits in symbol
+    int nsymbols;               //!< symbols in symbols[]
+    long alt;                   //!< stream index after a sync word seen in
+                                //!< the frame being collected, or -1
+    int alt_inverted;
+    long bit;                   //!< bits decoded
+    long frames;                //!< frames decoded, with errors corrected
+    long failed;                //!< frames with uncorrectable errors
+    short int symbols[FOXTLM_MAX_SYMBOLS];
+} foxdec_t;
+
+int foxdec_init(foxdec_t *d, foxtlm_mode_t mode, foxdec_sink_t sink,
+        void *arg);
+int foxdec_bits(foxdec_t *d, const unsigned char *bits, int n);
+int foxdec_packed(foxdec_t *d, const unsigned char *bits, long n);
+int foxdec_symbols(const foxtlm_desc_t *desc, const short int *symbols,
+        int inverted, foxdec_frame_t *frame);
+
+#endif /* FOXDEC_H_ */
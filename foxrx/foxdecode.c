@@ -0,0 +1,425 @@
+/*
+ *  Ground decoder for the CubeSatSim Fox telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Decodes DUV FSK or BPSK telemetry from recordings, WAV files or raw
+// 16-bit little endian samples, or from the sample stream radioafsk sends
+// to rpitx on port 8080, and prints the header and the fields of every
+// frame, named and converted as in the FoxTelem layout files.  Several
+// files are decoded in parallel, one per thread.
+//
+//   foxdecode [-m fsk|bpsk] [-r rate] [-l layout.csv] [-c curves.csv]
+//             [-w wodlayout.csv] [-j threads] [-q] [file ... | -]
+//   foxdecode [-m fsk|bpsk] -p port ...
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "fskdemod.h"
+#include "bpskdemod.h"
+#include "foxdec.h"
+#include "layout.h"
+#include "../foxtlm/fifo.h"
+#include "../foxtlm/wodz.h"
+#include "../afsk/status.h"
+
+#define DEFAULT_RATE    48000
+#define FSK_BIT_RATE    200
+#define BPSK_BIT_RATE   1200
+#define BPSK_FREQ_HZ    3000
+#define BLOCK_SAMPLES   65536
+#define MAX_THREADS     64
+#define LAYOUT_FILE     "spacecraft/FoxTelem_1.09m/CubeSatSim_rttelemetry.csv"
+#define PSK_LAYOUT_FILE "spacecraft/FoxTelem_1.09m/CubeSatSim_PSK_rttelemetry.csv"
+#define WOD_LAYOUT_FILE "spacecraft/FoxTelem_1.09m/CubeSatSim_PSK_wodtelemetry.csv"
+#define CURVES_FILE     "spacecraft/FoxTelem_1.09m/CubeSatSim_conversion_curves.csv"
+
+typedef struct {
+    layout_t *layout;           //!< NULL to print the header only
+    layout_t *wod_layout;       //!< of WOD frames, NULL to print their header only
+    const plan_t *wod_plan;     //!< of compressed WOD frames
+    int quiet;
+    foxtlm_mode_t mode;
+    int rate;                   //!< for raw samples
+    long frames, failed, samples;
+    double seconds;             //!< of audio
+} options_t;
+
+// One recording or connection being decoded
+typedef struct {
+    options_t *opt;             //!< totals are added up here
+    const char *name;           //!< printed before each frame, or NULL
+    int bit_rate;
+    fskdemod_t fsk;
+    bpskdemod_t bpsk;
+    foxdec_t dec;
+    short int samples[BLOCK_SAMPLES];
+    unsigned char bits[BLOCK_SAMPLES];
+} stream_t;
+
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Prints the fields of a payload
+static void print_payload(const layout_t *l, const unsigned char *payload, int len) {
+    int i;
+
+    for (i = 0; i < l->count; i++) {
+        unsigned long raw;
+
+        if (l->field[i].offset + l->field[i].bits > len * 8)
+            break;
+        if (l->field[i].bits > 32)     // padding
+            continue;
+        raw = layout_get(payload, l->field[i].offset, l->field[i].bits);
+        if (l->field[i].curve >= 0)
+            printf("  %s=%.2f", l->field[i].name, layout_value(l, i, raw));
+        else
+            printf("  %s=%lu", l->field[i].name, raw);
+        if (i % 6 == 5)
+            printf("\n");
+    }
+    printf("\n");
+}
+
+// Prints the WOD samples of a BPSK frame, compressed or one per payload
+static void print_wod(const options_t *opt, const foxdec_frame_t *frame) {
+    static const int max = 255;
+    const foxtlm_desc_t *d = frame->desc;
+    const unsigned char *payloads = &frame->data8[d->header_len];
+    unsigned char *records = NULL;
+    int i, n = d->payloads;
+
+    if (frame->frame_type == FOXTLM_WODZ_FRAME) {
+        records = malloc((size_t) max * d->data_len);
+        n = records ? wodz_decode(opt->wod_plan, payloads, d->payloads * d->data_len, records, d->data_len, max) : -1;
+        if (n < 0) {
+            printf("  compressed WOD block not decoded\n");
+            free(records);
+            return;
+        }
+        payloads = records;
+    }
+    for (i = 0; i < n; i++) {
+        printf(" WOD sample %d:\n", i);
+        print_payload(opt->wod_layout, &payloads[i * d->data_len], d->data_len);
+    }
+    free(records);
+}
+
+// Prints a frame.  Only the first payload of a BPSK frame is shown, but every
+// sample of a WOD frame.
+static void print_frame(void *arg, const foxdec_frame_t *frame) {
+    stream_t *st = arg;
+    const layout_t *l = st->opt->layout;
+    const unsigned char *payload = &frame->data8[frame->desc->header_len];
+
+    if (st->opt->quiet)
+        return;
+    // frames of streams decoded in parallel must not interleave
+    flockfile(stdout);
+    if (st->name)
+        printf("%s: ", st->name);
+    printf("%.3f s: id %d reset %d uptime %ld type %d", (double) frame->bit / st->bit_rate,
+            frame->id, frame->reset_count, frame->uptime, frame->frame_type);
+    if (frame->rs_errors) {
+        printf(" FAILED, %d 8b10b errors, %d RS codewords uncorrectable\n", frame->symbol_errors, frame->rs_errors);
+        funlockfile(stdout);
+        return;
+    }
+    if (frame->corrected)
+        printf(", %d bytes corrected", frame->corrected);
+    printf("%s\n", frame->inverted ? " inverted" : "");
+    if ((frame->desc->mode == FOXTLM_BPSK) && st->opt->wod_layout
+            && ((frame->frame_type == FOXTLM_WOD_FRAME) || (frame->frame_type == FOXTLM_WODZ_FRAME)))
+        print_wod(st->opt, frame);
+    else if (l)
+        print_payload(l, payload, frame->desc->data_len);
+    funlockfile(stdout);
+}
+
+// Skips the header of a WAV file, leaving the file at the first sample
+static int read_wav_header(FILE *in, int *rate, int *channels) {
+    unsigned char h[12], c[8], fmt[16];
+    uint32_t size;
+
+    if (fread(h, 1, 12, in) != 12 || memcmp(h, "RIFF", 4) != 0 || memcmp(&h[8], "WAVE", 4) != 0)
+        return -PQWS_INVALID_PARAM;
+    while (fread(c, 1, 8, in) == 8) {
+        size = c[4] | (c[5] << 8) | (c[6] << 16) | ((uint32_t) c[7] << 24);
+        if (memcmp(c, "data", 4) == 0)
+            return PQWS_SUCCESS;
+        if (memcmp(c, "fmt ", 4) == 0 && size >= 16) {
+            if (fread(fmt, 1, 16, in) != 16)
+                return -PQWS_INVALID_PARAM;
+            if ((fmt[0] | (fmt[1] << 8)) != 1 || (fmt[14] | (fmt[15] << 8)) != 16) {
+                fprintf(stderr, "ERROR: only 16-bit PCM WAV files are supported\n");
+                return -PQWS_INVALID_PARAM;
+            }
+            *channels = fmt[2] | (fmt[3] << 8);
+            *rate = fmt[4] | (fmt[5] << 8) | (fmt[6] << 16) | (fmt[7] << 24);
+            size -= 16;
+        }
+        if (fseek(in, size + (size & 1), SEEK_CUR) != 0)
+            return -PQWS_INVALID_PARAM;
+    }
+    return -PQWS_INVALID_PARAM;
+}
+
+// Decodes one recording or connection to the end
+static int decode(stream_t *st, FILE *in, int wav) {
+    options_t *opt = st->opt;
+    int rate = opt->rate, channels = 1, n, i, nbits;
+    long total = 0;
+
+    if (wav && read_wav_header(in, &rate, &channels) != PQWS_SUCCESS) {
+        rewind(in);     // raw samples
+        channels = 1;
+    }
+    if (opt->mode == FOXTLM_BPSK) {
+        st->bit_rate = BPSK_BIT_RATE;
+        n = bpskdemod_init(&st->bpsk, rate, BPSK_BIT_RATE, BPSK_FREQ_HZ);
+    } else {
+        st->bit_rate = FSK_BIT_RATE;
+        n = fskdemod_init(&st->fsk, rate, FSK_BIT_RATE);
+    }
+    if (channels < 1 || channels > BLOCK_SAMPLES || n != PQWS_SUCCESS) {
+        fprintf(stderr, "ERROR: %s: cannot demodulate at %d samples/s\n", st->name ? st->name : "input", rate);
+        return -PQWS_INVALID_PARAM;
+    }
+    foxdec_init(&st->dec, opt->mode, print_frame, st);
+
+    while ((n = (int) fread(st->samples, sizeof(short int) * channels,
+            BLOCK_SAMPLES / channels, in)) > 0) {
+        for (i = 0; channels > 1 && i < n; i++)      // keep the first channel
+            st->samples[i] = st->samples[i * channels];
+        if (opt->mode == FOXTLM_BPSK)
+            nbits = bpskdemod_process(&st->bpsk, st->samples, n, st->bits);
+        else
+            nbits = fskdemod_process(&st->fsk, st->samples, n, st->bits);
+        foxdec_bits(&st->dec, st->bits, nbits);
+        total += n;
+    }
+    if (opt->mode == FOXTLM_BPSK)
+        bpskdemod_free(&st->bpsk);
+
+    pthread_mutex_lock(&totals_lock);
+    opt->frames += st->dec.frames;
+    opt->failed += st->dec.failed;
+    opt->samples += total;
+    opt->seconds += (double) total / rate;
+    pthread_mutex_unlock(&totals_lock);
+    return PQWS_SUCCESS;
+}
+
+typedef struct {
+    options_t *opt;
+    fifo_t *jobs;               //!< file names
+    int named;                  //!< prefix frames with the file name
+} worker_t;
+
+static void *worker(void *arg) {
+    worker_t *w = arg;
+    stream_t *st = malloc(sizeof(stream_t));
+    const char *file;
+
+    if (!st)
+        return NULL;
+    while (fifo_pop(w->jobs, &file)) {
+        int is_stdin = (strcmp(file, "-") == 0);
+        FILE *in = is_stdin ? stdin : fopen(file, "rb");
+
+        if (!in) {
+            fprintf(stderr, "ERROR: cannot read %s\n", file);
+            continue;
+        }
+        st->opt = w->opt;
+        st->name = w->named ? file : NULL;
+        decode(st, in, !is_stdin);
+        if (!is_stdin)
+            fclose(in);
+    }
+    free(st);
+    return NULL;
+}
+
+// Takes the sample stream radioafsk sends to rpitx, one connection at a time
+static int listen_port(options_t *opt, int port) {
+    struct sockaddr_in addr;
+    stream_t *st = malloc(sizeof(stream_t));
+    int server, conn, one = 1;
+
+    if (!st || (server = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+        free(st);
+        return -PQWS_INVALID_PARAM;
+    }
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(server, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(server, 1) < 0) {
+        fprintf(stderr, "ERROR: cannot listen on port %d\n", port);
+        close(server);
+        free(st);
+        return -PQWS_INVALID_PARAM;
+    }
+    fprintf(stderr, "Listening on port %d\n", port);
+    while ((conn = accept(server, NULL, NULL)) >= 0) {
+        FILE *in = fdopen(conn, "rb");
+
+        if (!in) {
+            close(conn);
+            continue;
+        }
+        fprintf(stderr, "Connected\n");
+        st->opt = opt;
+        st->name = NULL;
+        decode(st, in, 0);
+        fclose(in);
+        fprintf(stderr, "Disconnected, %ld frames decoded, %ld failed\n", st->dec.frames, st->dec.failed);
+    }
+    close(server);
+    free(st);
+    return PQWS_SUCCESS;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-m fsk|bpsk] [-r rate] [-l layout.csv] [-c curves.csv] [-w wodlayout.csv]\n"
+            "           [-j threads] [-q]\n"
+            "           [-p port | file ... | -]\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    const char *layout_file = NULL, *curves_file = CURVES_FILE, *wod_file = WOD_LAYOUT_FILE;
+    static const char *std_in = "-";
+    static layout_t layout, wod_layout;
+    static plan_t wod_plan;
+    static options_t opt = { NULL, NULL, NULL, 0, FOXTLM_FSK, DEFAULT_RATE, 0, 0, 0, 0 };
+    pthread_t threads[MAX_THREADS];
+    worker_t w;
+    fifo_t jobs;
+    int threads_n = (int) sysconf(_SC_NPROCESSORS_ONLN), files, port = 0, c, i;
+
+    while ((c = getopt(argc, argv, "m:r:l:c:w:j:p:q")) != -1) {
+        switch (c) {
+        case 'm':
+            if (strcmp(optarg, "fsk") == 0) {
+                opt.mode = FOXTLM_FSK;
+            } else if (strcmp(optarg, "bpsk") == 0) {
+                opt.mode = FOXTLM_BPSK;
+            } else {
+                usage(argv[0]);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r':
+            opt.rate = atoi(optarg);
+            break;
+        case 'l':
+            layout_file = optarg;
+            break;
+        case 'c':
+            curves_file = optarg;
+            break;
+        case 'w':
+            wod_file = optarg;
+            break;
+        case 'j':
+            threads_n = atoi(optarg);
+            break;
+        case 'p':
+            port = atoi(optarg);
+            break;
+        case 'q':
+            opt.quiet = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!layout_file)
+        layout_file = (opt.mode == FOXTLM_BPSK) ? PSK_LAYOUT_FILE : LAYOUT_FILE;
+
+    if (layout_load(&layout, layout_file) == PQWS_SUCCESS) {
+        opt.layout = &layout;
+        if (layout_load_curves(&layout, curves_file) != PQWS_SUCCESS)
+            fprintf(stderr, "Cannot read %s, printing raw values\n", curves_file);
+    } else {
+        fprintf(stderr, "Cannot read %s, printing the frame headers only\n", layout_file);
+    }
+
+    // WOD frames are printed with the WOD layout, which also gives the
+    // fields of the compressed ones
+    if ((opt.mode == FOXTLM_BPSK) && (layout_load(&wod_layout, wod_file) == PQWS_SUCCESS)) {
+        layout_load_curves(&wod_layout, curves_file);
+        opt.wod_layout = &wod_layout;
+        opt.wod_plan = (plan_compile(&wod_plan, wod_file) == PQWS_SUCCESS) ? &wod_plan : plan_builtin(PLAN_WOD);
+    }
+
+    if (port > 0)
+        return (listen_port(&opt, port) == PQWS_SUCCESS) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+    files = argc - optind;
+    if (threads_n > files)
+        threads_n = files;
+    if (threads_n < 1)
+        threads_n = 1;
+    if (threads_n > MAX_THREADS)
+        threads_n = MAX_THREADS;
+    if (fifo_init(&jobs, files > 0 ? files : 1, sizeof(const char *)) != PQWS_SUCCESS)
+        return EXIT_FAILURE;
+    if (files == 0)
+        fifo_push(&jobs, &std_in);
+    for (i = optind; i < argc; i++)
+        fifo_push(&jobs, &argv[i]);
+    fifo_close(&jobs);
+
+    w.opt = &opt;
+    w.jobs = &jobs;
+    w.named = (files > 1);
+    double start = now();
+    for (i = 0; i < threads_n; i++)
+        if (pthread_create(&threads[i], NULL, worker, &w) != 0)
+            break;
+    threads_n = i;
+    if (threads_n == 0)
+        worker(&w);
+    for (i = 0; i < threads_n; i++)
+        pthread_join(threads[i], NULL);
+    double elapsed = now() - start;
+    fifo_free(&jobs);
+
+    fprintf(stderr, "%ld samples (%.1f s of audio) in %.2f s, %.0f times real time, %.3g samples/s\n",
+            opt.samples, opt.seconds, elapsed, elapsed > 0 ? opt.seconds / elapsed : 0,
+            elapsed > 0 ? opt.samples / elapsed : 0);
+    fprintf(stderr, "%ld frames decoded, %ld failed\n", opt.frames, opt.failed);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+/*
+ *  Bit-parallel sync word search for the Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "foxsync.h"
+
+// 64 bits from bit i on, most significant first; nothing is read from
+// byte end on
+static inline unsigned long long load64(const unsigned char *bits, long i,
+        long end) {
+    long b = i >> 3;
+    unsigned long long v = 0;
+    int k;
+
+    if (b + 9 <= end) {
+        for (k = 0; k < 8; k++)
+            v = (v << 8) | bits[b + k];
+        return (i & 7) ? (v << (i & 7)) | (bits[b + 8] >> (8 - (i & 7))) : v;
+    }
+    for (k = 0; k < 8; k++)
+        v = (v << 8) | ((b + k < end) ? bits[b + k] : 0);
+    if ((i & 7) && b + 8 < end)
+        return (v << (i & 7)) | (bits[b + 8] >> (8 - (i & 7)));
+    return v << (i & 7);
+}
+
+// Adds one to the bit-sliced 3-bit counters of the lanes set in x;
+// lanes that reach 8 are marked in over
+static inline void count(unsigned long long x, unsigned long long c[3],
+        unsigned long long *over) {
+    unsigned long long carry = c[0] & x;
+
+    c[0] ^= x;
+    x = carry;
+    carry = c[1] & x;
+    c[1] ^= x;
+    x = carry;
+    carry = c[2] & x;
+    c[2] ^= x;
+    *over |= carry;
+}
+
+/**
+ * Finds the first sync word in a packed bitstream, most significant bit
+ * first as foxtlm_bits() writes it, in either polarity.  The 64 positions
+ * of a word are tried at once: every bit of the sync word is compared
+ * with the stream shifted by that bit, and the mismatches are counted in
+ * bit-sliced counters, one lane per position.
+ * @param bits the bitstream
+ * @param from the first position to try, at least sync_bits - 1
+ * @param to the end of the stream
+ * @param sync the sync word, the last bit sent in bit 0
+ * @param sync_bits the length of the sync word
+ * @param max_errors the number of bits of the sync word that may be wrong
+ * @param inverted set to 1 if the sync word was found inverted, or NULL
+ * @return the position of the last bit of the sync word, or -1 if none
+ * was found or a parameter is invalid
+ */
+long foxsync_find(const unsigned char *bits, long from, long to,
+        unsigned long long sync, int sync_bits, int max_errors,
+        int *inverted) {
+    long end = (to + 7) >> 3, p0;
+    int bias = FOXSYNC_MAX_ERRORS - max_errors, k;
+
+    if (!bits || sync_bits < 1 || sync_bits > FOXSYNC_MAX_BITS || max_errors < 0
+            || max_errors > FOXSYNC_MAX_ERRORS || from < sync_bits - 1)
+        return -1;
+
+    for (p0 = from; p0 < to; p0 += 64) {
+        unsigned long long ok, iok;
+
+        if (max_errors == 0) {
+            // most positions fail within the first few bits
+            ok = iok = ~0ULL;
+            for (k = 0; k < sync_bits && (ok | iok); k++) {
+                unsigned long long x = load64(bits, p0 - k, end) ^ (((sync >> k) & 1) ? ~0ULL : 0);
+
+                ok &= ~x;
+                iok &= x;
+            }
+        } else {
+            // the counters start at 7 - max_errors, so one error too many
+            // carries out of them
+            unsigned long long c[3], ic[3], over = 0, iover = 0;
+
+            for (k = 0; k < 3; k++)
+                c[k] = ic[k] = ((bias >> k) & 1) ? ~0ULL : 0;
+            for (k = 0; k < sync_bits && ~(over & iover); k++) {
+                unsigned long long x = load64(bits, p0 - k, end) ^ (((sync >> k) & 1) ? ~0ULL : 0);
+
+                count(x, c, &over);
+                count(~x, ic, &iover);
+            }
+            ok = ~over;
+            iok = ~iover;
+        }
+        if (to - p0 < 64) {
+            ok &= ~0ULL << (64 - (to - p0));
+            iok &= ~0ULL << (64 - (to - p0));
+        }
+        if (ok | iok) {
+            int m = __builtin_clzll(ok | iok);
+
+            if (inverted)
+                *inverted = !((ok << m) >> 63);
+            return p0 + m;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,46 @@
+/*
+ *  Bit-parallel sync word search for the Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FOXSYNC_H_
+#define FOXSYNC_H_
+
+#define FOXSYNC_MAX_BITS        63      // longest sync word
+#define FOXSYNC_MAX_ERRORS      7       // most bit errors allowed
+
+long foxsync_find(const unsigned char *bits, long from, long to,
+        unsigned long long sync, int sync_bits, int max_errors,
+        int *inverted);
+
+/**
+ * Reads n bits (at most 57) of a packed bitstream, most significant bit
+ * first, from bit i on.  Eight bytes are read from byte i / 8, so the
+ * buffer needs that much slack past its last bit.
+ */
+static inline unsigned long long foxsync_get(const unsigned char *bits,
+        long i, int n) {
+    const unsigned char *p = &bits[i >> 3];
+    unsigned long long v = 0;
+    int k;
+
+    for (k = 0; k < 8; k++)
+        v = (v << 8) | p[k];
+    return (v << (i & 7)) >> (64 - n);
+}
+
+#endif /* FOXSYNC_H_ */
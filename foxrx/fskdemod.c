@@ -0,0 +1,142 @@
+/*
+ *  Demodulator for the CubeSatSim DUV 200 bps FSK telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "fskdemod.h"
+#include "../afsk/status.h"
+
+#define HALF_BIT        0x80000000u
+
+// where a crossing is seen: half a bit, plus the time the filter output
+// takes to get past the hysteresis
+#define CROSS_PHASE     (HALF_BIT + (HALF_BIT >> FSKDEMOD_HYST_SHIFT))
+
+/**
+ * Sets up a demodulator
+ * @param d the demodulator
+ * @param s_rate the sample rate of the audio
+ * @param bit_rate the bit rate, 200 for DUV
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int fskdemod_init(fskdemod_t *d, int s_rate, int bit_rate) {
+    if (!d || bit_rate <= 0 || s_rate < 2 * bit_rate) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(d, 0, sizeof(*d));
+    d->s_rate = s_rate;
+    d->bit_rate = bit_rate;
+    d->len = (s_rate + bit_rate / 2) / bit_rate;
+    if (d->len >= FSKDEMOD_HIST) {
+        return -PQWS_INVALID_PARAM;
+    }
+    d->step = (unsigned int) (((unsigned long long) bit_rate << 32) / s_rate);
+    d->idle = FSKDEMOD_IDLE_BITS;
+    d->last = -1;
+    return PQWS_SUCCESS;
+}
+
+/**
+ * @param d the demodulator
+ * @param n a number of samples
+ * @return the most bits fskdemod_process() can return for n samples
+ */
+int fskdemod_max_bits(const fskdemod_t *d, int n) {
+    return (int) (((long long) n * d->bit_rate) / d->s_rate) + 1;
+}
+
+/**
+ * Demodulates a block of samples.  State is kept between calls, so a
+ * recording can be fed in blocks of any size.
+ * @param d the demodulator
+ * @param in the samples
+ * @param n the number of samples
+ * @param bits where to write the bits, one per byte, at least
+ * fskdemod_max_bits() of them
+ * @return the number of bits written
+ */
+int fskdemod_process(fskdemod_t *d, const short int *in, int n,
+        unsigned char *bits) {
+    unsigned int phase = d->phase, pos = d->pos;
+    int adj = d->adj, limit = (int) (d->step / 2);
+    long long dc = d->dc;
+    long sum = d->sum;
+    long long level = d->level, peak = d->peak;
+    int last = d->last, idle = d->idle;
+    int i, nbits = 0;
+
+    for (i = 0; i < n; i++) {
+        int x = in[i];
+        long long v, hyst, mag;
+        int sign, corr;
+        unsigned int prev;
+
+        dc += (((long long) x << 16) - dc) >> FSKDEMOD_DC_SHIFT;
+        sum += x - d->hist[(pos - d->len) & (FSKDEMOD_HIST - 1)];
+        d->hist[pos & (FSKDEMOD_HIST - 1)] = x;
+        pos++;
+
+        v = ((long long) sum << 16) - dc * d->len;
+        hyst = level >> FSKDEMOD_HYST_SHIFT;
+        sign = (v > hyst) ? 1 : (v < -hyst) ? 0 : last;
+        mag = (v < 0) ? -v : v;
+        if (mag > peak)
+            peak = mag;
+        if (sign != last) {
+            // the filter crosses zero half a bit before the next decision.
+            // Crossings that end a weak excursion are noise; after a long
+            // run without transitions the clock snaps to the next one.
+            if (last >= 0 && peak >= level / 2) {
+                if (idle >= FSKDEMOD_IDLE_BITS) {
+                    phase = CROSS_PHASE;
+                    adj = 0;
+                } else {
+                    adj = -((int) (phase - CROSS_PHASE) >> FSKDEMOD_GAIN_SHIFT);
+                }
+                idle = 0;
+            }
+            if (peak > level)
+                level += (peak - level) >> FSKDEMOD_ATTACK_SHIFT;
+            else
+                level -= (level - peak) >> FSKDEMOD_DECAY_SHIFT;
+            peak = 0;
+            last = sign;
+        }
+        // the correction is spread over several samples so that the clock
+        // never steps over a decision or back across one
+        corr = (adj > limit) ? limit : (adj < -limit) ? -limit : adj;
+        adj -= corr;
+        prev = phase;
+        phase += d->step + corr;
+        if (phase < prev) {
+            bits[nbits++] = (unsigned char) (v > 0);
+            if (idle < FSKDEMOD_IDLE_BITS)
+                idle++;
+        }
+    }
+    d->phase = phase;
+    d->adj = adj;
+    d->pos = pos;
+    d->dc = dc;
+    d->sum = sum;
+    d->level = level;
+    d->peak = peak;
+    d->last = last;
+    d->idle = idle;
+    return nbits;
+}
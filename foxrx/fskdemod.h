@@ -0,0 +1,60 @@
+/*
+ *  Demodulator for the CubeSatSim DUV 200 bps FSK telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FSKDEMOD_H_
+#define FSKDEMOD_H_
+
+#define FSKDEMOD_HIST           512     // power of two, above the longest bit
+#define FSKDEMOD_DC_SHIFT       14      // DC tracking time constant, samples
+#define FSKDEMOD_GAIN_SHIFT     5       // clock correction per transition
+#define FSKDEMOD_IDLE_BITS      16      // bits without a transition to relock
+#define FSKDEMOD_ATTACK_SHIFT   2       // signal level rise, in crossings
+#define FSKDEMOD_DECAY_SHIFT    8       // signal level fall, in crossings
+#define FSKDEMOD_HYST_SHIFT     3       // crossing hysteresis, level / 8
+
+/**
+ * Demodulator state.  The DUV waveform is NRZ at baseband: each bit is a
+ * constant level of the sign of the bit.  The matched filter is therefore a
+ * moving sum over one bit period, and the bit clock is a phase accumulator
+ * pulled so that the zero crossings of the filter fall half way between two
+ * decisions.
+ */
+typedef struct {
+    int s_rate;
+    int bit_rate;
+    int len;                    //!< samples in the matched filter
+    unsigned int step;          //!< phase advance per sample, 2^32 per bit
+    unsigned int phase;         //!< bit clock, a decision on every wrap
+    int adj;                    //!< clock correction still to apply
+    unsigned int pos;           //!< samples seen, modulo 2^32
+    long long dc;               //!< DC level, 16 fractional bits
+    long sum;                   //!< filter output
+    long long level;            //!< filter magnitude between crossings
+    long long peak;             //!< filter magnitude since the last crossing
+    int last;                   //!< sign of the filter output, -1 at first
+    int idle;                   //!< bits since the last transition
+    int hist[FSKDEMOD_HIST];
+} fskdemod_t;
+
+int fskdemod_init(fskdemod_t *d, int s_rate, int bit_rate);
+int fskdemod_max_bits(const fskdemod_t *d, int n);
+int fskdemod_process(fskdemod_t *d, const short int *in, int n,
+        unsigned char *bits);
+
+#endif /* FSKDEMOD_H_ */
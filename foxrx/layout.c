@@ -0,0 +1,180 @@
+/*
+ *  FoxTelem telemetry layouts for the CubeSatSim ground decoder
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "layout.h"
+#include "../afsk/status.h"
+
+#define LINE_LEN        512
+#define MAX_COLUMNS     16
+
+// Splits a CSV line in place; FoxTelem files have no quoted columns
+static int split(char *line, char *col[], int max) {
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = 0;
+    col[n++] = line;
+    while (n < max && (line = strchr(line, ',')) != NULL) {
+        *line++ = 0;
+        col[n++] = line;
+    }
+    return n;
+}
+
+static void copy_name(char *dst, const char *src) {
+    strncpy(dst, src, LAYOUT_NAME_LEN - 1);
+    dst[LAYOUT_NAME_LEN - 1] = 0;
+}
+
+// Matches each field with the curve named before the '|' of its conversion
+static void resolve_curves(layout_t *l) {
+    int i, k;
+
+    for (i = 0; i < l->count; i++) {
+        size_t len = strcspn(l->conversion[i], "|");
+
+        l->field[i].curve = -1;
+        for (k = 0; k < l->curves; k++) {
+            if (strlen(l->curve[k].name) == len
+                    && strncmp(l->curve[k].name, l->conversion[i], len) == 0) {
+                l->field[i].curve = k;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * Reads the fields of a FoxTelem layout file
+ * @param l the layout
+ * @param path the CSV file
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the file cannot be read
+ */
+int layout_load(layout_t *l, const char *path) {
+    char line[LINE_LEN];
+    char *col[MAX_COLUMNS];
+    FILE *in;
+
+    if (!l || !path || (in = fopen(path, "r")) == NULL) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(l, 0, sizeof(*l));
+
+    // the first line holds the field count and the column names
+    if (!fgets(line, sizeof(line), in)) {
+        fclose(in);
+        return -PQWS_INVALID_PARAM;
+    }
+    while (fgets(line, sizeof(line), in) && l->count < LAYOUT_MAX_FIELDS) {
+        layout_field_t *f = &l->field[l->count];
+
+        if (split(line, col, MAX_COLUMNS) < 6)
+            continue;
+        f->bits = atoi(col[3]);
+        if (f->bits <= 0) {
+            fclose(in);
+            return -PQWS_INVALID_PARAM;
+        }
+        copy_name(f->name, col[2]);
+        copy_name(l->conversion[l->count], col[5]);
+        f->offset = l->bits;
+        l->bits += f->bits;
+        l->count++;
+    }
+    fclose(in);
+    resolve_curves(l);
+    return (l->count > 0) ? PQWS_SUCCESS : -PQWS_INVALID_PARAM;
+}
+
+/**
+ * Reads a FoxTelem conversion curve file and applies its curves to the
+ * fields that name them
+ * @param l the layout
+ * @param path the CSV file
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the file cannot be read
+ */
+int layout_load_curves(layout_t *l, const char *path) {
+    char line[LINE_LEN];
+    char *col[MAX_COLUMNS];
+    FILE *in;
+    int k;
+
+    if (!l || !path || (in = fopen(path, "r")) == NULL) {
+        return -PQWS_INVALID_PARAM;
+    }
+    l->curves = 0;
+    if (!fgets(line, sizeof(line), in)) {    // column names
+        fclose(in);
+        return -PQWS_INVALID_PARAM;
+    }
+    while (fgets(line, sizeof(line), in) && l->curves < LAYOUT_MAX_CURVES) {
+        layout_curve_t *c = &l->curve[l->curves];
+
+        if (split(line, col, MAX_COLUMNS) < 1 + LAYOUT_CURVE_TERMS)
+            continue;
+        copy_name(c->name, col[0]);
+        for (k = 0; k < LAYOUT_CURVE_TERMS; k++)
+            c->c[k] = atof(col[1 + k]);
+        l->curves++;
+    }
+    fclose(in);
+    resolve_curves(l);
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Extracts a field from a payload, least significant bit first
+ * @param payload the payload bytes
+ * @param offset the first bit of the field
+ * @param bits the width of the field, at most 32
+ * @return the raw value
+ */
+unsigned long layout_get(const unsigned char *payload, int offset, int bits) {
+    unsigned long long acc = 0;
+    int first = offset >> 3;
+    int last = (offset + bits - 1) >> 3;
+    int i;
+
+    for (i = last; i >= first; i--)
+        acc = (acc << 8) | payload[i];
+    acc >>= offset & 7;
+    return (unsigned long) (acc & ((1ULL << bits) - 1));
+}
+
+/**
+ * Converts a raw value with the curve of its field
+ * @param l the layout
+ * @param field the index of the field
+ * @param raw the raw value
+ * @return the converted value, or the raw value if the field has no curve
+ */
+double layout_value(const layout_t *l, int field, unsigned long raw) {
+    const layout_curve_t *c;
+    double x = (double) raw, v = 0;
+    int k;
+
+    if (l->field[field].curve < 0)
+        return x;
+    c = &l->curve[l->field[field].curve];
+    for (k = LAYOUT_CURVE_TERMS - 1; k >= 0; k--)
+        v = v * x + c->c[k];
+    return v;
+}
@@ -0,0 +1,66 @@
+/*
+ *  FoxTelem telemetry layouts for the CubeSatSim ground decoder
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LAYOUT_H_
+#define LAYOUT_H_
+
+#define LAYOUT_MAX_FIELDS       128
+#define LAYOUT_MAX_CURVES       32
+#define LAYOUT_NAME_LEN         48
+#define LAYOUT_CURVE_TERMS      6       // a + bx + ... + fx^5
+
+/**
+ * One field of a FoxTelem layout file.  Fields are packed one after the
+ * other, least significant bit first, from the start of the payload.
+ */
+typedef struct {
+    char name[LAYOUT_NAME_LEN];
+    int bits;           //!< width, more than 32 only for padding
+    int offset;         //!< first bit of the field in the payload
+    int curve;          //!< index in curve[] or -1 to show the raw value
+} layout_field_t;
+
+/**
+ * A FoxTelem conversion curve, a polynomial of the raw value
+ */
+typedef struct {
+    char name[LAYOUT_NAME_LEN];
+    double c[LAYOUT_CURVE_TERMS];
+} layout_curve_t;
+
+/**
+ * A payload layout as read from a FoxTelem CSV file, such as
+ * spacecraft/FoxTelem_1.09m/CubeSatSim_rttelemetry.csv, with the conversion
+ * curves it refers to
+ */
+typedef struct {
+    int count;          //!< fields in field[]
+    int bits;           //!< total bits of the fields
+    layout_field_t field[LAYOUT_MAX_FIELDS];
+    char conversion[LAYOUT_MAX_FIELDS][LAYOUT_NAME_LEN];
+    int curves;
+    layout_curve_t curve[LAYOUT_MAX_CURVES];
+} layout_t;
+
+int layout_load(layout_t *l, const char *path);
+int layout_load_curves(layout_t *l, const char *path);
+unsigned long layout_get(const unsigned char *payload, int offset, int bits);
+double layout_value(const layout_t *l, int field, unsigned long raw);
+
+#endif /* LAYOUT_H_ */
@@ -1,31 +1,13 @@
 /*
- * TelemEncoding.h
+ * TelemEncoding.c
  *
  *  Created on: Feb 3, 2014
  *      Author: fox
  */
 
-#ifndef TELEMENCODING_H_
-#define TELEMENCODING_H_
+#include "TelemEncoding.h"
 
-void update_rs(
-   unsigned char parity[32], // 32-byte encoder state; zero before each frame
-   unsigned char c          // Current data byte to update
-);
-
-#define CHARACTER_BITS 10
-#define CHARACTERS_PER_LONGWORD 3
-#define CHARACTER_MASK ((1<<CHARACTER_BITS)-1)
-#define SYNC_CHARACTER -1
-
-
-#define PARITY_BYTES_PER_CODEWORD 32U     // Number of parity symbols in frame
-#define NP 32U //For Phil's code
-#define DATA_BYTES_PER_CODE_WORD 223
-
-#endif /* TELEMENCODING_H_ */
-
-int Encode_8b10b[][256] = {
+const int Encode_8b10b[2][256] = {
 		   // RD = -1 cases
 		{
 		   /* 00 */ 0x274,
@@ -543,4 +525,3 @@ int Encode_8b10b[][256] = {
 		   /* fe */ 0x61e,
 		   /* ff */ 0x54e,
 		} };
-	
@@ -0,0 +1,29 @@
+/*
+ * TelemEncoding.h
+ *
+ *  Created on: Feb 3, 2014
+ *      Author: fox
+ */
+
+#ifndef TELEMENCODING_H_
+#define TELEMENCODING_H_
+
+#include "rs.h"
+
+#define CHARACTER_BITS 10
+#define CHARACTERS_PER_LONGWORD 3
+#define CHARACTER_MASK ((1<<CHARACTER_BITS)-1)
+#define SYNC_CHARACTER -1
+
+
+#define PARITY_BYTES_PER_CODEWORD 32U     // Number of parity symbols in frame
+#define NP 32U //For Phil's code
+#define DATA_BYTES_PER_CODE_WORD 223
+
+/*
+ * 8b10b code words indexed by [running disparity][data byte].  Bits 9..0
+ * hold the code word, bit 10 the running disparity that follows it.
+ */
+extern const int Encode_8b10b[2][256];
+
+#endif /* TELEMENCODING_H_ */
@@ -0,0 +1,267 @@
+/*
+ *  Benchmark and golden output check for the Fox FSK and BPSK encoders
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Runs the whole frame pipeline of radioafsk (pack, RS, 8b10b, synthesis)
+// on fixed telemetry, prints the time spent in each stage, and checks the
+// samples of the first GOLDEN_FRAMES frames against the hashes stored in
+// the golden file.  No Pi hardware is needed.
+//
+//   bench_fox [golden file]            benchmark and check
+//   bench_fox --update [golden file]   rewrite the golden file
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "foxtlm.h"
+#include "wave.h"
+
+#define S_RATE          48000
+#define FREQ_HZ         3000
+#define GOLDEN_FRAMES   3
+#define GOLDEN_FILE     "foxtlm/bench_fox.golden"
+
+typedef struct {
+  const char * name;
+  foxtlm_mode_t mode;
+  int bit_rate;
+  float amplitude;
+  int frames;         // frames timed
+} bench_mode_t;
+
+static const bench_mode_t modes[] = {
+  { "fsk", FOXTLM_FSK, 200, 32767 / 3, 2000 },
+  { "bpsk", FOXTLM_BPSK, 1200, 32767, 2000 },
+};
+
+typedef struct {
+  uint64_t hash;      // FNV-1a over the samples of the current frame
+  long count;
+} sink_state_t;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, & ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int hash_chunk(void * arg, const void * samples, int count) {
+  sink_state_t * s = arg;
+  const unsigned char * p = (const unsigned char * ) samples;
+
+  for (int i = 0; i < count * (int) sizeof(short int); i++)
+    s -> hash = (s -> hash ^ p[i]) * 0x100000001b3ULL;
+  s -> count += count;
+  return count * (int) sizeof(short int);
+}
+
+static int discard_chunk(void * arg, const void * samples, int count) {
+  (void) arg;
+  (void) samples;
+  return count * (int) sizeof(short int);
+}
+
+// Same readings every run; the frame number only moves the uptime
+static void fixed_tlm(foxtlm_tlm_t * tlm, int frame) {
+  memset(tlm, 0, sizeof( * tlm));
+  tlm -> frame_type = 1;
+  tlm -> reset_count = 42;
+  tlm -> uptime = 3600 + 4 * frame;
+  for (int k = 0; k < FOXTLM_POWER_CHANNELS; k++) {
+    tlm -> voltage[k] = 4.5f + 0.1f * k;
+    tlm -> current[k] = 20.0f * k - 35.5f;
+  }
+  tlm -> accel[0] = 0.02f;
+  tlm -> accel[1] = -0.98f;
+  tlm -> accel[2] = 0.11f;
+  tlm -> gyro[0] = 1.5f;
+  tlm -> gyro[1] = -3.25f;
+  tlm -> gyro[2] = 0.75f;
+  tlm -> temp = 23.4f;
+  tlm -> pressure = 1013.2f;
+  tlm -> altitude = 0.12f;
+  tlm -> humidity = 41.0f;
+  tlm -> xs2 = 17.0f;
+  tlm -> xs3 = 0.33f;
+  tlm -> spin = 0.5f;
+  tlm -> rssi = -80.0f;
+  tlm -> ihu_temp = 48.3f;
+  tlm -> stem_board_failure = 1;
+  tlm -> i2c_bus1 = 1;
+  tlm -> i2c_bus3 = 1;
+  tlm -> rx_antenna_deployed = 1;
+  tlm -> tx_antenna_deployed = 1;
+}
+
+static int setup(const bench_mode_t * m, foxtlm_t * fox, wave_t * wave) {
+  int samples = S_RATE / m -> bit_rate;
+  int smaller = (int)(S_RATE / (2 * FREQ_HZ));
+
+  if (foxtlm_init(fox, m -> mode) != 0)
+    return -1;
+  return wave_init(wave, (m -> mode == FOXTLM_BPSK), m -> amplitude, FREQ_HZ, S_RATE, samples, smaller);
+}
+
+// Hashes the first GOLDEN_FRAMES frames, each one on its own
+static int golden(const bench_mode_t * m, uint64_t hash[], long count[]) {
+  foxtlm_t fox;
+  wave_t wave;
+  wave_stream_t stream;
+  foxtlm_tlm_t tlm;
+  sink_state_t sink;
+  unsigned char bits[(FOXTLM_MAX_BITS + 7) / 8];
+
+  if (setup(m, & fox, & wave) != 0)
+    return -1;
+  wave_stream_init( & stream, & wave, hash_chunk, & sink);
+
+  for (int f = 0; f < GOLDEN_FRAMES; f++) {
+    sink.hash = 0xcbf29ce484222325ULL;
+    sink.count = 0;
+    fixed_tlm( & tlm, f);
+    int n = foxtlm_encode_bits( & fox, & tlm, bits);
+    for (int i = 0; i < n; i++)
+      wave_stream_bit( & stream, foxtlm_bit(bits, i));
+    wave_stream_flush( & stream);
+    hash[f] = sink.hash;
+    count[f] = sink.count;
+  }
+  wave_free( & wave);
+  return 0;
+}
+
+static void bench(const bench_mode_t * m) {
+  foxtlm_t fox;
+  wave_t wave;
+  wave_stream_t stream;
+  foxtlm_tlm_t tlm;
+  short int symbols[FOXTLM_MAX_SYMBOLS];
+  unsigned char bits[(FOXTLM_MAX_BITS + 7) / 8];
+  double t[5] = { 0 };
+
+  if (setup(m, & fox, & wave) != 0) {
+    printf("ERROR: %s setup failed\n", m -> name);
+    return;
+  }
+  wave_stream_init( & stream, & wave, discard_chunk, NULL);
+  fixed_tlm( & tlm, 0);
+
+  long samples = (long) foxtlm_frame_bits( & fox) * wave.samples * m -> frames;
+  for (int f = 0; f < m -> frames; f++) {
+    double t0 = now();
+    foxtlm_pack( & fox, & tlm);
+    double t1 = now();
+    foxtlm_parity( & fox);
+    double t2 = now();
+    int n = foxtlm_8b10b( & fox, symbols);
+    n = foxtlm_bits( & fox, symbols, n, bits);
+    double t3 = now();
+    stream.ctr = 0; // as radioafsk does before each frame
+    for (int i = 0; i < n; i++)
+      wave_stream_bit( & stream, foxtlm_bit(bits, i));
+    wave_stream_flush( & stream);
+    double t4 = now();
+    t[0] += t1 - t0;
+    t[1] += t2 - t1;
+    t[2] += t3 - t2;
+    t[3] += t4 - t3;
+    t[4] += t4 - t0;
+  }
+
+  const char * stage[] = { "pack", "RS", "8b10b", "synthesis", "total" };
+  printf("%s: %d frames, %ld samples per frame, %.0f frames/s\n", m -> name, m -> frames,
+    samples / m -> frames, m -> frames / t[4]);
+  for (int s = 0; s < 5; s++)
+    printf("  %-10s %10.2f us/frame %8.3f ns/sample\n", stage[s], t[s] / m -> frames * 1e6, t[s] / samples * 1e9);
+  wave_free( & wave);
+}
+
+int main(int argc, char * argv[]) {
+  const char * file = GOLDEN_FILE;
+  int update = 0, failed = 0;
+  uint64_t hash[GOLDEN_FRAMES];
+  long count[GOLDEN_FRAMES];
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--update") == 0)
+      update = 1;
+    else
+      file = argv[i];
+  }
+
+  if (update) {
+    FILE * out = fopen(file, "w");
+    if (!out) {
+      fprintf(stderr, "ERROR: cannot write %s\n", file);
+      return EXIT_FAILURE;
+    }
+    fprintf(out, "# bench_fox golden output: mode frame samples fnv1a64\n");
+    for (unsigned int m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+      if (golden( & modes[m], hash, count) != 0)
+        return EXIT_FAILURE;
+      for (int f = 0; f < GOLDEN_FRAMES; f++)
+        fprintf(out, "%s %d %ld %016llx\n", modes[m].name, f, count[f], (unsigned long long) hash[f]);
+    }
+    fclose(out);
+    printf("Wrote %s\n", file);
+    return EXIT_SUCCESS;
+  }
+
+  FILE * in = fopen(file, "r");
+  if (!in) {
+    fprintf(stderr, "ERROR: cannot read %s\n", file);
+    return EXIT_FAILURE;
+  }
+  for (unsigned int m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+    char line[200], name[16];
+    int frame, checked = 0;
+    long n;
+    unsigned long long h;
+
+    if (golden( & modes[m], hash, count) != 0) {
+      printf("ERROR: %s setup failed\n", modes[m].name);
+      failed = 1;
+      continue;
+    }
+    rewind(in);
+    while (fgets(line, sizeof(line), in)) {
+      if (sscanf(line, "%15s %d %ld %llx", name, & frame, & n, & h) != 4 ||
+        strcmp(name, modes[m].name) != 0 || frame < 0 || frame >= GOLDEN_FRAMES)
+        continue;
+      checked++;
+      if (count[frame] != n || hash[frame] != h) {
+        printf("ERROR: %s frame %d: %ld samples hash %016llx, golden %ld samples hash %016llx\n",
+          modes[m].name, frame, count[frame], (unsigned long long) hash[frame], n, h);
+        failed = 1;
+      }
+    }
+    if (checked != GOLDEN_FRAMES) {
+      printf("ERROR: %s has %d of %d golden frames in %s\n", modes[m].name, checked, GOLDEN_FRAMES, file);
+      failed = 1;
+    } else if (!failed)
+      printf("%s: %d frames match %s\n", modes[m].name, GOLDEN_FRAMES, file);
+  }
+  fclose(in);
+
+  for (unsigned int m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+    bench( & modes[m]);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
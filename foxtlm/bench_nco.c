@@ -0,0 +1,159 @@
+/*
+ *  Benchmark for the CubeSatSim subcarrier oscillator
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Compares the fixed-point oscillator, with and without interpolation,
+// with the float sin() subcarrier that write_wave() used.  For each one it
+// prints the spur-free dynamic range, the carrier against the largest other
+// line of an FFT_LEN point spectrum, and the time per sample.  The tones sit
+// exactly on an FFT bin so no window is needed.  The sin() subcarrier is
+// measured at the start of a frame and again LATE_INDEX samples in, as far
+// as a long multi-frame buffer reaches.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+#include "nco.h"
+
+#define S_RATE          48000
+#define AMPLITUDE       32767
+#define FFT_BITS        16
+#define FFT_LEN         (1 << FFT_BITS)
+#define LATE_INDEX      2000000
+#define TIMED_SAMPLES   (1 << 22)
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, & ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned long long ticks(void) {
+#if defined(__i386__) || defined(__x86_64__)
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+// write_wave() as it was, one sin() per sample
+static void libm_block(short int * out, int count, long first, double freq_Hz) {
+  for (int i = 0; i < count; i++)
+    out[i] = (short int)(AMPLITUDE * sin((float)(2 * M_PI * (first + i) * freq_Hz / S_RATE)));
+}
+
+// In place radix 2 FFT
+static void fft(double * re, double * im) {
+  for (int i = 1, j = 0; i < FFT_LEN; i++) {
+    int bit = FFT_LEN >> 1;
+    for (; j & bit; bit >>= 1)
+      j ^= bit;
+    j |= bit;
+    if (i < j) {
+      double t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+  for (int len = 2; len <= FFT_LEN; len <<= 1) {
+    double a = -2 * M_PI / len;
+    for (int i = 0; i < FFT_LEN; i += len) {
+      for (int k = 0; k < len / 2; k++) {
+        double wr = cos(a * k), wi = sin(a * k);
+        double *ur = & re[i + k], *ui = & im[i + k];
+        double vr = re[i + k + len / 2] * wr - im[i + k + len / 2] * wi;
+        double vi = re[i + k + len / 2] * wi + im[i + k + len / 2] * wr;
+        re[i + k + len / 2] = * ur - vr;
+        im[i + k + len / 2] = * ui - vi;
+        * ur += vr;
+        * ui += vi;
+      }
+    }
+  }
+}
+
+// Carrier power over the largest other line, dB
+static double sfdr(const short int * samples, int bin) {
+  static double re[FFT_LEN], im[FFT_LEN];
+  double carrier, spur = 1e-30;
+
+  for (int i = 0; i < FFT_LEN; i++) {
+    re[i] = samples[i];
+    im[i] = 0;
+  }
+  fft(re, im);
+  carrier = re[bin] * re[bin] + im[bin] * im[bin];
+  for (int k = 0; k <= FFT_LEN / 2; k++) {
+    double p = re[k] * re[k] + im[k] * im[k];
+    if (k != bin && p > spur)
+      spur = p;
+  }
+  return 10 * log10(carrier / spur);
+}
+
+static void report(const char * name, double dB, double secs, unsigned long long t) {
+  printf("  %-22s %7.1f dBc SFDR %7.2f ns/sample", name, dB, secs / TIMED_SAMPLES * 1e9);
+  if (t)
+    printf(" %6.2f cycles/sample", (double) t / TIMED_SAMPLES);
+  printf("\n");
+}
+
+static void bench(int bin) {
+  static short int spectrum[FFT_LEN];
+  double freq_Hz = (double) bin * S_RATE / FFT_LEN;
+  short int * out = malloc(TIMED_SAMPLES * sizeof(short int));
+  nco_t nco;
+
+  if (!out)
+    return;
+  printf("%.2f Hz at %d Hz, FFT bin %d of %d\n", freq_Hz, S_RATE, bin, FFT_LEN);
+
+  libm_block(spectrum, FFT_LEN, 0, freq_Hz);
+  double dB = sfdr(spectrum, bin);
+  double start = now();
+  unsigned long long t0 = ticks();
+  libm_block(out, TIMED_SAMPLES, 0, freq_Hz);
+  unsigned long long t = ticks() - t0;
+  report("float sin()", dB, now() - start, t);
+
+  libm_block(spectrum, FFT_LEN, LATE_INDEX, freq_Hz);
+  printf("  %-22s %7.1f dBc SFDR\n", "float sin(), late", sfdr(spectrum, bin));
+
+  for (int interp = 0; interp < 2; interp++) {
+    nco_init( & nco, freq_Hz, S_RATE, interp);
+    nco_block( & nco, spectrum, FFT_LEN, AMPLITUDE);
+    dB = sfdr(spectrum, bin);
+    start = now();
+    t0 = ticks();
+    nco_block( & nco, out, TIMED_SAMPLES, AMPLITUDE);
+    t = ticks() - t0;
+    report(interp ? "NCO, interpolated" : "NCO, nearest entry", dB, now() - start, t);
+  }
+  free(out);
+}
+
+int main(void) {
+  printf("NCO: %d entry quarter wave table, 32-bit phase\n", 1 << NCO_TABLE_BITS);
+  bench(FFT_LEN / 16);    // 3000 Hz, the BPSK subcarrier
+  bench(1031);            // 755 Hz, a prime bin that visits most of the table
+  return EXIT_SUCCESS;
+}
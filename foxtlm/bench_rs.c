@@ -0,0 +1,171 @@
+/*
+ *  Throughput benchmark for the Fox RS(255,223) encoders
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Encodes FSK (1 x 64 byte) and BPSK (3 x 159 byte, last one short) frames
+// with update_rs() and with every instruction set the batch encoder
+// supports here, checks the parities match, and prints bytes/s for each.
+// Then decodes the same frames with errors and erasures added, checks they
+// are corrected, and prints frames/s.
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rs.h"
+
+#define FRAMES 20000
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, & ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void encode_reference(const unsigned char * data, int len, int depth, unsigned char parity[][RS_PARITY_LEN]) {
+  for (int i = 0; i < len; i++)
+    update_rs(parity[i % depth], data[i]);
+}
+
+static int bench(const char * name, int len, int depth) {
+  static unsigned char data[64][RS_MAX_DEPTH * 223];
+  unsigned char ref[RS_MAX_DEPTH][RS_PARITY_LEN], out[RS_MAX_DEPTH][RS_PARITY_LEN];
+  int failed = 0;
+
+  for (unsigned int f = 0; f < sizeof(data) / sizeof(data[0]); f++)
+    for (int i = 0; i < len; i++)
+      data[f][i] = (unsigned char) rand();
+
+  double start = now();
+  for (int f = 0; f < FRAMES; f++) {
+    memset(ref, 0, sizeof(ref));
+    encode_reference(data[f % 64], len, depth, ref);
+  }
+  double ref_time = now() - start;
+  printf("%s %4d bytes x %d: %-8s %8.2f MB/s\n", name, len, depth, "update_rs", (double) FRAMES * len / ref_time / 1e6);
+
+  for (int isa = RS_ISA_SCALAR; isa <= RS_ISA_NEON; isa++) {
+    if (rs_set_isa((rs_isa_t) isa) != 0)
+      continue;
+
+    for (int f = 0; f < 64; f++) {
+      memset(ref, 0, sizeof(ref));
+      memset(out, 0, sizeof(out));
+      encode_reference(data[f], len, depth, ref);
+      rs_encode_interleaved(data[f], len, depth, out);
+      if (memcmp(ref, out, sizeof(ref)) != 0) {
+        printf("ERROR: %s parities differ from update_rs\n", rs_isa_name((rs_isa_t) isa));
+        failed = 1;
+        break;
+      }
+    }
+
+    start = now();
+    for (int f = 0; f < FRAMES; f++) {
+      memset(out, 0, sizeof(out));
+      rs_encode_interleaved(data[f % 64], len, depth, out);
+    }
+    double t = now() - start;
+    printf("%s %4d bytes x %d: %-8s %8.2f MB/s  (%.1fx)\n", name, len, depth, rs_isa_name((rs_isa_t) isa),
+      (double) FRAMES * len / t / 1e6, ref_time / t);
+  }
+  return failed;
+}
+
+// Adds errors and erasures to every codeword of a frame.  Each codeword
+// gets errors and erasures within what the code corrects, 2e + f <= 32.
+static void damage(unsigned char * data, int len, int depth, unsigned char parity[][RS_PARITY_LEN],
+  int errors, int erasures, int eras[][RS_PARITY_LEN]) {
+  for (int j = 0; j < depth; j++) {
+    int n = (len - j + depth - 1) / depth + RS_PARITY_LEN, used[255] = { 0 };
+
+    for (int k = 0; k < errors + erasures; k++) {
+      int p;
+      do
+        p = rand() % n;
+      while (used[p]);
+      used[p] = 1;
+      if (k >= errors)
+        eras[j][k - errors] = p;
+      if (p < n - RS_PARITY_LEN)
+        data[p * depth + j] ^= (unsigned char)(1 + rand() % 255);
+      else
+        parity[j][p - (n - RS_PARITY_LEN)] ^= (unsigned char)(1 + rand() % 255);
+    }
+  }
+}
+
+static int bench_decode(const char * name, int len, int depth, int errors, int erasures) {
+  static unsigned char clean[64][RS_MAX_DEPTH * 223], data[64][RS_MAX_DEPTH * 223];
+  static unsigned char parity[64][RS_MAX_DEPTH][RS_PARITY_LEN], sent[64][RS_MAX_DEPTH][RS_PARITY_LEN];
+  static int eras[64][RS_MAX_DEPTH][RS_PARITY_LEN];
+  int failed = 0;
+
+  for (int f = 0; f < 64; f++) {
+    for (int i = 0; i < len; i++)
+      clean[f][i] = (unsigned char) rand();
+    memset(sent[f], 0, sizeof(sent[f]));
+    rs_encode_interleaved(clean[f], len, depth, sent[f]);
+  }
+  for (int isa = RS_ISA_SCALAR; isa <= RS_ISA_NEON; isa++) {
+    double t = 0;
+
+    if (rs_set_isa((rs_isa_t) isa) != 0)
+      continue;
+    for (int f = 0; f < FRAMES / 4; f++) {
+      int k = f % 64;
+
+      memcpy(data[k], clean[k], len);
+      memcpy(parity[k], sent[k], sizeof(parity[k]));
+      damage(data[k], len, depth, parity[k], errors, erasures, eras[k]);
+      double start = now();
+      for (int j = 0; j < depth; j++) {
+        int n = (len - j + depth - 1) / depth;
+
+        if (rs_decode(&data[k][j], n, depth, parity[k][j], eras[k][j], erasures) < 0)
+          failed = 1;
+      }
+      t += now() - start;
+      if (memcmp(data[k], clean[k], len) != 0 || memcmp(parity[k], sent[k], sizeof(parity[k])) != 0)
+        failed = 1;
+    }
+    printf("%s decode %2d errors %2d erasures: %-8s %10.0f frames/s%s\n", name, errors, erasures,
+      rs_isa_name((rs_isa_t) isa), FRAMES / 4 / t, failed ? "  ERROR: not corrected" : "");
+  }
+  return failed;
+}
+
+int main(void) {
+  int failed = 0;
+
+  srand(1);
+  rs_init();
+  printf("Default instruction set: %s\n", rs_isa_name(rs_get_isa()));
+
+  failed |= bench("FSK ", 64, 1);
+  failed |= bench("BPSK", 476, 3);
+  failed |= bench_decode("FSK ", 64, 1, 0, 0);
+  failed |= bench_decode("FSK ", 64, 1, 8, 0);
+  failed |= bench_decode("FSK ", 64, 1, 16, 0);
+  failed |= bench_decode("FSK ", 64, 1, 8, 16);
+  failed |= bench_decode("BPSK", 476, 3, 8, 0);
+  failed |= bench_decode("BPSK", 476, 3, 16, 0);
+  failed |= bench_decode("BPSK", 476, 3, 4, 24);
+
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,111 @@
+/*
+ *  Bounded blocking queue for the Fox frame pipeline
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "fifo.h"
+#include "../afsk/status.h"
+
+/**
+ * Sets up an empty queue
+ * @param q the queue
+ * @param depth the number of items it holds
+ * @param size the size of each item in bytes
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int fifo_init(fifo_t *q, int depth, size_t size) {
+    if (!q || depth < 1 || size == 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(q, 0, sizeof(*q));
+    q->buf = malloc(depth * size);
+    if (!q->buf) {
+        return -PQWS_INVALID_PARAM;
+    }
+    q->depth = depth;
+    q->size = size;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return PQWS_SUCCESS;
+}
+
+void fifo_free(fifo_t *q) {
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_mutex_destroy(&q->lock);
+    free(q->buf);
+    q->buf = NULL;
+}
+
+/**
+ * Copies an item into the queue, waiting for room if it is full
+ * @param q the queue
+ * @param item the item
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the queue was closed
+ */
+int fifo_push(fifo_t *q, const void *item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == q->depth && !q->closed)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    if (q->closed) {
+        pthread_mutex_unlock(&q->lock);
+        return -PQWS_INVALID_PARAM;
+    }
+    memcpy(q->buf + ((q->head + q->count) % q->depth) * q->size, item, q->size);
+    q->count++;
+    pthread_cond_signal(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Copies the oldest item out of the queue, waiting for one if it is empty
+ * @param q the queue
+ * @param item where to copy the item
+ * @return 1 if an item was copied, 0 once the queue is closed and drained
+ */
+int fifo_pop(fifo_t *q, void *item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->count == 0 && !q->closed)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    if (q->count == 0) {
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
+    memcpy(item, q->buf + q->head * q->size, q->size);
+    q->head = (q->head + 1) % q->depth;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+/**
+ * Marks the end of the stream.  Items already queued can still be popped;
+ * further pushes fail and blocked callers are woken up.
+ * @param q the queue
+ */
+void fifo_close(fifo_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,49 @@
+/*
+ *  Bounded blocking queue for the Fox frame pipeline
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FIFO_H_
+#define FIFO_H_
+
+#include <stddef.h>
+#include <pthread.h>
+
+/**
+ * A queue of fixed size items joining two pipeline stages.  Items are
+ * copied in and out, push blocks while the queue is full and pop blocks
+ * while it is empty, so the slower stage paces the faster one.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    unsigned char *buf;
+    size_t size;        //!< bytes per item
+    int depth;          //!< items the queue holds
+    int head;           //!< index of the oldest item
+    int count;          //!< items waiting
+    int closed;         //!< no more items will be pushed
+} fifo_t;
+
+int fifo_init(fifo_t *q, int depth, size_t size);
+void fifo_free(fifo_t *q);
+int fifo_push(fifo_t *q, const void *item);
+int fifo_pop(fifo_t *q, void *item);
+void fifo_close(fifo_t *q);
+
+#endif /* FIFO_H_ */
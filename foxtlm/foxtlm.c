@@ -0,0 +1,438 @@
+/*
+ *  Fox telemetry frame encoder for CubeSatSim
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "foxtlm.h"
+#include "rs.h"
+#include "plan.h"
+#include "wodz.h"
+#include "TelemEncoding.h"
+#include "../afsk/status.h"
+
+#define FSK_BYTES       (6 + 58 * 1)
+#define BPSK_BYTES      (8 + 78 * 6)
+
+const foxtlm_desc_t foxtlm_fsk = {
+    FOXTLM_FSK, 7, 1, 64, 6, 58, 1, 10, 0b0011111010, RS_PARITY_LEN
+};
+
+const foxtlm_desc_t foxtlm_bpsk = {
+    FOXTLM_BPSK, 0, 3, 159, 8, 78, 6, 31, 0b1000111110011010010000101011101,
+    RS_PARITY_LEN
+};
+
+// The header and payload fill the RS codewords exactly, with the last BPSK
+// codeword one byte short
+_Static_assert(FSK_BYTES == 1 * 64, "FSK layout");
+_Static_assert(BPSK_BYTES == 3 * 159 - 1, "BPSK layout");
+_Static_assert(BPSK_BYTES == FOXTLM_MAX_BYTES, "FOXTLM_MAX_BYTES");
+_Static_assert(BPSK_BYTES == FOXTLM_MAX_HEADER + FOXTLM_MAX_PAYLOADS * FOXTLM_MAX_DATA,
+        "FOXTLM_MAX_PAYLOADS");
+
+/**
+ * Sets up an encoder for one frame format
+ * @param f the encoder
+ * @param mode FOXTLM_FSK or FOXTLM_BPSK
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int foxtlm_init(foxtlm_t *f, foxtlm_mode_t mode) {
+    if (!f) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(f, 0, sizeof(*f));
+
+    switch (mode) {
+    case FOXTLM_FSK:
+        f->desc = &foxtlm_fsk;
+        break;
+    case FOXTLM_BPSK:
+        f->desc = &foxtlm_bpsk;
+        break;
+    default:
+        return -PQWS_INVALID_PARAM;
+    }
+    f->plan = plan_builtin((mode == FOXTLM_BPSK) ? PLAN_BPSK : PLAN_FSK);
+    if (mode == FOXTLM_BPSK)
+        f->wod_plan = plan_builtin(PLAN_WOD);
+    rs_init();
+    return PQWS_SUCCESS;
+}
+
+static inline int frame_symbols(const foxtlm_desc_t *d) {
+    return d->header_len + d->data_len * d->payloads + d->rs_frames * d->parity_len;
+}
+
+/**
+ * @param f the encoder
+ * @return the number of 10-bit symbols in a frame, not counting the sync word
+ */
+int foxtlm_symbols(const foxtlm_t *f) {
+    return frame_symbols(f->desc);
+}
+
+/**
+ * @param f the encoder
+ * @return the number of bits in a frame including the sync word
+ */
+int foxtlm_frame_bits(const foxtlm_t *f) {
+    return f->desc->sync_bits + 10 * frame_symbols(f->desc);
+}
+
+/**
+ * Packs a 12-bit value into the low byte and low nibble of the next byte
+ * @param b the payload
+ * @param index the first byte
+ * @param val the value
+ * @return 0
+ */
+int foxtlm_encodeA(short int *b, int index, int val) {
+    b[index] = val & 0xff;
+    b[index + 1] = (short int) ((b[index + 1] & 0xf0) | ((val >> 8) & 0x0f));
+    return 0;
+}
+
+/**
+ * Packs a 12-bit value into the high nibble of a byte and the next byte
+ * @param b the payload
+ * @param index the first byte
+ * @param val the value
+ * @return 0
+ */
+int foxtlm_encodeB(short int *b, int index, int val) {
+    b[index] = (short int) ((b[index] & 0x0f) | ((val << 4) & 0xf0));
+    b[index + 1] = (val >> 4) & 0xff;
+    return 0;
+}
+
+// Every value a layout can name, in the raw units FoxTelem expects; a plan
+// takes them in the order and widths of its layout
+static inline __attribute__((always_inline)) void tlm_values(
+        const foxtlm_tlm_t *tlm, unsigned int *v) {
+    const float *voltage = tlm->voltage, *current = tlm->current;
+
+    v[PLAN_ZERO] = 0;
+    v[PLAN_BATT_V] = (int) (voltage[FOXTLM_BAT] * 100);
+    v[PLAN_ACCEL_X] = (int) (tlm->accel[0] * 100 + 0.5) + 2048;
+    v[PLAN_ACCEL_Y] = (int) (tlm->accel[1] * 100 + 0.5) + 2048;
+    v[PLAN_ACCEL_Z] = (int) (tlm->accel[2] * 100 + 0.5) + 2048;
+    v[PLAN_BATT_I] = (int) (current[FOXTLM_BAT] + 0.5) + 2048;
+    v[PLAN_TEMP] = (int) (tlm->temp * 10 + 0.5);
+
+    v[PLAN_PLUS_X_V] = (int) (voltage[FOXTLM_PLUS_X] * 100);
+    v[PLAN_PLUS_Y_V] = (int) (voltage[FOXTLM_PLUS_Y] * 100);
+    v[PLAN_PLUS_Z_V] = (int) (voltage[FOXTLM_PLUS_Z] * 100);
+    v[PLAN_MINUS_X_V] = (int) (voltage[FOXTLM_MINUS_X] * 100);
+    v[PLAN_MINUS_Y_V] = (int) (voltage[FOXTLM_MINUS_Y] * 100);
+    v[PLAN_MINUS_Z_V] = (int) (voltage[FOXTLM_MINUS_Z] * 100);
+
+    v[PLAN_PLUS_X_I] = (int) (current[FOXTLM_PLUS_X] + 0.5) + 2048;
+    v[PLAN_PLUS_Y_I] = (int) (current[FOXTLM_PLUS_Y] + 0.5) + 2048;
+    v[PLAN_PLUS_Z_I] = (int) (current[FOXTLM_PLUS_Z] + 0.5) + 2048;
+    v[PLAN_MINUS_X_I] = (int) (current[FOXTLM_MINUS_X] + 0.5) + 2048;
+    v[PLAN_MINUS_Y_I] = (int) (current[FOXTLM_MINUS_Y] + 0.5) + 2048;
+    v[PLAN_MINUS_Z_I] = (int) (current[FOXTLM_MINUS_Z] + 0.5) + 2048;
+
+    v[PLAN_PSU_V] = (int) (voltage[FOXTLM_BUS] * 100);
+    v[PLAN_SPIN] = ((int) (tlm->spin * 10)) + 2048;
+    v[PLAN_PRESSURE] = (int) (tlm->pressure + 0.5);
+    v[PLAN_ALTITUDE] = (int) (tlm->altitude * 10.0 + 0.5);
+    v[PLAN_RSSI] = (int) (tlm->rssi + 0.5) + 2048;
+    v[PLAN_IHU_TEMP] = (int) (tlm->ihu_temp * 10 + 0.5);
+    v[PLAN_GYRO_X] = (int) (tlm->gyro[0] + 0.5) + 2048;
+    v[PLAN_GYRO_Y] = (int) (tlm->gyro[1] + 0.5) + 2048;
+    v[PLAN_GYRO_Z] = (int) (tlm->gyro[2] + 0.5) + 2048;
+    v[PLAN_HUMIDITY] = (int) (tlm->humidity + 0.5);
+    v[PLAN_PSU_I] = (int) (current[FOXTLM_BUS] + 0.5) + 2048;
+    v[PLAN_XS2] = (int) (tlm->xs2) + 2048;
+    v[PLAN_XS3] = (int) (tlm->xs3 * 100 + 0.5) + 2048;
+
+    // payload failures and the ground command count are not simulated
+    v[PLAN_STEM_FAILURE] = (tlm->stem_board_failure != 0);
+    v[PLAN_SAFE_MODE] = (tlm->normal_mode_failure != 0);
+    v[PLAN_I2C_BUS0_FAILURE] = (tlm->i2c_bus0 == 0);
+    v[PLAN_I2C_BUS1_FAILURE] = (tlm->i2c_bus1 == 0);
+    v[PLAN_I2C_BUS3_FAILURE] = (tlm->i2c_bus3 == 0);
+    v[PLAN_CAMERA_FAILURE] = (tlm->camera == 0);
+    v[PLAN_RX_ANTENNA] = tlm->rx_antenna_deployed;
+    v[PLAN_TX_ANTENNA] = tlm->tx_antenna_deployed;
+    v[PLAN_WOD_RESET] = tlm->reset_count;
+    v[PLAN_WOD_UPTIME] = tlm->uptime;
+}
+
+/**
+ * Converts telemetry to the raw values of the payload fields
+ * @param tlm the telemetry
+ * @param values where to write the value of every plan_source_t
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int foxtlm_values(const foxtlm_tlm_t *tlm, unsigned int *values) {
+    if (!tlm || !values) {
+        return -PQWS_INVALID_PARAM;
+    }
+    tlm_values(tlm, values);
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Finds how many WOD samples a compressed WOD frame can carry
+ * @param f the encoder
+ * @param tlm the samples, tlm->wod_count of them
+ * @return the number of samples, oldest first, that fit in a
+ * FOXTLM_WODZ_FRAME, or -PQWS_INVALID_PARAM if the frame format has none
+ */
+int foxtlm_wod_fit(const foxtlm_t *f, const foxtlm_tlm_t *tlm) {
+    unsigned char block[FOXTLM_MAX_PAYLOADS * FOXTLM_MAX_DATA];
+
+    if (!f || !tlm || !f->wod_plan || tlm->wod_count < 0 || tlm->wod_count > FOXTLM_MAX_WOD) {
+        return -PQWS_INVALID_PARAM;
+    }
+    return wodz_encode(f->wod_plan, tlm->wod[0].value, tlm->wod_count, block,
+            f->desc->payloads * f->desc->data_len);
+}
+
+// The functions below take the layout as a parameter and are always inlined
+// into the per layout instances at the end of the file, where it is constant.
+
+static inline __attribute__((always_inline)) int pack_frame(foxtlm_t *f,
+        const foxtlm_desc_t *d, const foxtlm_tlm_t *tlm) {
+    short int h[FOXTLM_MAX_HEADER];
+    unsigned int v[PLAN_SOURCES];
+    unsigned char *b = &f->data8[d->header_len];
+    int i, p, n;
+
+    memset(h, 0, sizeof(h));
+
+    h[0] = (short int) ((h[0] & 0xf8) | (d->id & 0x07)); // 3 bits
+    h[0] = (short int) ((h[0] & 0x07) | ((tlm->reset_count & 0x1f) << 3));
+    h[1] = (short int) ((tlm->reset_count >> 5) & 0xff);
+    h[2] = (short int) ((h[2] & 0xf8) | ((tlm->reset_count >> 13) & 0x07));
+    h[2] = (short int) ((h[2] & 0x0e) | ((tlm->uptime & 0x1f) << 3));
+    h[3] = (short int) ((tlm->uptime >> 5) & 0xff);
+    h[4] = (short int) ((tlm->uptime >> 13) & 0xff);
+    h[5] = (short int) ((h[5] & 0xf0) | ((tlm->uptime >> 21) & 0x0f));
+    h[5] = (short int) ((h[5] & 0x0f) | (tlm->frame_type << 4));
+
+    if (d->mode == FOXTLM_BPSK)
+        h[6] = 99;
+
+    // the header followed by the payloads; the RS codewords take the bytes
+    // in turn, which is what leaves the last BPSK codeword a byte short
+    for (i = 0; i < d->header_len; i++)
+        f->data8[i] = (unsigned char) h[i];
+
+    n = (tlm->frame_type == FOXTLM_WOD_FRAME || tlm->frame_type == FOXTLM_WODZ_FRAME)
+            ? tlm->wod_count : 0;
+    if (n > 0 && tlm->frame_type == FOXTLM_WODZ_FRAME) {
+        // the samples compressed over all the payloads, foxtlm_wod_fit()
+        // tells how many fit
+        if (d->mode != FOXTLM_BPSK || !f->wod_plan || n > FOXTLM_MAX_WOD
+                || wodz_encode(f->wod_plan, tlm->wod[0].value, n, b, d->payloads * d->data_len) != n) {
+            return -PQWS_INVALID_PARAM;
+        }
+    } else if (n > 0) {
+        // a WOD sample per payload, oldest first, the last one repeated in
+        // the payloads left over
+        if (d->mode != FOXTLM_BPSK || !f->wod_plan || n > FOXTLM_MAX_PAYLOADS) {
+            return -PQWS_INVALID_PARAM;
+        }
+        for (p = 0; p < d->payloads; p++)
+            plan_pack(f->wod_plan, tlm->wod[(p < n) ? p : n - 1].value,
+                    &b[p * d->data_len], d->data_len);
+    } else {
+        // the real time payload repeated payloads times
+        tlm_values(tlm, v);
+        plan_pack(f->plan, v, b, d->data_len);
+
+        if (d->mode == FOXTLM_BPSK) { // WOD field experiments
+            b[63] = 0xff;
+            b[64] &= 0xf0;
+            b[74] |= 0xf0;
+            b[75] = 0x0f;
+        }
+        for (p = 1; p < d->payloads; p++)
+            memcpy(&b[p * d->data_len], b, d->data_len);
+    }
+    f->len = d->header_len + d->payloads * d->data_len;
+    return f->len;
+}
+
+/**
+ * Computes the RS parities of the bytes in data8[]
+ * @param f the encoder
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int foxtlm_parity(foxtlm_t *f) {
+    memset(f->parities, 0, sizeof(f->parities));
+    return rs_encode_interleaved(f->data8, f->len, f->desc->rs_frames,
+            f->parities);
+}
+
+static inline __attribute__((always_inline)) int encode_8b10b(foxtlm_t *f,
+        const foxtlm_desc_t *d, short int *symbols) {
+    int i, j, word, n = 0;
+    int rd = f->rd;
+
+    for (i = 0; i < d->header_len + d->payloads * d->data_len; i++) {
+        word = Encode_8b10b[rd][f->data8[i]];
+        symbols[n++] = (short int) (word & 0x3ff);
+        rd = (word >> 10) & 1;
+    }
+    for (i = 0; i < d->parity_len; i++) {
+        for (j = 0; j < d->rs_frames; j++) {
+            word = Encode_8b10b[rd][f->parities[j][i]];
+            symbols[n++] = (short int) (word & 0x3ff);
+            rd = (word >> 10) & 1;
+        }
+    }
+    f->rd = rd;
+    return n;
+}
+
+static inline __attribute__((always_inline)) int pack_bits(
+        const foxtlm_desc_t *d, const short int *symbols, int n,
+        unsigned char *bits) {
+    unsigned long long acc = (unsigned long long) d->sync_word;
+    int k, out = 0, pending = d->sync_bits;   // bits waiting in acc
+
+    for (k = 0; k < n; k++) {
+        while (pending >= 8) {
+            pending -= 8;
+            bits[out++] = (unsigned char) (acc >> pending);
+        }
+        acc = (acc << 10) | (symbols[k] & 0x3ff);
+        pending += 10;
+    }
+    while (pending >= 8) {
+        pending -= 8;
+        bits[out++] = (unsigned char) (acc >> pending);
+    }
+    if (pending)
+        bits[out] = (unsigned char) (acc << (8 - pending));
+    return d->sync_bits + 10 * n;
+}
+
+// One instance of each stage per layout
+#define FOXTLM_INSTANCE(name, desc) \
+    static int pack_##name(foxtlm_t *f, const foxtlm_tlm_t *tlm) { \
+        return pack_frame(f, &desc, tlm); \
+    } \
+    static int encode_8b10b_##name(foxtlm_t *f, short int *symbols) { \
+        return encode_8b10b(f, &desc, symbols); \
+    } \
+    static int pack_bits_##name(const short int *symbols, int n, \
+            unsigned char *bits) { \
+        return pack_bits(&desc, symbols, n, bits); \
+    }
+
+FOXTLM_INSTANCE(fsk, foxtlm_fsk)
+FOXTLM_INSTANCE(bpsk, foxtlm_bpsk)
+
+/**
+ * Builds the header and payload of a frame in data8[], in transmit order.
+ * Byte n of data8[] belongs to RS codeword n % rs_frames.
+ * @param f the encoder
+ * @param tlm the telemetry to send
+ * @return the number of bytes packed or -PQWS_INVALID_PARAM
+ */
+int foxtlm_pack(foxtlm_t *f, const foxtlm_tlm_t *tlm) {
+    if (!f || !f->desc || !tlm) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (f->desc->mode == FOXTLM_BPSK)
+        return pack_bpsk(f, tlm);
+    return pack_fsk(f, tlm);
+}
+
+/**
+ * 8b10b encodes data8[] followed by the parities, advancing the running
+ * disparity
+ * @param f the encoder
+ * @param symbols where to write the 10-bit symbols, at least
+ * foxtlm_symbols() of them
+ * @return the number of symbols written
+ */
+int foxtlm_8b10b(foxtlm_t *f, short int *symbols) {
+    if (f->desc->mode == FOXTLM_BPSK)
+        return encode_8b10b_bpsk(f, symbols);
+    return encode_8b10b_fsk(f, symbols);
+}
+
+/**
+ * Packs the sync word and the symbols of a frame into a bitstream in
+ * transmit order, most significant bit of each byte first
+ * @param f the encoder
+ * @param symbols the 10-bit symbols
+ * @param n the number of symbols
+ * @param bits where to write the bitstream, at least
+ * (sync_bits + 10 * n + 7) / 8 bytes
+ * @return the number of bits written
+ */
+int foxtlm_bits(const foxtlm_t *f, const short int *symbols, int n,
+        unsigned char *bits) {
+    if (f->desc->mode == FOXTLM_BPSK)
+        return pack_bits_bpsk(symbols, n, bits);
+    return pack_bits_fsk(symbols, n, bits);
+}
+
+/**
+ * Encodes one frame of telemetry into 10-bit symbols
+ * @param f the encoder
+ * @param tlm the telemetry to send
+ * @param symbols where to write the symbols, at least foxtlm_symbols() of them
+ * @return the number of symbols or the negative of an error code
+ */
+int foxtlm_encode(foxtlm_t *f, const foxtlm_tlm_t *tlm, short int *symbols) {
+    int ret;
+
+    if (!symbols) {
+        return -PQWS_INVALID_PARAM;
+    }
+    ret = foxtlm_pack(f, tlm);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = foxtlm_parity(f);
+    if (ret != PQWS_SUCCESS) {
+        return ret;
+    }
+    return foxtlm_8b10b(f, symbols);
+}
+
+/**
+ * Encodes one frame of telemetry into a bitstream, sync word included
+ * @param f the encoder
+ * @param tlm the telemetry to send
+ * @param bits where to write the bitstream, at least
+ * (FOXTLM_MAX_BITS + 7) / 8 bytes
+ * @return the number of bits or the negative of an error code
+ */
+int foxtlm_encode_bits(foxtlm_t *f, const foxtlm_tlm_t *tlm,
+        unsigned char *bits) {
+    short int symbols[FOXTLM_MAX_SYMBOLS];
+    int n;
+
+    if (!bits) {
+        return -PQWS_INVALID_PARAM;
+    }
+    n = foxtlm_encode(f, tlm, symbols);
+    if (n < 0) {
+        return n;
+    }
+    return foxtlm_bits(f, symbols, n, bits);
+}
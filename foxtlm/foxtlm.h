@@ -0,0 +1,162 @@
+/*
+ *  Fox telemetry frame encoder for CubeSatSim
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef FOXTLM_H_
+#define FOXTLM_H_
+
+#include "rs.h"
+#include "plan.h"
+
+#define FOXTLM_MAX_HEADER       8       // header bytes, BPSK
+#define FOXTLM_MAX_DATA         78      // payload bytes, BPSK
+#define FOXTLM_MAX_PAYLOADS     6       // payloads per frame, BPSK
+#define FOXTLM_MAX_WOD          64      // WOD samples in a compressed frame
+#define FOXTLM_MAX_BYTES        476     // header and payload bytes, BPSK
+#define FOXTLM_MAX_SYMBOLS      (FOXTLM_MAX_BYTES + 3 * RS_PARITY_LEN)
+#define FOXTLM_MAX_BITS         (31 + 10 * FOXTLM_MAX_SYMBOLS)
+
+/**
+ * Fox frame formats
+ */
+typedef enum {
+    FOXTLM_FSK,     //!< DUV, 200 bps, one RS codeword
+    FOXTLM_BPSK     //!< 1200 bps, three interleaved RS codewords
+} foxtlm_mode_t;
+
+/**
+ * Power channels of the telemetry, in the order of the INA219 sensors
+ */
+typedef enum {
+    FOXTLM_PLUS_X,
+    FOXTLM_PLUS_Y,
+    FOXTLM_BAT,
+    FOXTLM_BUS,
+    FOXTLM_MINUS_X,
+    FOXTLM_MINUS_Y,
+    FOXTLM_PLUS_Z,
+    FOXTLM_MINUS_Z,
+    FOXTLM_POWER_CHANNELS
+} foxtlm_power_t;
+
+#define FOXTLM_WOD_FRAME        0       // frame_type of a BPSK frame of WOD samples
+#define FOXTLM_WODZ_FRAME       5       // frame_type of a BPSK frame of compressed WOD samples
+
+/**
+ * One whole orbit data sample: the value of every plan_source_t, in the
+ * raw units of the payload, as foxtlm_values() gives them
+ */
+typedef struct {
+    unsigned int value[PLAN_SOURCES];
+} foxtlm_wod_t;
+
+/**
+ * One set of telemetry readings, as read from the sensors
+ */
+typedef struct {
+    int frame_type;             //!< 1 real time, 2 max, 3 min, FOXTLM_WOD_FRAME or FOXTLM_WODZ_FRAME
+    int reset_count;
+    long uptime;                            //!< seconds since the last reset
+    float voltage[FOXTLM_POWER_CHANNELS];
+    float current[FOXTLM_POWER_CHANNELS];
+    float accel[3];                         //!< X, Y and Z
+    float gyro[3];                          //!< X, Y and Z
+    float temp;
+    float pressure;
+    float altitude;
+    float humidity;
+    float xs2;
+    float xs3;
+    float spin;
+    float rssi;
+    float ihu_temp;
+    int stem_board_failure;     //!< non-zero if the STEM payload is missing
+    int normal_mode_failure;    //!< non-zero in safe mode
+    int i2c_bus0;               //!< non-zero if the bus works
+    int i2c_bus1;
+    int i2c_bus3;
+    int camera;
+    int rx_antenna_deployed;
+    int tx_antenna_deployed;
+    int wod_count;              //!< samples in wod[], a WOD frame without any carries the real time payload
+    foxtlm_wod_t wod[FOXTLM_MAX_WOD];       //!< oldest first
+} foxtlm_tlm_t;
+
+/**
+ * Layout of a frame format.  foxtlm_fsk and foxtlm_bpsk are the only
+ * instances: the encoder is compiled once for each of them, so every loop
+ * bound and array size it uses is a constant in the generated code.
+ */
+typedef struct {
+    foxtlm_mode_t mode;
+    int id;             //!< spacecraft id sent in the header
+    int rs_frames;      //!< interleaved RS codewords
+    int rs_frame_len;   //!< data bytes per RS codeword, one less in the last BPSK one
+    int header_len;
+    int data_len;       //!< payload bytes
+    int payloads;       //!< copies of the payload per frame
+    int sync_bits;
+    long sync_word;
+    int parity_len;
+} foxtlm_desc_t;
+
+extern const foxtlm_desc_t foxtlm_fsk;
+extern const foxtlm_desc_t foxtlm_bpsk;
+
+/**
+ * Encoder state.  Every field a frame depends on lives here, so any number
+ * of encoders can run side by side; the 8b10b running disparity is carried
+ * from one frame to the next as on the air.
+ */
+typedef struct {
+    const foxtlm_desc_t *desc;
+    const plan_t *plan; //!< payload layout, the built-in one or from plan_load()
+    const plan_t *wod_plan;     //!< layout of WOD payloads, NULL for FSK
+    int rd;             //!< 8b10b running disparity
+    int len;            //!< bytes in data8[]
+    unsigned char data8[FOXTLM_MAX_BYTES];
+    unsigned char parities[RS_MAX_DEPTH][RS_PARITY_LEN];
+} foxtlm_t;
+
+int foxtlm_init(foxtlm_t *f, foxtlm_mode_t mode);
+int foxtlm_symbols(const foxtlm_t *f);
+int foxtlm_frame_bits(const foxtlm_t *f);
+
+int foxtlm_encodeA(short int *b, int index, int val);
+int foxtlm_encodeB(short int *b, int index, int val);
+
+int foxtlm_values(const foxtlm_tlm_t *tlm, unsigned int *values);
+int foxtlm_wod_fit(const foxtlm_t *f, const foxtlm_tlm_t *tlm);
+int foxtlm_pack(foxtlm_t *f, const foxtlm_tlm_t *tlm);
+int foxtlm_parity(foxtlm_t *f);
+int foxtlm_8b10b(foxtlm_t *f, short int *symbols);
+int foxtlm_encode(foxtlm_t *f, const foxtlm_tlm_t *tlm, short int *symbols);
+
+int foxtlm_bits(const foxtlm_t *f, const short int *symbols, int n,
+        unsigned char *bits);
+int foxtlm_encode_bits(foxtlm_t *f, const foxtlm_tlm_t *tlm,
+        unsigned char *bits);
+
+/**
+ * Returns bit i (0 or 1) of a packed bitstream, most significant bit first
+ */
+static inline int foxtlm_bit(const unsigned char *bits, int i) {
+    return (bits[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+#endif /* FOXTLM_H_ */
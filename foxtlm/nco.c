@@ -0,0 +1,133 @@
+/*
+ *  Numerically controlled oscillator for the CubeSatSim subcarriers
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <pthread.h>
+#include "nco.h"
+#include "../afsk/status.h"
+
+#define TABLE_LEN       (1 << NCO_TABLE_BITS)
+#define QUARTER         0x40000000u
+#define HALF            0x80000000u
+#define AMP_SHIFT       16      // fractional bits of the amplitude
+
+// sin() over the first quarter turn in Q30, and one entry past it so the
+// interpolation never reads outside the table
+static int table[TABLE_LEN + 2];
+static pthread_once_t table_once = PTHREAD_ONCE_INIT;
+
+static void table_build(void) {
+    int i;
+
+    for (i = 0; i < TABLE_LEN + 2; i++)
+        table[i] = (int) lround(sin(M_PI / 2 * i / TABLE_LEN) * (1 << 30));
+}
+
+// sin() of a phase in Q30.  The second and fourth quarters read the table
+// backwards, the second half turn is the first one negated.
+static inline int lookup(unsigned int phase, int interp) {
+    unsigned int x = phase & (QUARTER - 1), i, frac;
+    int v;
+
+    if (phase & QUARTER)
+        x = QUARTER - x;
+    if (interp) {
+        i = x >> NCO_FRAC_BITS;
+        frac = x & ((1u << NCO_FRAC_BITS) - 1);
+        v = table[i] + (int) (((long long) (table[i + 1] - table[i]) * frac) >> NCO_FRAC_BITS);
+    } else {
+        v = table[(x + (1u << (NCO_FRAC_BITS - 1))) >> NCO_FRAC_BITS];
+    }
+    return (phase & HALF) ? -v : v;
+}
+
+// Scales a Q30 value by an amplitude with AMP_SHIFT fractional bits,
+// rounding to the nearest sample
+static inline short int scale(int v, long long amp) {
+    return (short int) (((long long) v * amp + (1LL << (29 + AMP_SHIFT))) >> (30 + AMP_SHIFT));
+}
+
+static long long amp_fixed(float amplitude) {
+    return llround((double) amplitude * (1 << AMP_SHIFT));
+}
+
+/**
+ * Sets up an oscillator at phase zero
+ * @param n the oscillator
+ * @param freq_Hz the output frequency
+ * @param s_rate the sample rate
+ * @param interp non-zero to interpolate between table entries
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int nco_init(nco_t *n, double freq_Hz, int s_rate, int interp) {
+    if (!n || s_rate <= 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    pthread_once(&table_once, table_build);
+    n->phase = 0;
+    n->interp = interp;
+    nco_set_freq(n, freq_Hz, s_rate);
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Changes the frequency from the next sample on.  The phase carries on, so
+ * switching tones, as AFSK does, leaves no discontinuity.
+ * @param n the oscillator
+ * @param freq_Hz the output frequency
+ * @param s_rate the sample rate
+ */
+void nco_set_freq(nco_t *n, double freq_Hz, int s_rate) {
+    double turns = freq_Hz / s_rate;
+
+    turns -= floor(turns);
+    n->step = (unsigned int) llround(turns * 4294967296.0);
+}
+
+/**
+ * @param n the oscillator
+ * @param phase a phase, 2^32 per turn
+ * @param amplitude the full scale amplitude
+ * @return amplitude * sin(phase), rounded
+ */
+short int nco_at(const nco_t *n, unsigned int phase, float amplitude) {
+    return scale(lookup(phase, n->interp), amp_fixed(amplitude));
+}
+
+/**
+ * Generates the next samples
+ * @param n the oscillator
+ * @param out where to write the samples
+ * @param count the number of samples
+ * @param amplitude the full scale amplitude, at most 32767
+ */
+void nco_block(nco_t *n, short int *out, int count, float amplitude) {
+    unsigned int phase = n->phase, step = n->step;
+    long long amp = amp_fixed(amplitude);
+    int i;
+
+    if (n->interp) {
+        for (i = 0; i < count; i++, phase += step)
+            out[i] = scale(lookup(phase, 1), amp);
+    } else {
+        for (i = 0; i < count; i++, phase += step)
+            out[i] = scale(lookup(phase, 0), amp);
+    }
+    n->phase = phase;
+}
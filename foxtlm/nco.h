@@ -0,0 +1,44 @@
+/*
+ *  Numerically controlled oscillator for the CubeSatSim subcarriers
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NCO_H_
+#define NCO_H_
+
+#define NCO_TABLE_BITS  10      // quarter wave table entries, log2
+#define NCO_FRAC_BITS   (30 - NCO_TABLE_BITS)       // phase bits between entries
+
+/**
+ * Oscillator state.  The phase is a 32-bit accumulator, a full turn per
+ * 2^32, so the phase of sample i is exactly i * step and never drifts
+ * however long the output.  Sine values come from a quarter wave table,
+ * rounded to the nearest entry or interpolated between the two around
+ * the phase.
+ */
+typedef struct {
+    unsigned int phase;         //!< phase of the next sample
+    unsigned int step;          //!< phase advance per sample
+    int interp;                 //!< non-zero to interpolate the table
+} nco_t;
+
+int nco_init(nco_t *n, double freq_Hz, int s_rate, int interp);
+void nco_set_freq(nco_t *n, double freq_Hz, int s_rate);
+short int nco_at(const nco_t *n, unsigned int phase, float amplitude);
+void nco_block(nco_t *n, short int *out, int count, float amplitude);
+
+#endif /* NCO_H_ */
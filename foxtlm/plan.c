@@ -0,0 +1,546 @@
+/*
+ *  Telemetry packing plans compiled from FoxTelem layout files
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "plan.h"
+#include "../afsk/status.h"
+
+#define LINE_LEN        512
+#define MAX_COLUMNS     16
+#define CACHE_MAGIC     0x4c505846u     // "FXPL"
+
+typedef struct {
+    const char *name;
+    int bits;
+} field_t;
+
+// The FIELD names of the FoxTelem files and the values they carry.  Names
+// match without regard to case, as the FSK and BPSK files differ there.
+static const struct {
+    const char *name;
+    plan_source_t source;
+} sources[] = {
+    { "BATT_V", PLAN_BATT_V },
+    { "SatelliteXAxisAcceleration", PLAN_ACCEL_X },
+    { "SatelliteYAxisAcceleration", PLAN_ACCEL_Y },
+    { "SatelliteZAxisAcceleration", PLAN_ACCEL_Z },
+    { "TOTAL_BATT_I", PLAN_BATT_I },
+    { "battCurr", PLAN_BATT_I },
+    { "Temperature", PLAN_TEMP },
+    { "PANEL_PLUS_X_V", PLAN_PLUS_X_V },
+    { "PANEL_MINUS_X_V", PLAN_MINUS_X_V },
+    { "PANEL_PLUS_Y_V", PLAN_PLUS_Y_V },
+    { "PANEL_MINUS_Y_V", PLAN_MINUS_Y_V },
+    { "PANEL_PLUS_Z_V", PLAN_PLUS_Z_V },
+    { "PANEL_MINUS_Z_V", PLAN_MINUS_Z_V },
+    { "PANEL_PLUS_X_I", PLAN_PLUS_X_I },
+    { "PANEL_MINUS_X_I", PLAN_MINUS_X_I },
+    { "PANEL_PLUS_Y_I", PLAN_PLUS_Y_I },
+    { "PANEL_MINUS_Y_I", PLAN_MINUS_Y_I },
+    { "PANEL_PLUS_Z_I", PLAN_PLUS_Z_I },
+    { "PANEL_MINUS_Z_I", PLAN_MINUS_Z_I },
+    { "posXv", PLAN_PLUS_X_V },
+    { "negXv", PLAN_MINUS_X_V },
+    { "posYv", PLAN_PLUS_Y_V },
+    { "negYv", PLAN_MINUS_Y_V },
+    { "posZv", PLAN_PLUS_Z_V },
+    { "negZv", PLAN_MINUS_Z_V },
+    { "posXi", PLAN_PLUS_X_I },
+    { "negXi", PLAN_MINUS_X_I },
+    { "posYi", PLAN_PLUS_Y_I },
+    { "negYi", PLAN_MINUS_Y_I },
+    { "posZi", PLAN_PLUS_Z_I },
+    { "negZi", PLAN_MINUS_Z_I },
+    { "PSUVoltage", PLAN_PSU_V },
+    { "SPIN", PLAN_SPIN },
+    { "Pressure", PLAN_PRESSURE },
+    { "Altitude", PLAN_ALTITUDE },
+    { "RSSI", PLAN_RSSI },
+    { "IHUTemperature", PLAN_IHU_TEMP },
+    { "IHUcpuTemp", PLAN_IHU_TEMP },
+    { "SatelliteXAxisAngularVelocity", PLAN_GYRO_X },
+    { "SatelliteYAxisAngularVelocity", PLAN_GYRO_Y },
+    { "SatelliteZAxisAngularVelocity", PLAN_GYRO_Z },
+    { "Sensor1", PLAN_HUMIDITY },
+    { "PSUCurrent", PLAN_PSU_I },
+    { "Sensor2", PLAN_XS2 },
+    { "Sensor3", PLAN_XS3 },
+    { "STEMPayloadStatus", PLAN_STEM_FAILURE },
+    { "Nominal Mode", PLAN_SAFE_MODE },
+    { "I2CBus0Failure", PLAN_I2C_BUS0_FAILURE },
+    { "I2CBus1Failure", PLAN_I2C_BUS1_FAILURE },
+    { "I2CBus3Failure", PLAN_I2C_BUS3_FAILURE },
+    { "CameraFailure", PLAN_CAMERA_FAILURE },
+    { "RXAntenna", PLAN_RX_ANTENNA },
+    { "TXAntenna", PLAN_TX_ANTENNA },
+    { "RxAntDeploy", PLAN_RX_ANTENNA },
+    { "TxAntDeploy", PLAN_TX_ANTENNA },
+    { "WODTimeStampReset", PLAN_WOD_RESET },
+    { "WODTimeStampUpTime", PLAN_WOD_UPTIME }
+};
+
+// Copies of CubeSatSim_rttelemetry.csv, CubeSatSim_PSK_rttelemetry.csv and
+// CubeSatSim_PSK_wodtelemetry.csv, for when the files cannot be read
+static const field_t fsk_fields[] = {
+    { "BATT_A_V", 12 },
+    { "BATT_B_V", 12 },
+    { "BATT_V", 12 },
+    { "SatelliteXAxisAcceleration", 12 },
+    { "SatelliteYAxisAcceleration", 12 },
+    { "SatelliteZAxisAcceleration", 12 },
+    { "TOTAL_BATT_I", 12 },
+    { "Temperature", 12 },
+    { "PANEL_PLUS_X_V", 12 },
+    { "PANEL_MINUS_X_V", 12 },
+    { "PANEL_PLUS_Y_V", 12 },
+    { "PANEL_MINUS_Y_V", 12 },
+    { "PANEL_PLUS_Z_V", 12 },
+    { "PANEL_MINUS_Z_V", 12 },
+    { "PANEL_PLUS_X_I", 12 },
+    { "PANEL_MINUS_X_I", 12 },
+    { "PANEL_PLUS_Y_I", 12 },
+    { "PANEL_MINUS_Y_I", 12 },
+    { "PANEL_PLUS_Z_I", 12 },
+    { "PANEL_MINUS_Z_I", 12 },
+    { "PSUVoltage", 12 },
+    { "SPIN", 12 },
+    { "Pressure", 12 },
+    { "Altitude", 12 },
+    { "Resets", 12 },
+    { "RSSI", 12 },
+    { "IHUTemperature", 12 },
+    { "SatelliteXAxisAngularVelocity", 12 },
+    { "SatelliteYAxisAngularVelocity", 12 },
+    { "SatelliteZAxisAngularVelocity", 12 },
+    { "Sensor1", 12 },
+    { "PSUCurrent", 12 },
+    { "Sensor2", 12 },
+    { "Sensor3", 12 },
+    { "STEMPayloadStatus", 1 },
+    { "Nominal Mode", 1 },
+    { "PayloadStatus1", 1 },
+    { "PayloadStatus2", 1 },
+    { "I2CBus0Failure", 1 },
+    { "I2CBus1Failure", 1 },
+    { "I2CBus3Failure", 1 },
+    { "CameraFailure", 1 },
+    { "GroundCommands", 4 },
+    { "RXAntenna", 1 },
+    { "TXAntenna", 1 },
+    { "Pad", 58 }
+};
+
+static const field_t bpsk_fields[] = {
+    { "BATT_A_V", 12 },
+    { "BATT_B_V", 12 },
+    { "BATT_V", 12 },
+    { "SatelliteXAxisAcceleration", 12 },
+    { "SatelliteYAxisAcceleration", 12 },
+    { "SatelliteZAxisAcceleration", 12 },
+    { "battCurr", 12 },
+    { "Temperature", 12 },
+    { "posXv", 12 },
+    { "posYv", 12 },
+    { "posZv", 12 },
+    { "negXv", 12 },
+    { "negYv", 12 },
+    { "negZv", 12 },
+    { "posXi", 12 },
+    { "posYi", 12 },
+    { "posZi", 12 },
+    { "negXi", 12 },
+    { "negYi", 12 },
+    { "negZi", 12 },
+    { "PSUVoltage", 12 },
+    { "spin", 12 },
+    { "Pressure", 12 },
+    { "Altitude", 12 },
+    { "Resets", 12 },
+    { "rssi", 12 },
+    { "IHUcpuTemp", 12 },
+    { "SatelliteXAxisAngularVelocity", 12 },
+    { "SatelliteYAxisAngularVelocity", 12 },
+    { "SatelliteZAxisAngularVelocity", 12 },
+    { "Sensor1", 12 },
+    { "PSUCurrent", 12 },
+    { "Sensor2", 12 },
+    { "Sensor3", 12 },
+    { "STEMPayloadStatus", 1 },
+    { "Nominal Mode", 1 },
+    { "PayloadStatus1", 1 },
+    { "PayloadStatus2", 1 },
+    { "I2CBus0Failure", 1 },
+    { "I2CBus1Failure", 1 },
+    { "I2CBus3Failure", 1 },
+    { "CameraFailure", 1 },
+    { "GroundCommands", 4 },
+    { "RxAntenna", 1 },
+    { "TxAntenna", 2 },
+    { "ICR3VProt", 12 },
+    { "ICR2dot5V", 12 },
+    { "ICR2dot5VProt", 12 },
+    { "rf6", 12 },
+    { "rf7", 12 },
+    { "MuxTest", 12 },
+    { "LtVGACtl", 12 },
+    { "pad", 4 },
+    { "IHUdiagData", 32 },
+    { "pad1", 1 },
+    { "wodSize", 8 },
+    { "swCmds", 32 },
+    { "hwCmdCnt", 6 },
+    { "swCmdCnt", 6 },
+    { "pad2", 28 }
+};
+
+static const field_t wod_fields[] = {
+    { "BATT_A_V", 12 },
+    { "BATT_B_V", 12 },
+    { "BATT_V", 12 },
+    { "SatelliteXAxisAcceleration", 12 },
+    { "SatelliteYAxisAcceleration", 12 },
+    { "SatelliteZAxisAcceleration", 12 },
+    { "battCurr", 12 },
+    { "Temperature", 12 },
+    { "posXv", 12 },
+    { "posYv", 12 },
+    { "posZv", 12 },
+    { "negXv", 12 },
+    { "negYv", 12 },
+    { "negZv", 12 },
+    { "posXi", 12 },
+    { "posYi", 12 },
+    { "posZi", 12 },
+    { "negXi", 12 },
+    { "negYi", 12 },
+    { "negZi", 12 },
+    { "PSUVoltage", 12 },
+    { "spin", 12 },
+    { "Pressure", 12 },
+    { "Altitude", 12 },
+    { "Resets", 12 },
+    { "rssi", 12 },
+    { "IHUcpuTemp", 12 },
+    { "SatelliteXAxisAngularVelocity", 12 },
+    { "SatelliteYAxisAngularVelocity", 12 },
+    { "SatelliteZAxisAngularVelocity", 12 },
+    { "Sensor1", 12 },
+    { "PSUCurrent", 12 },
+    { "Sensor2", 12 },
+    { "Sensor3", 12 },
+    { "STEMPayloadStatus", 1 },
+    { "Nominal Mode", 1 },
+    { "PayloadStatus1", 1 },
+    { "PayloadStatus2", 1 },
+    { "I2CBus0Failure", 1 },
+    { "I2CBus1Failure", 1 },
+    { "I2CBus3Failure", 1 },
+    { "CameraFailure", 1 },
+    { "GroundCommands", 4 },
+    { "RxAntDeploy", 1 },
+    { "TxAntDeploy", 2 },
+    { "ICR3VProt", 12 },
+    { "ICR2dot5V", 12 },
+    { "ICR2dot5VProt", 12 },
+    { "rf6", 12 },
+    { "rf7", 12 },
+    { "MuxTest", 12 },
+    { "LtVGACtl", 12 },
+    { "pad", 4 },
+    { "WODTimeStampReset", 16 },
+    { "pad1", 17 },
+    { "wodSize", 8 },
+    { "swCmds", 32 },
+    { "hwCmdCnt", 6 },
+    { "swCmdCnt", 6 },
+    { "WODTimeStampUpTime", 25 },
+    { "pad2", 3 }
+};
+
+static plan_t builtin[PLAN_LAYOUTS];
+static pthread_once_t builtin_once = PTHREAD_ONCE_INIT;
+
+// The header of a cached plan, which is only used while the layout file
+// keeps the size and modification time it had when the plan was compiled
+typedef struct {
+    unsigned int magic;
+    int version;
+    int sources;
+    int count;
+    int bits;
+    long long size;
+    long long mtime;
+} cache_header_t;
+
+static plan_source_t source_of(const char *name) {
+    size_t i;
+
+    for (i = 0; i < sizeof(sources) / sizeof(sources[0]); i++) {
+        if (strcasecmp(sources[i].name, name) == 0)
+            return sources[i].source;
+    }
+    return PLAN_ZERO;
+}
+
+// Appends the steps of one field
+static int add_field(plan_t *p, const char *name, int bits) {
+    plan_source_t source = source_of(name);
+    int skip = 0;
+
+    if (bits <= 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    while (bits > 0) {
+        plan_op_t *op = &p->op[p->count];
+        int shift = p->bits % 64;
+        int n = (bits > 32) ? 32 : bits;
+
+        if (n > 64 - shift)
+            n = 64 - shift;
+        // values have 32 bits, what a wider field has past them is zero
+        if (source != PLAN_ZERO && skip < 32) {
+            if (p->count >= PLAN_MAX_OPS || p->bits + n > PLAN_MAX_WORDS * 64) {
+                return -PQWS_INVALID_PARAM;
+            }
+            op->mask = ((1ULL << n) - 1) << shift;
+            op->source = (unsigned char) source;
+            op->rotate = (unsigned char) ((shift - skip) & 63);
+            op->shift = (unsigned char) shift;
+            op->bits = (unsigned char) n;
+            op->word = (unsigned char) (p->bits / 64);
+            op->last = 1;
+            if (p->count > 0)
+                op[-1].last = (op[-1].word != op->word);
+            p->count++;
+        }
+        p->bits += n;
+        skip += n;
+        bits -= n;
+    }
+    return PQWS_SUCCESS;
+}
+
+static void builtin_build(void) {
+    size_t i;
+
+    for (i = 0; i < sizeof(fsk_fields) / sizeof(fsk_fields[0]); i++)
+        add_field(&builtin[PLAN_FSK], fsk_fields[i].name, fsk_fields[i].bits);
+    for (i = 0; i < sizeof(bpsk_fields) / sizeof(bpsk_fields[0]); i++)
+        add_field(&builtin[PLAN_BPSK], bpsk_fields[i].name, bpsk_fields[i].bits);
+    for (i = 0; i < sizeof(wod_fields) / sizeof(wod_fields[0]); i++)
+        add_field(&builtin[PLAN_WOD], wod_fields[i].name, wod_fields[i].bits);
+}
+
+/**
+ * @param layout a layout the encoder was built with
+ * @return its plan, or NULL if there is no such layout
+ */
+const plan_t *plan_builtin(plan_layout_t layout) {
+    if ((unsigned int) layout >= PLAN_LAYOUTS)
+        return NULL;
+    pthread_once(&builtin_once, builtin_build);
+    return &builtin[layout];
+}
+
+// Splits a CSV line in place; FoxTelem files have no quoted columns
+static int split(char *line, char *col[], int max) {
+    int n = 0;
+
+    line[strcspn(line, "\r\n")] = 0;
+    col[n++] = line;
+    while (n < max && (line = strchr(line, ',')) != NULL) {
+        *line++ = 0;
+        col[n++] = line;
+    }
+    return n;
+}
+
+/**
+ * Compiles the FIELD and BITS columns of a FoxTelem layout file into a plan
+ * @param p the plan
+ * @param csv the layout file, such as
+ * spacecraft/FoxTelem_1.09m/CubeSatSim_rttelemetry.csv
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the file cannot be read or
+ * has too many fields
+ */
+int plan_compile(plan_t *p, const char *csv) {
+    char line[LINE_LEN];
+    char *col[MAX_COLUMNS];
+    FILE *in;
+    int ret = PQWS_SUCCESS;
+
+    if (!p || !csv || (in = fopen(csv, "r")) == NULL) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(p, 0, sizeof(*p));
+
+    // the first line holds the field count and the column names
+    if (!fgets(line, sizeof(line), in)) {
+        fclose(in);
+        return -PQWS_INVALID_PARAM;
+    }
+    while (ret == PQWS_SUCCESS && fgets(line, sizeof(line), in)) {
+        if (split(line, col, MAX_COLUMNS) < 4)
+            continue;
+        ret = add_field(p, col[2], atoi(col[3]));
+    }
+    fclose(in);
+    if (ret == PQWS_SUCCESS && (p->bits == 0 || p->bits > PLAN_MAX_WORDS * 64)) {
+        ret = -PQWS_INVALID_PARAM;
+    }
+    return ret;
+}
+
+static int cache_read(plan_t *p, const char *cache, const struct stat *st) {
+    cache_header_t h;
+    FILE *in = fopen(cache, "rb");
+    int i, end, ok;
+
+    if (!in) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(p, 0, sizeof(*p));
+    ok = fread(&h, sizeof(h), 1, in) == 1 && h.magic == CACHE_MAGIC
+            && h.version == PLAN_VERSION && h.sources == PLAN_SOURCES
+            && h.size == (long long) st->st_size && h.mtime == (long long) st->st_mtime
+            && h.count >= 0 && h.count <= PLAN_MAX_OPS
+            && h.bits > 0 && h.bits <= PLAN_MAX_WORDS * 64
+            && fread(p->op, sizeof(plan_op_t), h.count, in) == (size_t) h.count;
+    fclose(in);
+    if (!ok) {
+        return -PQWS_INVALID_PARAM;
+    }
+    p->count = h.count;
+    p->bits = h.bits;
+    // the steps must come in order inside the payload, which keeps
+    // plan_pack() inside its words
+    for (i = 0, end = 0; i < p->count; i++) {
+        const plan_op_t *op = &p->op[i];
+        int at = op->word * 64 + op->shift;
+
+        if (op->source == PLAN_ZERO || op->source >= PLAN_SOURCES
+                || op->bits == 0 || op->bits > 32 || op->rotate >= 64
+                || at < end || op->shift + op->bits > 64 || at + op->bits > p->bits
+                || op->mask != ((1ULL << op->bits) - 1) << op->shift
+                || op->last != (i + 1 == p->count || op[1].word != op->word)) {
+            return -PQWS_INVALID_PARAM;
+        }
+        end = at + op->bits;
+    }
+    return PQWS_SUCCESS;
+}
+
+static void cache_write(const plan_t *p, const char *cache, const struct stat *st) {
+    cache_header_t h;
+    FILE *out = fopen(cache, "wb");
+
+    if (!out)
+        return;
+    memset(&h, 0, sizeof(h));
+    h.magic = CACHE_MAGIC;
+    h.version = PLAN_VERSION;
+    h.sources = PLAN_SOURCES;
+    h.count = p->count;
+    h.bits = p->bits;
+    h.size = (long long) st->st_size;
+    h.mtime = (long long) st->st_mtime;
+    if (fwrite(&h, sizeof(h), 1, out) != 1
+            || fwrite(p->op, sizeof(plan_op_t), p->count, out) != (size_t) p->count) {
+        fclose(out);
+        remove(cache);
+        return;
+    }
+    if (fclose(out) != 0)
+        remove(cache);
+}
+
+/**
+ * Loads the plan of a layout file from its cache, or compiles it and
+ * caches it if the cache is missing or older than the file
+ * @param p the plan
+ * @param csv the layout file
+ * @param cache the cached plan, or NULL to always compile
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the layout file cannot be
+ * read
+ */
+int plan_load(plan_t *p, const char *csv, const char *cache) {
+    struct stat st;
+
+    if (!p || !csv || stat(csv, &st) != 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (cache && cache_read(p, cache, &st) == PQWS_SUCCESS) {
+        return PQWS_SUCCESS;
+    }
+    if (plan_compile(p, csv) != PQWS_SUCCESS) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (cache)
+        cache_write(p, cache, &st);
+    return PQWS_SUCCESS;
+}
+
+// Stores a packed word, or the part of it inside the payload
+static inline void put_word(unsigned char *out, int len, int word,
+        unsigned long long acc) {
+    int i = word * 8, end = i + 8;
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (end <= len) {
+        memcpy(&out[i], &acc, 8);
+        return;
+    }
+#endif
+    for (; i < end && i < len; i++, acc >>= 8)
+        out[i] = (unsigned char) acc;
+}
+
+/**
+ * Packs telemetry values into a payload, least significant bit first.
+ * Every step lands at a position fixed by the plan, so there is no bit
+ * count to carry from one to the next and nothing to do for the padding.
+ * Bytes past the layout are zero and fields past len are left out.
+ * @param p the plan
+ * @param values the value of every plan_source_t
+ * @param out the payload
+ * @param len the payload bytes
+ * @return len
+ */
+int plan_pack(const plan_t *p, const unsigned int *values,
+        unsigned char *out, int len) {
+    const plan_op_t *op = p->op, *end = p->op + p->count;
+    unsigned long long acc = 0;
+
+    memset(out, 0, len);
+    for (; op < end; op++) {
+        unsigned long long v = values[op->source];
+
+        acc |= ((v << op->rotate) | (v >> (-op->rotate & 63))) & op->mask;
+        if (op->last) {
+            put_word(out, len, op->word, acc);
+            acc = 0;
+        }
+    }
+    return len;
+}
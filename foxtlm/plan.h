@@ -0,0 +1,119 @@
+/*
+ *  Telemetry packing plans compiled from FoxTelem layout files
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAN_H_
+#define PLAN_H_
+
+#define PLAN_MAX_OPS            128
+#define PLAN_MAX_WORDS          (PLAN_MAX_OPS / 2)      // 64-bit words of a payload
+#define PLAN_VERSION            2       // bump when plan_source_t changes
+
+/**
+ * The telemetry values a layout field can carry.  Fields with no source,
+ * such as pads and values that are not simulated, are sent as zero.
+ */
+typedef enum {
+    PLAN_ZERO,
+    PLAN_BATT_V,
+    PLAN_ACCEL_X,
+    PLAN_ACCEL_Y,
+    PLAN_ACCEL_Z,
+    PLAN_BATT_I,
+    PLAN_TEMP,
+    PLAN_PLUS_X_V,
+    PLAN_MINUS_X_V,
+    PLAN_PLUS_Y_V,
+    PLAN_MINUS_Y_V,
+    PLAN_PLUS_Z_V,
+    PLAN_MINUS_Z_V,
+    PLAN_PLUS_X_I,
+    PLAN_MINUS_X_I,
+    PLAN_PLUS_Y_I,
+    PLAN_MINUS_Y_I,
+    PLAN_PLUS_Z_I,
+    PLAN_MINUS_Z_I,
+    PLAN_PSU_V,
+    PLAN_SPIN,
+    PLAN_PRESSURE,
+    PLAN_ALTITUDE,
+    PLAN_RSSI,
+    PLAN_IHU_TEMP,
+    PLAN_GYRO_X,
+    PLAN_GYRO_Y,
+    PLAN_GYRO_Z,
+    PLAN_HUMIDITY,
+    PLAN_PSU_I,
+    PLAN_XS2,
+    PLAN_XS3,
+    PLAN_STEM_FAILURE,
+    PLAN_SAFE_MODE,
+    PLAN_I2C_BUS0_FAILURE,
+    PLAN_I2C_BUS1_FAILURE,
+    PLAN_I2C_BUS3_FAILURE,
+    PLAN_CAMERA_FAILURE,
+    PLAN_RX_ANTENNA,
+    PLAN_TX_ANTENNA,
+    PLAN_WOD_RESET,             //!< reset count when a WOD sample was taken
+    PLAN_WOD_UPTIME,            //!< uptime when a WOD sample was taken
+    PLAN_SOURCES
+} plan_source_t;
+
+/**
+ * The layouts plan_builtin() has copies of
+ */
+typedef enum {
+    PLAN_FSK,                   //!< CubeSatSim_rttelemetry.csv
+    PLAN_BPSK,                  //!< CubeSatSim_PSK_rttelemetry.csv
+    PLAN_WOD,                   //!< CubeSatSim_PSK_wodtelemetry.csv
+    PLAN_LAYOUTS
+} plan_layout_t;
+
+/**
+ * One step of a plan: bits of a value, placed in a 64-bit word of the
+ * payload, which is packed least significant bit first.  The value is
+ * rotated to its place, so a field that crosses a word takes two steps
+ * with the same rotation and masks for either word.  Fields wider than 32
+ * bits take several steps, and fields that are always zero take none.
+ */
+typedef struct {
+    unsigned long long mask;    //!< the bits of the step in its word
+    unsigned char source;       //!< a plan_source_t
+    unsigned char rotate;       //!< left rotation taking the value to its place
+    unsigned char word;
+    unsigned char last;         //!< 1 if the next step is in another word
+    unsigned char shift;        //!< first bit of the step in its word
+    unsigned char bits;
+} plan_op_t;
+
+/**
+ * A payload layout reduced to the steps that pack it
+ */
+typedef struct {
+    int count;                  //!< steps in op[]
+    int bits;                   //!< bits of all the fields
+    plan_op_t op[PLAN_MAX_OPS];
+} plan_t;
+
+const plan_t *plan_builtin(plan_layout_t layout);
+int plan_compile(plan_t *p, const char *csv);
+int plan_load(plan_t *p, const char *csv, const char *cache);
+int plan_pack(const plan_t *p, const unsigned int *values,
+        unsigned char *out, int len);
+
+#endif /* PLAN_H_ */
@@ -0,0 +1,227 @@
+/*
+ *  Offline multi-threaded synthesis of Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "render.h"
+#include "../afsk/status.h"
+
+// Frames are rendered in batches.  The only state carried from one frame
+// to the next is the 8b10b running disparity and the phase and symbol
+// history of the stream, and both are cheap to chain in order, so each
+// batch is split into
+//
+//   - packing and RS parity, on every thread
+//   - 8b10b coding and stepping the stream state over the bits, in order
+//   - synthesis of the samples from that state, on every thread
+//   - handing the samples to the sink, in order
+//
+// which gives exactly the samples of frames sent one after the other.
+
+enum {
+    STAGE_ENCODE,
+    STAGE_SYNTHESIZE
+};
+
+typedef struct {
+    foxtlm_t enc;
+    foxtlm_tlm_t tlm;
+    int n;                      //!< bits in the frame
+    unsigned char bits[(FOXTLM_MAX_BITS + 7) / 8];
+    wave_stream_t s;            //!< stream state at the start of the frame
+    unsigned char *samples;
+    int count;                  //!< samples synthesized
+} frame_t;
+
+typedef struct {
+    frame_t *frames;
+    int count;
+    int next;                   //!< the next frame to claim
+    int stage;
+    int error;
+} batch_t;
+
+static int collect(void *arg, const void *samples, int count) {
+    frame_t *f = arg;
+    int width = f->s.w->width;
+
+    memcpy(&f->samples[f->count * width], samples, count * width);
+    f->count += count;
+    return count * width;
+}
+
+static void synthesize(frame_t *f) {
+    int i;
+
+    f->s.sink = collect;
+    f->s.arg = f;
+    f->s.n = 0;
+    f->count = 0;
+    for (i = 0; i < f->n; i++)
+        wave_stream_bit(&f->s, foxtlm_bit(f->bits, i));
+    wave_stream_flush(&f->s);
+}
+
+static void *worker(void *arg) {
+    batch_t *b = arg;
+    int i;
+
+    while ((i = __sync_fetch_and_add(&b->next, 1)) < b->count) {
+        frame_t *f = &b->frames[i];
+
+        if (b->stage == STAGE_SYNTHESIZE) {
+            synthesize(f);
+        } else if (foxtlm_pack(&f->enc, &f->tlm) < 0 || foxtlm_parity(&f->enc) != PQWS_SUCCESS) {
+            b->error = 1;
+        }
+    }
+    return NULL;
+}
+
+// Runs one stage over the batch on up to threads threads, this one included
+static void run_stage(batch_t *b, int stage, int threads) {
+    pthread_t tid[RENDER_MAX_THREADS];
+    int i, started = 0;
+
+    b->stage = stage;
+    b->next = 0;
+    for (i = 1; i < threads && i < b->count; i++) {
+        if (pthread_create(&tid[started], NULL, worker, b) != 0)
+            break;
+        started++;
+    }
+    worker(b);
+    for (i = 0; i < started; i++)
+        pthread_join(tid[i], NULL);
+}
+
+// Moves the stream state over the bits of a frame without synthesizing
+static void advance(wave_stream_t *s, const frame_t *f) {
+    int i;
+
+    for (i = 0; i < f->n; i++)
+        wave_stream_skip(s, foxtlm_bit(f->bits, i));
+}
+
+// Encodes, synthesizes and sends one batch, b->count frames from frame
+// number first.  Returns the number of frames sent or -PQWS_INVALID_PARAM.
+static int render_batch(foxtlm_t *fox, wave_stream_t *s, batch_t *b,
+        long first, int cycle_frames, int threads) {
+    short int symbols[FOXTLM_MAX_SYMBOLS];
+    int i;
+
+    run_stage(b, STAGE_ENCODE, threads);
+    if (b->error) {
+        return -PQWS_INVALID_PARAM;
+    }
+
+    for (i = 0; i < b->count; i++) {
+        frame_t *f = &b->frames[i];
+
+        f->enc.rd = fox->rd;
+        f->n = foxtlm_bits(&f->enc, symbols, foxtlm_8b10b(&f->enc, symbols), f->bits);
+        fox->rd = f->enc.rd;
+        if ((first + i) % cycle_frames == 0)
+            s->ctr = 0;
+        f->s.w = s->w;
+        f->s.ctr = s->ctr;
+        f->s.flip_ctr = s->flip_ctr;
+        f->s.phase = s->phase;
+        f->s.history = s->history;
+        f->s.symbols = s->symbols;
+        advance(s, f);
+    }
+    run_stage(b, STAGE_SYNTHESIZE, threads);
+
+    for (i = 0; i < b->count; i++) {
+        frame_t *f = &b->frames[i];
+
+        if (s->sink && s->sink(s->arg, f->samples, f->count) < 0)
+            break;
+        s->sent += f->count;
+    }
+    return i;
+}
+
+/**
+ * Encodes and synthesizes frames on several threads.  The samples reach
+ * the sink of the stream in order and are the same as when each frame is
+ * encoded with foxtlm_encode_bits() and sent with wave_stream_bit(), with
+ * the stream count reset at the start of every cycle.
+ * @param fox the encoder, its running disparity carries on to every frame
+ * @param s the stream, waiting samples are flushed first
+ * @param frames the number of frames to render
+ * @param cycle_frames frames per telemetry cycle, the first frame starts one
+ * @param threads the number of threads to use
+ * @param tlm supplies the telemetry of each frame
+ * @param arg passed back to tlm
+ * @return the number of frames handed to the sink, or -PQWS_INVALID_PARAM
+ */
+long render_frames(foxtlm_t *fox, wave_stream_t *s, long frames,
+        int cycle_frames, int threads, render_tlm_t tlm, void *arg) {
+    batch_t b;
+    long done = 0;
+    int i, size, max_samples, sent = 0;
+
+    if (!fox || !s || !s->w || !tlm || frames < 0 || cycle_frames < 1) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (threads < 1)
+        threads = 1;
+    if (threads > RENDER_MAX_THREADS)
+        threads = RENDER_MAX_THREADS;
+    size = threads * RENDER_BATCH;
+    max_samples = foxtlm_frame_bits(fox) * s->w->samples + WAVE_CHUNK_SAMPLES;
+
+    memset(&b, 0, sizeof(b));
+    b.frames = calloc(size, sizeof(frame_t));
+    for (i = 0; b.frames && i < size; i++) {
+        b.frames[i].samples = malloc(max_samples * s->w->width);
+        if (!b.frames[i].samples)
+            done = -PQWS_INVALID_PARAM;
+    }
+    if (!b.frames)
+        done = -PQWS_INVALID_PARAM;
+
+    wave_stream_flush(s);
+    while (done >= 0 && done < frames) {
+        b.count = (frames - done < size) ? (int) (frames - done) : size;
+        for (i = 0; i < b.count; i++) {
+            b.frames[i].enc = *fox;
+            if (tlm(arg, done + i, &b.frames[i].tlm) != 0) {
+                b.count = i;
+                frames = done + i;
+            }
+        }
+        sent = render_batch(fox, s, &b, done, cycle_frames, threads);
+        if (sent < 0) {
+            done = sent;
+        } else {
+            done += sent;
+            if (sent < b.count)
+                break;
+        }
+    }
+
+    for (i = 0; b.frames && i < size; i++)
+        free(b.frames[i].samples);
+    free(b.frames);
+    return done;
+}
@@ -0,0 +1,38 @@
+/*
+ *  Offline multi-threaded synthesis of Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RENDER_H_
+#define RENDER_H_
+
+#include "foxtlm.h"
+#include "wave.h"
+
+#define RENDER_MAX_THREADS      64
+#define RENDER_BATCH            4       // frames per thread in each batch
+
+/**
+ * Supplies the telemetry of frame number frame.  Called from the thread
+ * running render_frames(), in frame order.  Returns 0, or -1 to stop.
+ */
+typedef int (*render_tlm_t)(void *arg, long frame, foxtlm_tlm_t *tlm);
+
+long render_frames(foxtlm_t *fox, wave_stream_t *s, long frames,
+        int cycle_frames, int threads, render_tlm_t tlm, void *arg);
+
+#endif /* RENDER_H_ */
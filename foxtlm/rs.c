@@ -0,0 +1,763 @@
+/*
+ *  Reed-Solomon RS(255,223) encoder and decoder for the Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  Portions Copyright (C) 2014 Phil Karn KA9Q
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include "rs.h"
+#include "../afsk/status.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RS_HAVE_X86 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RS_HAVE_NEON 1
+#endif
+
+#define NP RS_PARITY_LEN
+
+#ifndef NULL
+#define NULL ((void *)0)
+#endif
+
+#define NN (0xff) // Frame size in symbols
+#define A0 (NN)   // special value for log(0)
+
+
+// GF Antilog lookup table table
+static unsigned char CCSDS_alpha_to[NN+1] = {
+0x01,0x02,0x04,0x08,0x10,0x20,0x40,0x80,0x87,0x89,0x95,0xad,0xdd,0x3d,0x7a,0xf4,
+0x6f,0xde,0x3b,0x76,0xec,0x5f,0xbe,0xfb,0x71,0xe2,0x43,0x86,0x8b,0x91,0xa5,0xcd,
+0x1d,0x3a,0x74,0xe8,0x57,0xae,0xdb,0x31,0x62,0xc4,0x0f,0x1e,0x3c,0x78,0xf0,0x67,
+0xce,0x1b,0x36,0x6c,0xd8,0x37,0x6e,0xdc,0x3f,0x7e,0xfc,0x7f,0xfe,0x7b,0xf6,0x6b,
+0xd6,0x2b,0x56,0xac,0xdf,0x39,0x72,0xe4,0x4f,0x9e,0xbb,0xf1,0x65,0xca,0x13,0x26,
+0x4c,0x98,0xb7,0xe9,0x55,0xaa,0xd3,0x21,0x42,0x84,0x8f,0x99,0xb5,0xed,0x5d,0xba,
+0xf3,0x61,0xc2,0x03,0x06,0x0c,0x18,0x30,0x60,0xc0,0x07,0x0e,0x1c,0x38,0x70,0xe0,
+0x47,0x8e,0x9b,0xb1,0xe5,0x4d,0x9a,0xb3,0xe1,0x45,0x8a,0x93,0xa1,0xc5,0x0d,0x1a,
+0x34,0x68,0xd0,0x27,0x4e,0x9c,0xbf,0xf9,0x75,0xea,0x53,0xa6,0xcb,0x11,0x22,0x44,
+0x88,0x97,0xa9,0xd5,0x2d,0x5a,0xb4,0xef,0x59,0xb2,0xe3,0x41,0x82,0x83,0x81,0x85,
+0x8d,0x9d,0xbd,0xfd,0x7d,0xfa,0x73,0xe6,0x4b,0x96,0xab,0xd1,0x25,0x4a,0x94,0xaf,
+0xd9,0x35,0x6a,0xd4,0x2f,0x5e,0xbc,0xff,0x79,0xf2,0x63,0xc6,0x0b,0x16,0x2c,0x58,
+0xb0,0xe7,0x49,0x92,0xa3,0xc1,0x05,0x0a,0x14,0x28,0x50,0xa0,0xc7,0x09,0x12,0x24,
+0x48,0x90,0xa7,0xc9,0x15,0x2a,0x54,0xa8,0xd7,0x29,0x52,0xa4,0xcf,0x19,0x32,0x64,
+0xc8,0x17,0x2e,0x5c,0xb8,0xf7,0x69,0xd2,0x23,0x46,0x8c,0x9f,0xb9,0xf5,0x6d,0xda,
+0x33,0x66,0xcc,0x1f,0x3e,0x7c,0xf8,0x77,0xee,0x5b,0xb6,0xeb,0x51,0xa2,0xc3,0x00,
+};
+
+// GF log lookup table. Special value represents log(0)
+static unsigned char CCSDS_index_of[NN+1] = {
+ A0,  0,  1, 99,  2,198,100,106,  3,205,199,188,101,126,107, 42,
+  4,141,206, 78,200,212,189,225,102,221,127, 49,108, 32, 43,243,
+  5, 87,142,232,207,172, 79,131,201,217,213, 65,190,148,226,180,
+103, 39,222,240,128,177, 50, 53,109, 69, 33, 18, 44, 13,244, 56,
+  6,155, 88, 26,143,121,233,112,208,194,173,168, 80,117,132, 72,
+202,252,218,138,214, 84, 66, 36,191,152,149,249,227, 94,181, 21,
+104, 97, 40,186,223, 76,241, 47,129,230,178, 63, 51,238, 54, 16,
+110, 24, 70,166, 34,136, 19,247, 45,184, 14, 61,245,164, 57, 59,
+  7,158,156,157, 89,159, 27,  8,144,  9,122, 28,234,160,113, 90,
+209, 29,195,123,174, 10,169,145, 81, 91,118,114,133,161, 73,235,
+203,124,253,196,219, 30,139,210,215,146, 85,170, 67, 11, 37,175,
+192,115,153,119,150, 92,250, 82,228,236, 95, 74,182,162, 22,134,
+105,197, 98,254, 41,125,187,204,224,211, 77,140,242, 31, 48,220,
+130,171,231, 86,179,147, 64,216, 52,176,239, 38, 55, 12, 17, 68,
+111,120, 25,154, 71,116,167,193, 35, 83,137,251, 20, 93,248,151,
+ 46, 75,185, 96, 15,237, 62,229,246,135,165, 23, 58,163, 60,183,
+};
+
+// Only half the coefficients are given here because the
+// generator polynomial is palindromic; G0 = G32, G1 = G31, etc.
+// Only G16 is unique
+static unsigned char CCSDS_poly[] = {
+  0,249,  59, 66,  4,  43,126,251, 97,  30,   3,213, 50, 66,170,   5,
+  24,
+};
+
+static inline int modnn(int x){
+  while (x >= NN) {
+    x -= NN;
+    x = (x >> 8) + (x & NN);
+  }
+  return x;
+}
+
+// Update Reed-Solomon encoder
+// parity -> 32-byte reed-solomon encoder state; clear this to zero before each frame
+void update_rs(
+   unsigned char parity[32], // 32-byte encoder state; zero before each frame
+   unsigned char c)          // Current data byte to update
+{
+  unsigned char feedback;
+  int j,t;
+
+  assert(parity != NULL);
+  feedback = CCSDS_index_of[c ^ parity[0]];
+  if(feedback != A0){ // only if feedback is non-zero
+    // Take advantage of palindromic polynomial to halve the multiplies
+    // Do G1...G15, which is the same as G17...G31
+    for(j=1;j<NP/2;j++){
+      t = CCSDS_alpha_to[modnn(feedback + CCSDS_poly[j])];
+      parity[j] ^= t;
+      parity[NP-j] ^= t;
+    }
+    // Do G16, which is used in only parity[16]
+    t = CCSDS_alpha_to[modnn(feedback + CCSDS_poly[j])];
+    parity[j] ^= t;
+  }
+  // shift left
+  memmove(&parity[0],&parity[1],NP-1);
+  // G0 is 1 in alpha form, 0 in index form; don't need to multiply by it
+  parity[NP-1] = CCSDS_alpha_to[feedback];
+  //taskYIELD();
+}
+
+
+/*
+ * Batch encoder
+ *
+ * update_rs() is linear, so one step of the encoder shift register is
+ *
+ *   f = c ^ parity[0]
+ *   parity = (parity shifted down one byte) ^ rs_step[f]
+ *
+ * where rs_step[f] is the register that update_rs() leaves behind when fed
+ * f from an all-zero state.  With that 8 KB table every step is a 32-byte
+ * shift and XOR, which maps onto one AVX2 register or two SSE2 or NEON
+ * registers.  The codewords of a frame are independent, so encoding them
+ * side by side lets their steps overlap in the pipeline.
+ */
+
+static unsigned char rs_step[256][NP] __attribute__((aligned(32)));
+static rs_isa_t rs_isa = RS_ISA_SCALAR;
+static pthread_once_t rs_once = PTHREAD_ONCE_INIT;
+
+static void decode_build(void);
+
+static void encode_scalar(const unsigned char *data, int len, int depth,
+        unsigned char parity[][NP]) {
+  int i, k;
+
+  for (i = 0; i < len; i++) {
+    unsigned char *p = parity[i % depth];
+    const unsigned char *t = rs_step[data[i] ^ p[0]];
+
+    for (k = 0; k < NP - 1; k++)
+      p[k] = p[k + 1] ^ t[k];
+    p[NP - 1] = t[NP - 1];
+  }
+}
+
+#ifdef RS_HAVE_X86
+__attribute__((target("sse2")))
+static void encode_sse2(const unsigned char *data, int len, int depth,
+        unsigned char parity[][NP]) {
+  __m128i lo[RS_MAX_DEPTH], hi[RS_MAX_DEPTH];
+  int i, j;
+
+  for (j = 0; j < depth; j++) {
+    lo[j] = _mm_loadu_si128((const __m128i *) &parity[j][0]);
+    hi[j] = _mm_loadu_si128((const __m128i *) &parity[j][16]);
+  }
+  for (i = 0, j = 0; i < len; i++) {
+    const unsigned char *t = rs_step[data[i] ^ (unsigned char) _mm_cvtsi128_si32(lo[j])];
+
+    lo[j] = _mm_or_si128(_mm_srli_si128(lo[j], 1), _mm_slli_si128(hi[j], 15));
+    hi[j] = _mm_srli_si128(hi[j], 1);
+    lo[j] = _mm_xor_si128(lo[j], _mm_load_si128((const __m128i *) &t[0]));
+    hi[j] = _mm_xor_si128(hi[j], _mm_load_si128((const __m128i *) &t[16]));
+    if (++j == depth)
+      j = 0;
+  }
+  for (j = 0; j < depth; j++) {
+    _mm_storeu_si128((__m128i *) &parity[j][0], lo[j]);
+    _mm_storeu_si128((__m128i *) &parity[j][16], hi[j]);
+  }
+}
+
+__attribute__((target("avx2")))
+static void encode_avx2(const unsigned char *data, int len, int depth,
+        unsigned char parity[][NP]) {
+  __m256i p[RS_MAX_DEPTH];
+  int i, j;
+
+  for (j = 0; j < depth; j++)
+    p[j] = _mm256_loadu_si256((const __m256i *) parity[j]);
+  for (i = 0, j = 0; i < len; i++) {
+    const unsigned char *t = rs_step[data[i] ^ (unsigned char) _mm_cvtsi128_si32(_mm256_castsi256_si128(p[j]))];
+    // move the upper lane down so alignr can shift across the lane boundary
+    __m256i up = _mm256_permute2x128_si256(p[j], p[j], 0x81);
+
+    p[j] = _mm256_xor_si256(_mm256_alignr_epi8(up, p[j], 1), _mm256_load_si256((const __m256i *) t));
+    if (++j == depth)
+      j = 0;
+  }
+  for (j = 0; j < depth; j++)
+    _mm256_storeu_si256((__m256i *) parity[j], p[j]);
+}
+#endif
+
+#ifdef RS_HAVE_NEON
+static void encode_neon(const unsigned char *data, int len, int depth,
+        unsigned char parity[][NP]) {
+  uint8x16_t lo[RS_MAX_DEPTH], hi[RS_MAX_DEPTH];
+  const uint8x16_t zero = vdupq_n_u8(0);
+  int i, j;
+
+  for (j = 0; j < depth; j++) {
+    lo[j] = vld1q_u8(&parity[j][0]);
+    hi[j] = vld1q_u8(&parity[j][16]);
+  }
+  for (i = 0, j = 0; i < len; i++) {
+    const unsigned char *t = rs_step[data[i] ^ vgetq_lane_u8(lo[j], 0)];
+
+    lo[j] = veorq_u8(vextq_u8(lo[j], hi[j], 1), vld1q_u8(&t[0]));
+    hi[j] = veorq_u8(vextq_u8(hi[j], zero, 1), vld1q_u8(&t[16]));
+    if (++j == depth)
+      j = 0;
+  }
+  for (j = 0; j < depth; j++) {
+    vst1q_u8(&parity[j][0], lo[j]);
+    vst1q_u8(&parity[j][16], hi[j]);
+  }
+}
+#endif
+
+static void rs_build(void) {
+  int f;
+
+  for (f = 0; f < 256; f++) {
+    memset(rs_step[f], 0, NP);
+    update_rs(rs_step[f], (unsigned char) f);
+  }
+  decode_build();
+
+  // SSE2 is preferred over AVX2: the cross-lane shift AVX2 needs costs more
+  // than the second register saves (see bench_rs)
+  if (rs_isa_supported(RS_ISA_NEON))
+    rs_isa = RS_ISA_NEON;
+  else if (rs_isa_supported(RS_ISA_SSE2))
+    rs_isa = RS_ISA_SSE2;
+  else
+    rs_isa = RS_ISA_SCALAR;
+}
+
+/**
+ * Builds the batch encoder table and selects the fastest instruction set
+ * available on this CPU.  Safe to call more than once and from any thread.
+ */
+void rs_init(void) {
+  pthread_once(&rs_once, rs_build);
+}
+
+/**
+ * Checks whether the batch encoder can use an instruction set
+ * @param isa the instruction set
+ * @return 1 if it is compiled in and supported by this CPU, otherwise 0
+ */
+int rs_isa_supported(rs_isa_t isa) {
+  switch (isa) {
+  case RS_ISA_SCALAR:
+    return 1;
+#ifdef RS_HAVE_X86
+  case RS_ISA_SSE2:
+    return __builtin_cpu_supports("sse2");
+  case RS_ISA_AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+#ifdef RS_HAVE_NEON
+  case RS_ISA_NEON:
+    return 1;
+#endif
+  default:
+    return 0;
+  }
+}
+
+/**
+ * Forces the batch encoder onto one instruction set, e.g. for benchmarking
+ * @param isa the instruction set
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if it is not supported
+ */
+int rs_set_isa(rs_isa_t isa) {
+  rs_init();
+  if (!rs_isa_supported(isa))
+    return -PQWS_INVALID_PARAM;
+  rs_isa = isa;
+  return PQWS_SUCCESS;
+}
+
+rs_isa_t rs_get_isa(void) {
+  return rs_isa;
+}
+
+const char *rs_isa_name(rs_isa_t isa) {
+  switch (isa) {
+  case RS_ISA_SCALAR:
+    return "scalar";
+  case RS_ISA_SSE2:
+    return "SSE2";
+  case RS_ISA_AVX2:
+    return "AVX2";
+  case RS_ISA_NEON:
+    return "NEON";
+  }
+  return "unknown";
+}
+
+/**
+ * Encodes all the interleaved codewords of a frame in one call.  Byte i of
+ * data belongs to codeword i % depth, which is the order get_tlm_fox()
+ * transmits them in, so a short last row simply leaves the later codewords
+ * one byte shorter.  The parities come out identical to feeding the same
+ * bytes through update_rs() one at a time.
+ * @param data the data bytes in transmit order
+ * @param len the number of data bytes
+ * @param depth the number of interleaved codewords
+ * @param parity the encoder registers, one per codeword; zero before each frame
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int rs_encode_interleaved(const unsigned char *data, int len, int depth,
+        unsigned char parity[][RS_PARITY_LEN]) {
+  if (!data || !parity || len < 0 || depth < 1 || depth > RS_MAX_DEPTH)
+    return -PQWS_INVALID_PARAM;
+
+  rs_init();
+  switch (rs_isa) {
+#ifdef RS_HAVE_X86
+  case RS_ISA_SSE2:
+    encode_sse2(data, len, depth, parity);
+    break;
+  case RS_ISA_AVX2:
+    encode_avx2(data, len, depth, parity);
+    break;
+#endif
+#ifdef RS_HAVE_NEON
+  case RS_ISA_NEON:
+    encode_neon(data, len, depth, parity);
+    break;
+#endif
+  default:
+    encode_scalar(data, len, depth, parity);
+    break;
+  }
+  return PQWS_SUCCESS;
+}
+
+
+/*
+ * Decoder
+ *
+ * The errors-and-erasures decoder of Phil Karn's libfec (decode_rs.h) for
+ * the same code: first consecutive root 112, roots spaced by alpha^11.
+ * Three changes make it fast on the short codewords of the Fox frames:
+ *
+ * - the syndromes come from the 32-byte remainder of the received word
+ *   divided by g(x), which the rs_step table gives directly, rather than
+ *   from 32 passes over the whole codeword, so a clean codeword costs one
+ *   encode;
+ * - the remainder is evaluated at the 32 roots, and the Chien search tries
+ *   16 positions at a time (8 on NEON), with the GF(256) products done as
+ *   two nibble table lookups (pshufb / vtbl);
+ * - the Chien search only visits the positions of the shortened codeword.
+ */
+
+#define FCR     112     // first consecutive root of g(x), index form
+#define PRIM    11      // spacing of the roots
+#define IPRIM   116     // PRIM * IPRIM = 1 modulo NN, as in decode_rs.h
+
+static unsigned char rs_mul_lo[256][16] __attribute__((aligned(16)));  // c * n
+static unsigned char rs_mul_hi[256][16] __attribute__((aligned(16)));  // c * (n << 4)
+static unsigned char rs_syn_pow[NP][NP] __attribute__((aligned(16)));  // root i ^ (NP - 1 - k) at [k][i]
+
+static inline unsigned char gf_mul(unsigned char a, unsigned char b) {
+  if (a == 0 || b == 0)
+    return 0;
+  return CCSDS_alpha_to[modnn(CCSDS_index_of[a] + CCSDS_index_of[b])];
+}
+
+static void decode_build(void) {
+  int c, n, i, k;
+
+  for (c = 0; c < 256; c++) {
+    for (n = 0; n < 16; n++) {
+      rs_mul_lo[c][n] = gf_mul((unsigned char) c, (unsigned char) n);
+      rs_mul_hi[c][n] = gf_mul((unsigned char) c, (unsigned char) (n << 4));
+    }
+  }
+  for (k = 0; k < NP; k++)
+    for (i = 0; i < NP; i++)
+      rs_syn_pow[k][i] = CCSDS_alpha_to[modnn((FCR + i) * PRIM * (NP - 1 - k))];
+}
+
+// The received word modulo g(x), highest power first like the parity
+static int rs_remainder(const unsigned char *data, int len, int stride,
+        const unsigned char parity[NP], unsigned char r[NP]) {
+  int i, k, any = 0;
+
+  memset(r, 0, NP);
+  for (i = 0; i < len; i++) {
+    const unsigned char *t = rs_step[data[i * stride] ^ r[0]];
+
+    for (k = 0; k < NP - 1; k++)
+      r[k] = r[k + 1] ^ t[k];
+    r[NP - 1] = t[NP - 1];
+  }
+  for (k = 0; k < NP; k++) {
+    r[k] ^= parity[k];
+    any |= r[k];
+  }
+  return any;
+}
+
+static void syndromes_scalar(const unsigned char r[NP], unsigned char s[NP]) {
+  int i, k;
+
+  memset(s, 0, NP);
+  for (k = 0; k < NP; k++)
+    if (r[k])
+      for (i = 0; i < NP; i++)
+        s[i] ^= gf_mul(r[k], rs_syn_pow[k][i]);
+}
+
+// The roots of lambda(x) among the n positions of the codeword
+static int chien_scalar(const unsigned char *lambda, int deg, int n, int pad,
+        int loc[NP]) {
+  int reg[NP + 1];
+  int r0 = modnn(PRIM * (pad + 1)), count = 0, p, j;
+
+  for (j = 1; j <= deg; j++)
+    reg[j] = lambda[j] ? modnn(CCSDS_index_of[lambda[j]] + j * r0) : A0;
+  for (p = 0; p < n; p++) {
+    unsigned char q = lambda[0];
+
+    for (j = 1; j <= deg; j++) {
+      if (reg[j] != A0) {
+        q ^= CCSDS_alpha_to[reg[j]];
+        reg[j] = modnn(reg[j] + j * PRIM);
+      }
+    }
+    if (q == 0) {
+      loc[count++] = p;
+      if (count == deg)
+        break;
+    }
+  }
+  return count;
+}
+
+// lambda[j] * alpha^(j * r) at lanes positions from r0, r stepping by PRIM
+static void chien_start(const unsigned char *lambda, int j, int r0, int lanes,
+        unsigned char *x) {
+  int lane;
+
+  for (lane = 0; lane < lanes; lane++)
+    x[lane] = lambda[j] ? CCSDS_alpha_to[modnn(CCSDS_index_of[lambda[j]] + j * modnn(r0 + lane * PRIM))] : 0;
+}
+
+#ifdef RS_HAVE_X86
+__attribute__((target("ssse3")))
+static inline __m128i gf_mul_ssse3(unsigned char c, __m128i x) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  __m128i lo = _mm_shuffle_epi8(_mm_load_si128((const __m128i *) rs_mul_lo[c]), _mm_and_si128(x, mask));
+  __m128i hi = _mm_shuffle_epi8(_mm_load_si128((const __m128i *) rs_mul_hi[c]),
+    _mm_and_si128(_mm_srli_epi16(x, 4), mask));
+
+  return _mm_xor_si128(lo, hi);
+}
+
+__attribute__((target("ssse3")))
+static void syndromes_ssse3(const unsigned char r[NP], unsigned char s[NP]) {
+  __m128i s0 = _mm_setzero_si128(), s1 = _mm_setzero_si128();
+  int k;
+
+  for (k = 0; k < NP; k++) {
+    if (r[k]) {
+      s0 = _mm_xor_si128(s0, gf_mul_ssse3(r[k], _mm_load_si128((const __m128i *) &rs_syn_pow[k][0])));
+      s1 = _mm_xor_si128(s1, gf_mul_ssse3(r[k], _mm_load_si128((const __m128i *) &rs_syn_pow[k][16])));
+    }
+  }
+  _mm_storeu_si128((__m128i *) &s[0], s0);
+  _mm_storeu_si128((__m128i *) &s[16], s1);
+}
+
+__attribute__((target("ssse3")))
+static int chien_ssse3(const unsigned char *lambda, int deg, int n, int pad,
+        int loc[NP]) {
+  __m128i x[NP + 1];
+  unsigned char step[NP + 1], start[16];
+  int r0 = modnn(PRIM * (pad + 1)), count = 0, p, j;
+
+  for (j = 0; j <= deg; j++) {
+    chien_start(lambda, j, r0, 16, start);
+    x[j] = _mm_loadu_si128((const __m128i *) start);
+    step[j] = CCSDS_alpha_to[modnn(j * 16 * PRIM)];
+  }
+  for (p = 0; p < n; p += 16) {
+    __m128i q = x[0];
+    unsigned int roots;
+
+    for (j = 1; j <= deg; j++)
+      q = _mm_xor_si128(q, x[j]);
+    roots = (unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(q, _mm_setzero_si128()));
+    if (n - p < 16)
+      roots &= (1u << (n - p)) - 1;
+    while (roots) {
+      loc[count++] = p + __builtin_ctz(roots);
+      if (count == deg)
+        return count;
+      roots &= roots - 1;
+    }
+    for (j = 1; j <= deg; j++)
+      x[j] = gf_mul_ssse3(step[j], x[j]);
+  }
+  return count;
+}
+#endif
+
+#ifdef RS_HAVE_NEON
+static inline uint8x8_t gf_mul_neon(unsigned char c, uint8x8_t x) {
+  uint8x8x2_t lo = { { vld1_u8(&rs_mul_lo[c][0]), vld1_u8(&rs_mul_lo[c][8]) } };
+  uint8x8x2_t hi = { { vld1_u8(&rs_mul_hi[c][0]), vld1_u8(&rs_mul_hi[c][8]) } };
+
+  return veor_u8(vtbl2_u8(lo, vand_u8(x, vdup_n_u8(0x0f))), vtbl2_u8(hi, vshr_n_u8(x, 4)));
+}
+
+static void syndromes_neon(const unsigned char r[NP], unsigned char s[NP]) {
+  uint8x8_t acc[NP / 8];
+  int i, k;
+
+  for (i = 0; i < NP / 8; i++)
+    acc[i] = vdup_n_u8(0);
+  for (k = 0; k < NP; k++)
+    if (r[k])
+      for (i = 0; i < NP / 8; i++)
+        acc[i] = veor_u8(acc[i], gf_mul_neon(r[k], vld1_u8(&rs_syn_pow[k][8 * i])));
+  for (i = 0; i < NP / 8; i++)
+    vst1_u8(&s[8 * i], acc[i]);
+}
+
+static int chien_neon(const unsigned char *lambda, int deg, int n, int pad,
+        int loc[NP]) {
+  uint8x8_t x[NP + 1];
+  unsigned char step[NP + 1], start[8];
+  int r0 = modnn(PRIM * (pad + 1)), count = 0, p, j, lane;
+
+  for (j = 0; j <= deg; j++) {
+    chien_start(lambda, j, r0, 8, start);
+    x[j] = vld1_u8(start);
+    step[j] = CCSDS_alpha_to[modnn(j * 8 * PRIM)];
+  }
+  for (p = 0; p < n; p += 8) {
+    uint8x8_t q = x[0];
+    uint64_t roots;
+
+    for (j = 1; j <= deg; j++)
+      q = veor_u8(q, x[j]);
+    roots = vget_lane_u64(vreinterpret_u64_u8(vceq_u8(q, vdup_n_u8(0))), 0);
+    for (lane = 0; roots && lane < 8 && p + lane < n; lane++, roots >>= 8) {
+      if (roots & 0xff) {
+        loc[count++] = p + lane;
+        if (count == deg)
+          return count;
+      }
+    }
+    for (j = 1; j <= deg; j++)
+      x[j] = gf_mul_neon(step[j], x[j]);
+  }
+  return count;
+}
+#endif
+
+static void syndromes(const unsigned char r[NP], unsigned char s[NP]) {
+  switch (rs_isa) {
+#ifdef RS_HAVE_X86
+  case RS_ISA_SSE2:
+  case RS_ISA_AVX2:
+    if (__builtin_cpu_supports("ssse3")) {
+      syndromes_ssse3(r, s);
+      return;
+    }
+    break;
+#endif
+#ifdef RS_HAVE_NEON
+  case RS_ISA_NEON:
+    syndromes_neon(r, s);
+    return;
+#endif
+  default:
+    break;
+  }
+  syndromes_scalar(r, s);
+}
+
+static int chien(const unsigned char *lambda, int deg, int n, int pad,
+        int loc[NP]) {
+  switch (rs_isa) {
+#ifdef RS_HAVE_X86
+  case RS_ISA_SSE2:
+  case RS_ISA_AVX2:
+    if (__builtin_cpu_supports("ssse3"))
+      return chien_ssse3(lambda, deg, n, pad, loc);
+    break;
+#endif
+#ifdef RS_HAVE_NEON
+  case RS_ISA_NEON:
+    return chien_neon(lambda, deg, n, pad, loc);
+#endif
+  default:
+    break;
+  }
+  return chien_scalar(lambda, deg, n, pad, loc);
+}
+
+/**
+ * Corrects one codeword in place.  The codeword is laid out as the encoder
+ * sends it: len data bytes, every stride-th byte of data, then the parity,
+ * so one codeword of an interleaved frame is decoded where it lies.  Up to
+ * 16 errors are corrected, or more when their positions are known: e
+ * errors and f erasures are corrected as long as 2e + f <= 32.
+ * @param data the data bytes of the codeword
+ * @param len the number of data bytes, at most 223
+ * @param stride the distance between two data bytes, the frame's depth
+ * @param parity the received parity
+ * @param erasures positions that are known to be unreliable, counting the
+ * data bytes from 0 and the parity bytes from len, or NULL
+ * @param n_erasures the number of erasures, at most 32
+ * @return the number of bytes corrected, -PQWS_UNCORRECTABLE if there are
+ * too many errors, or -PQWS_INVALID_PARAM
+ */
+int rs_decode(unsigned char *data, int len, int stride,
+        unsigned char parity[RS_PARITY_LEN], const int *erasures,
+        int n_erasures) {
+  unsigned char r[NP], s[NP], lambda[NP + 1], b[NP + 1], t[NP + 1];
+  unsigned char lam[NP + 1], omega[NP + 1], fix[NP];
+  int loc[NP];
+  int n = len + NP, pad = NN - n;
+  int deg_lambda, deg_omega, el, count, i, j, k;
+  unsigned char u, tmp, discr_r;
+
+  if (!data || !parity || len < 1 || pad < 0 || stride < 1 || n_erasures < 0 || n_erasures > NP ||
+    (n_erasures > 0 && !erasures))
+    return -PQWS_INVALID_PARAM;
+  for (i = 0; i < n_erasures; i++)
+    if (erasures[i] < 0 || erasures[i] >= n)
+      return -PQWS_INVALID_PARAM;
+
+  rs_init();
+  if (!rs_remainder(data, len, stride, parity, r))
+    return 0;
+  syndromes(r, s);
+  for (i = 0; i < NP; i++)
+    s[i] = CCSDS_index_of[s[i]];
+
+  // the erasure locator, from which Berlekamp-Massey starts
+  memset(&lambda[1], 0, NP);
+  lambda[0] = 1;
+  if (n_erasures > 0) {
+    lambda[1] = CCSDS_alpha_to[modnn(PRIM * (NN - 1 - (erasures[0] + pad)))];
+    for (i = 1; i < n_erasures; i++) {
+      u = (unsigned char) modnn(PRIM * (NN - 1 - (erasures[i] + pad)));
+      for (j = i + 1; j > 0; j--) {
+        tmp = CCSDS_index_of[lambda[j - 1]];
+        if (tmp != A0)
+          lambda[j] ^= CCSDS_alpha_to[modnn(u + tmp)];
+      }
+    }
+  }
+  for (i = 0; i < NP + 1; i++)
+    b[i] = CCSDS_index_of[lambda[i]];
+
+  // Berlekamp-Massey: lambda and t in polynomial form, b in index form
+  el = n_erasures;
+  for (k = n_erasures + 1; k <= NP; k++) {
+    discr_r = 0;
+    for (i = 0; i < k; i++)
+      if (lambda[i] != 0 && s[k - i - 1] != A0)
+        discr_r ^= CCSDS_alpha_to[modnn(CCSDS_index_of[lambda[i]] + s[k - i - 1])];
+    discr_r = CCSDS_index_of[discr_r];
+    if (discr_r == A0) {
+      memmove(&b[1], b, NP);
+      b[0] = A0;
+      continue;
+    }
+    t[0] = lambda[0];
+    for (i = 0; i < NP; i++)
+      t[i + 1] = (b[i] != A0) ? lambda[i + 1] ^ CCSDS_alpha_to[modnn(discr_r + b[i])] : lambda[i + 1];
+    if (2 * el <= k + n_erasures - 1) {
+      el = k + n_erasures - el;
+      for (i = 0; i <= NP; i++)
+        b[i] = (lambda[i] == 0) ? A0 : (unsigned char) modnn(CCSDS_index_of[lambda[i]] - discr_r + NN);
+    } else {
+      memmove(&b[1], b, NP);
+      b[0] = A0;
+    }
+    memcpy(lambda, t, NP + 1);
+  }
+
+  deg_lambda = 0;
+  for (i = 0; i < NP + 1; i++) {
+    lam[i] = CCSDS_index_of[lambda[i]];
+    if (lam[i] != A0)
+      deg_lambda = i;
+  }
+  // a locator with no roots, or fewer roots inside the shortened codeword
+  // than its degree, means more errors than the code can correct
+  if (deg_lambda == 0)
+    return -PQWS_UNCORRECTABLE;
+  count = chien(lambda, deg_lambda, n, pad, loc);
+  if (count != deg_lambda)
+    return -PQWS_UNCORRECTABLE;
+
+  // Forney: omega(x) = s(x) lambda(x) mod x^NP, in index form
+  deg_omega = deg_lambda - 1;
+  for (i = 0; i <= deg_omega; i++) {
+    tmp = 0;
+    for (j = i; j >= 0; j--)
+      if (s[i - j] != A0 && lam[j] != A0)
+        tmp ^= CCSDS_alpha_to[modnn(s[i - j] + lam[j])];
+    omega[i] = CCSDS_index_of[tmp];
+  }
+  for (j = 0; j < count; j++) {
+    int root = modnn(PRIM * (loc[j] + pad + 1));
+    unsigned char num1 = 0, num2, den = 0;
+
+    for (i = deg_omega; i >= 0; i--)
+      if (omega[i] != A0)
+        num1 ^= CCSDS_alpha_to[modnn(omega[i] + i * root)];
+    num2 = CCSDS_alpha_to[modnn(root * (FCR - 1) + NN)];
+    // lambda[i + 1] for even i is the formal derivative of lambda
+    for (i = ((deg_lambda < NP - 1) ? deg_lambda : NP - 1) & ~1; i >= 0; i -= 2)
+      if (lam[i + 1] != A0)
+        den ^= CCSDS_alpha_to[modnn(lam[i + 1] + i * root)];
+    if (den == 0)
+      return -PQWS_UNCORRECTABLE;
+    fix[j] = num1 ? CCSDS_alpha_to[modnn(CCSDS_index_of[num1] + CCSDS_index_of[num2] + NN - CCSDS_index_of[den])] : 0;
+  }
+  for (j = 0; j < count; j++) {
+    if (loc[j] < len)
+      data[loc[j] * stride] ^= fix[j];
+    else
+      parity[loc[j] - len] ^= fix[j];
+  }
+  return count;
+}
@@ -0,0 +1,54 @@
+/*
+ *  Reed-Solomon RS(255,223) encoder and decoder for the Fox telemetry frames
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  Portions Copyright (C) 2014 Phil Karn KA9Q
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RS_H_
+#define RS_H_
+
+#define RS_PARITY_LEN   32      // parity bytes per codeword
+#define RS_MAX_DEPTH    8       // most codewords interleaved in one frame
+
+/**
+ * Instruction sets the batch encoder can run on
+ */
+typedef enum {
+    RS_ISA_SCALAR,  //!< portable C
+    RS_ISA_SSE2,    //!< x86 SSE2
+    RS_ISA_AVX2,    //!< x86 AVX2
+    RS_ISA_NEON     //!< ARM NEON
+} rs_isa_t;
+
+void update_rs(
+   unsigned char parity[32], // 32-byte encoder state; zero before each frame
+   unsigned char c          // Current data byte to update
+);
+
+void rs_init(void);
+int rs_isa_supported(rs_isa_t isa);
+int rs_set_isa(rs_isa_t isa);
+rs_isa_t rs_get_isa(void);
+const char *rs_isa_name(rs_isa_t isa);
+int rs_encode_interleaved(const unsigned char *data, int len, int depth,
+        unsigned char parity[][RS_PARITY_LEN]);
+int rs_decode(unsigned char *data, int len, int stride,
+        unsigned char parity[RS_PARITY_LEN], const int *erasures,
+        int n_erasures);
+
+#endif /* RS_H_ */
@@ -0,0 +1,172 @@
+/*
+ *  Fixed rate sensor sampling for the CubeSatSim telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include "sampler.h"
+#include "../afsk/status.h"
+
+#define SLEEP_SLICE_NS 200000000LL // longest sleep before checking for a stop
+
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void *run(void *arg) {
+    sampler_t *s = arg;
+    long long next = now_ns(), now;
+    struct timespec deadline;
+
+    while (__atomic_load_n(&s->running, __ATOMIC_ACQUIRE)) {
+        unsigned int head = s->head;
+        sampler_sample_t *x = &s->ring[head % SAMPLER_RING];
+
+        if (head - __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE) >= SAMPLER_RING) {
+            s->overruns++;
+        } else if (s->read(s->arg, x->value) > 0) {
+            x->time_ms = now_ns() / 1000000;
+            __atomic_store_n(&s->head, head + 1, __ATOMIC_RELEASE);
+        }
+
+        // keep to the schedule, but do not catch up on deadlines missed
+        next += s->period_ns;
+        now = now_ns();
+        if (next <= now) {
+            s->late += 1 + (long) ((now - next) / s->period_ns);
+            next += ((now - next) / s->period_ns + 1) * s->period_ns;
+        }
+        // sleep in slices, so a slow schedule still stops promptly
+        while (__atomic_load_n(&s->running, __ATOMIC_ACQUIRE) && (now = now_ns()) < next) {
+            long long until = (next - now > SLEEP_SLICE_NS) ? now + SLEEP_SLICE_NS : next;
+
+            deadline.tv_sec = (time_t) (until / 1000000000LL);
+            deadline.tv_nsec = (long) (until % 1000000000LL);
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL);
+        }
+    }
+    return NULL;
+}
+
+static int start(sampler_t *s, long long period_ns, int channels,
+        sampler_read_t read, void *arg) {
+    if (!s) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(s, 0, sizeof(*s));
+    if (period_ns <= 0 || channels < 1 || channels > SAMPLER_MAX_CHANNELS || !read) {
+        return -PQWS_INVALID_PARAM;
+    }
+    s->read = read;
+    s->arg = arg;
+    s->channels = channels;
+    s->period_ns = period_ns;
+    s->running = 1;
+    if (pthread_create(&s->thread, NULL, run, s) != 0) {
+        s->running = 0;
+        return -PQWS_INVALID_PARAM;
+    }
+    s->started = 1;
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Starts sampling
+ * @param s the sampler
+ * @param rate_hz samples a second
+ * @param channels values per sample, at most SAMPLER_MAX_CHANNELS
+ * @param read reads a sample, called on the sampler thread only
+ * @param arg passed to read
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int sampler_start(sampler_t *s, int rate_hz, int channels, sampler_read_t read,
+        void *arg) {
+    return start(s, rate_hz > 0 ? 1000000000LL / rate_hz : 0, channels, read, arg);
+}
+
+/**
+ * Starts sampling slower than once a second
+ * @param s the sampler
+ * @param period_ms milliseconds between samples
+ * @param channels values per sample, at most SAMPLER_MAX_CHANNELS
+ * @param read reads a sample, called on the sampler thread only
+ * @param arg passed to read
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int sampler_start_period(sampler_t *s, long period_ms, int channels,
+        sampler_read_t read, void *arg) {
+    return start(s, (long long) period_ms * 1000000LL, channels, read, arg);
+}
+
+/**
+ * Stops sampling, after the read in progress
+ * @param s the sampler
+ */
+void sampler_stop(sampler_t *s) {
+    if (!s->started)
+        return;
+    __atomic_store_n(&s->running, 0, __ATOMIC_RELEASE);
+    pthread_join(s->thread, NULL);
+    s->started = 0;
+}
+
+/**
+ * Takes the oldest sample waiting
+ * @param s the sampler
+ * @param sample where to put it
+ * @return 1 for a sample, 0 if none is waiting
+ */
+int sampler_pop(sampler_t *s, sampler_sample_t *sample) {
+    unsigned int tail = s->tail;
+
+    if (__atomic_load_n(&s->head, __ATOMIC_ACQUIRE) == tail)
+        return 0;
+    memcpy(sample, &s->ring[tail % SAMPLER_RING], sizeof(*sample));
+    __atomic_store_n(&s->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+/**
+ * Takes every sample waiting and gathers them per channel
+ * @param s the sampler
+ * @param acc where to put the minimum, maximum, sum and count of each
+ * channel
+ * @return the number of samples
+ */
+int sampler_take(sampler_t *s, stats_acc_t *acc) {
+    sampler_sample_t x;
+    int n = 0, c;
+
+    memset(acc, 0, s->channels * sizeof(*acc));
+    while (sampler_pop(s, &x)) {
+        for (c = 0; c < s->channels; c++) {
+            if (n == 0 || x.value[c] < acc[c].min)
+                acc[c].min = x.value[c];
+            if (n == 0 || x.value[c] > acc[c].max)
+                acc[c].max = x.value[c];
+            acc[c].sum += x.value[c];
+            acc[c].count++;
+        }
+        n++;
+    }
+    return n;
+}
@@ -0,0 +1,76 @@
+/*
+ *  Fixed rate sensor sampling for the CubeSatSim telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SAMPLER_H_
+#define SAMPLER_H_
+
+#include <pthread.h>
+#include "stats.h"
+
+#define SAMPLER_MAX_CHANNELS    16
+#define SAMPLER_RING            256     // samples, a power of two
+
+/**
+ * A sample of every channel
+ */
+typedef struct {
+    long long time_ms;                  //!< CLOCK_MONOTONIC when read
+    float value[SAMPLER_MAX_CHANNELS];
+} sampler_sample_t;
+
+/**
+ * Reads a sample
+ * @param arg what was given to sampler_start()
+ * @param values where to put one value per channel
+ * @return 1 for a sample, 0 if there is no new one, negative on error
+ */
+typedef int (*sampler_read_t)(void *arg, float *values);
+
+/**
+ * A thread reading the sensors on a fixed schedule of absolute deadlines,
+ * so the time a read takes does not drift the rate.  The samples go
+ * through a ring with one writer, the thread, and one reader, so neither
+ * side takes a lock: each index is written by one side only and published
+ * with release and acquire ordering.  While the ring is full the thread
+ * skips samples and counts them.
+ */
+typedef struct {
+    sampler_read_t read;
+    void *arg;
+    int channels;
+    long long period_ns;
+    pthread_t thread;
+    int started;
+    int running;
+    unsigned int head;                  //!< samples written, by the thread
+    unsigned int tail;                  //!< samples taken, by the reader
+    long overruns;                      //!< samples skipped while the ring was full
+    long late;                          //!< deadlines missed
+    sampler_sample_t ring[SAMPLER_RING];
+} sampler_t;
+
+int sampler_start(sampler_t *s, int rate_hz, int channels, sampler_read_t read,
+        void *arg);
+int sampler_start_period(sampler_t *s, long period_ms, int channels,
+        sampler_read_t read, void *arg);
+void sampler_stop(sampler_t *s);
+int sampler_pop(sampler_t *s, sampler_sample_t *sample);
+int sampler_take(sampler_t *s, stats_acc_t *acc);
+
+#endif /* SAMPLER_H_ */
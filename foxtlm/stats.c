@@ -0,0 +1,310 @@
+/*
+ *  Minimum, maximum and mean of the CubeSatSim telemetry channels
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "stats.h"
+#include "../afsk/status.h"
+
+#define STATS_MAGIC     0x54415453u     // "STAT"
+#define STATS_VERSION   1               // bump when stats_file_t changes
+
+// The file
+struct stats_file {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int channels;
+    unsigned int bin_secs;
+    int reset_count;                    //!< of the STATS_RESET statistics
+    unsigned int pad;
+    stats_acc_t scope[STATS_WINDOW][STATS_MAX_CHANNELS];
+    long long bin_index[STATS_BINS];    //!< time bin of each slot of the ring
+    stats_acc_t bin[STATS_BINS][STATS_MAX_CHANNELS];
+};
+
+static void clear(stats_acc_t *a, int count) {
+    int i;
+
+    for (i = 0; i < count; i++) {
+        a[i].min = 0;
+        a[i].max = 0;
+        a[i].sum = 0;
+        a[i].count = 0;
+    }
+}
+
+static inline void add(stats_acc_t *a, float value) {
+    if (a->count == 0 || value < a->min)
+        a->min = value;
+    if (a->count == 0 || value > a->max)
+        a->max = value;
+    a->sum += value;
+    a->count++;
+}
+
+static inline void merge(stats_acc_t *a, const stats_acc_t *b) {
+    if (b->count == 0)
+        return;
+    if (a->count == 0 || b->min < a->min)
+        a->min = b->min;
+    if (a->count == 0 || b->max > a->max)
+        a->max = b->max;
+    a->sum += b->sum;
+    a->count += b->count;
+}
+
+static inline int slot(long long bin) {
+    return (int) (((bin % STATS_BINS) + STATS_BINS) % STATS_BINS);
+}
+
+// Empties the rolling window.  The bins are kept by the time since boot,
+// which starts over at a reset, so bins from before one are not comparable
+// with those after it.
+static void forget_bins(stats_file_t *m) {
+    int i;
+
+    for (i = 0; i < STATS_BINS; i++) {
+        m->bin_index[i] = -1;
+        clear(m->bin[i], STATS_MAX_CHANNELS);
+    }
+}
+
+// Starts time bin bin: clears its slot if it held an older bin and merges
+// the other bins still in the window.  Bins from after bin, left by a clock
+// that went back, are not in the window.
+static void start_bin(stats_t *s, long long bin) {
+    stats_file_t *m = s->map;
+    int i, c;
+
+    s->bin = bin;
+    if (m->bin_index[slot(bin)] != bin) {
+        m->bin_index[slot(bin)] = bin;
+        clear(m->bin[slot(bin)], s->channels);
+        s->dirty = 1;
+    }
+    clear(s->window, s->channels);
+    for (i = 0; i < STATS_BINS; i++) {
+        if (m->bin_index[i] < bin && m->bin_index[i] > bin - STATS_BINS)
+            for (c = 0; c < s->channels; c++)
+                merge(&s->window[c], &m->bin[i][c]);
+    }
+}
+
+/**
+ * Opens the statistics, creating the file if needed.  A file for another
+ * number of channels or bin length is started over, and the STATS_RESET
+ * statistics and the rolling window start over when the reset count is
+ * not the one in the file.
+ * @param s the statistics
+ * @param path the file, or NULL to keep the statistics only in memory
+ * @param channels the number of channels, at most STATS_MAX_CHANNELS
+ * @param bin_secs seconds per bin of the rolling window
+ * @param reset_count the current reset count
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the file cannot be mapped
+ */
+int stats_open(stats_t *s, const char *path, int channels,
+        unsigned int bin_secs, int reset_count) {
+    struct stat st;
+    stats_file_t *m;
+    void *map;
+    int fresh = 1;
+
+    if (!s) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(s, 0, sizeof(*s));
+    s->fd = -1;
+    if (channels < 1 || channels > STATS_MAX_CHANNELS || bin_secs == 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    s->channels = channels;
+
+    if (path) {
+        s->fd = open(path, O_RDWR | O_CREAT, 0644);
+        if (s->fd < 0 || fstat(s->fd, &st) != 0) {
+            stats_close(s);
+            return -PQWS_INVALID_PARAM;
+        }
+        fresh = (st.st_size != (off_t) sizeof(stats_file_t));
+        if (fresh && (ftruncate(s->fd, 0) != 0
+                || ftruncate(s->fd, (off_t) sizeof(stats_file_t)) != 0)) {
+            stats_close(s);
+            return -PQWS_INVALID_PARAM;
+        }
+        map = mmap(NULL, sizeof(stats_file_t), PROT_READ | PROT_WRITE, MAP_SHARED, s->fd, 0);
+    } else {
+        map = mmap(NULL, sizeof(stats_file_t), PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    if (map == MAP_FAILED) {
+        stats_close(s);
+        return -PQWS_INVALID_PARAM;
+    }
+    s->map = m = map;
+
+    if (fresh || m->magic != STATS_MAGIC || m->version != STATS_VERSION
+            || m->channels != (unsigned int) channels || m->bin_secs != bin_secs) {
+        memset(m, 0, sizeof(*m));
+        m->magic = STATS_MAGIC;
+        m->version = STATS_VERSION;
+        m->channels = (unsigned int) channels;
+        m->bin_secs = bin_secs;
+        m->reset_count = reset_count;
+        forget_bins(m);
+        s->dirty = 1;
+    }
+    if (m->reset_count != reset_count) {
+        m->reset_count = reset_count;
+        clear(m->scope[STATS_RESET], channels);
+        forget_bins(m);
+        s->dirty = 1;
+    }
+    s->bin = LLONG_MIN; // no sample yet
+    if (stats_sync(s) != PQWS_SUCCESS) {
+        stats_close(s);
+        return -PQWS_INVALID_PARAM;
+    }
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Writes the statistics out and closes them
+ * @param s the statistics
+ */
+void stats_close(stats_t *s) {
+    if (s->map) {
+        stats_sync(s);
+        munmap(s->map, sizeof(stats_file_t));
+        s->map = NULL;
+    }
+    if (s->fd >= 0)
+        close(s->fd);
+    s->fd = -1;
+}
+
+// The bin of time now, started if it is a new one
+static stats_acc_t *bin_at(stats_t *s, long now) {
+    stats_file_t *m = s->map;
+    long long secs = m->bin_secs;
+    long long bin = (now >= 0) ? now / secs : -1 - (-1 - (long long) now) / secs;
+
+    if (bin != s->bin || m->bin_index[slot(bin)] != bin)
+        start_bin(s, bin);
+    return m->bin[slot(bin)];
+}
+
+/**
+ * Adds a sample of some of the channels
+ * @param s the statistics
+ * @param now the time of the sample in seconds, which picks its bin
+ * @param first the first channel of the sample
+ * @param values one value per channel from first on
+ * @param count the number of values
+ */
+void stats_add(stats_t *s, long now, int first, const float *values,
+        int count) {
+    stats_file_t *m = s->map;
+    stats_acc_t *b;
+    int c;
+
+    if (first < 0 || count < 0 || first + count > s->channels)
+        return;
+    b = bin_at(s, now);
+    for (c = first; c < first + count; c++) {
+        add(&m->scope[STATS_MISSION][c], values[c - first]);
+        add(&m->scope[STATS_RESET][c], values[c - first]);
+        add(&b[c], values[c - first]);
+    }
+    s->dirty = 1;
+}
+
+/**
+ * Adds samples already gathered, as if each had been added by itself
+ * @param s the statistics
+ * @param now the time of the samples in seconds, which picks their bin
+ * @param first the first channel of the samples
+ * @param acc the minimum, maximum, sum and count of the samples of each
+ * channel from first on
+ * @param count the number of channels
+ */
+void stats_merge(stats_t *s, long now, int first, const stats_acc_t *acc,
+        int count) {
+    stats_file_t *m = s->map;
+    stats_acc_t *b;
+    int c;
+
+    if (first < 0 || count < 0 || first + count > s->channels)
+        return;
+    b = bin_at(s, now);
+    for (c = first; c < first + count; c++) {
+        merge(&m->scope[STATS_MISSION][c], &acc[c - first]);
+        merge(&m->scope[STATS_RESET][c], &acc[c - first]);
+        merge(&b[c], &acc[c - first]);
+    }
+    s->dirty = 1;
+}
+
+/**
+ * @param s the statistics
+ * @param scope what the statistic covers
+ * @param channel the channel
+ * @param v where to put the minimum, maximum, mean and sample count
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int stats_get(const stats_t *s, stats_scope_t scope, int channel,
+        stats_value_t *v) {
+    stats_acc_t a;
+
+    if (!s || !s->map || !v || channel < 0 || channel >= s->channels
+            || scope < 0 || scope >= STATS_SCOPES) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (scope == STATS_WINDOW) {
+        a = s->window[channel];
+        if (s->map->bin_index[slot(s->bin)] == s->bin)
+            merge(&a, &s->map->bin[slot(s->bin)][channel]);
+    } else {
+        a = s->map->scope[scope][channel];
+    }
+    v->min = a.min;
+    v->max = a.max;
+    v->mean = (a.count > 0) ? (float) (a.sum / a.count) : 0;
+    v->count = a.count;
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Writes the changes since the last call to the file
+ * @param s the statistics
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the file cannot be written
+ */
+int stats_sync(stats_t *s) {
+    if (!s->map) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (s->dirty && s->fd >= 0 && msync(s->map, sizeof(stats_file_t), MS_SYNC) != 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    s->dirty = 0;
+    return PQWS_SUCCESS;
+}
@@ -0,0 +1,84 @@
+/*
+ *  Minimum, maximum and mean of the CubeSatSim telemetry channels
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#define STATS_MAX_CHANNELS      40
+#define STATS_BINS              16      // the rolling window is this many bins
+
+/**
+ * What a statistic covers
+ */
+typedef enum {
+    STATS_MISSION,              //!< every sample ever added to the file
+    STATS_RESET,                //!< samples since the reset count changed
+    STATS_WINDOW,               //!< samples of the last STATS_BINS bins
+    STATS_SCOPES
+} stats_scope_t;
+
+/**
+ * Running minimum, maximum and sum of one channel
+ */
+typedef struct {
+    float min;
+    float max;
+    double sum;
+    unsigned int count;
+} stats_acc_t;
+
+/**
+ * A statistic of one channel, as stats_get() gives it
+ */
+typedef struct {
+    float min;
+    float max;
+    float mean;
+    unsigned int count;         //!< samples, the rest is meaningless when 0
+} stats_value_t;
+
+typedef struct stats_file stats_file_t;
+
+/**
+ * Statistics of up to STATS_MAX_CHANNELS channels, kept in a file mapped
+ * into memory so the mission values outlive the process.  A sample costs
+ * a constant time per channel; the rolling window is a ring of time bins,
+ * merged again only when a new bin starts.
+ */
+typedef struct {
+    int fd;                     //!< -1 when the statistics are only in memory
+    stats_file_t *map;          //!< NULL when not open
+    int channels;
+    long long bin;              //!< time bin of the latest sample
+    stats_acc_t window[STATS_MAX_CHANNELS]; //!< the finished bins of the window
+    int dirty;                  //!< changed since the last stats_sync()
+} stats_t;
+
+int stats_open(stats_t *s, const char *path, int channels,
+        unsigned int bin_secs, int reset_count);
+void stats_close(stats_t *s);
+void stats_add(stats_t *s, long now, int first, const float *values,
+        int count);
+void stats_merge(stats_t *s, long now, int first, const stats_acc_t *acc,
+        int count);
+int stats_get(const stats_t *s, stats_scope_t scope, int channel,
+        stats_value_t *v);
+int stats_sync(stats_t *s);
+
+#endif /* STATS_H_ */
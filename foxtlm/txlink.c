@@ -0,0 +1,250 @@
+/*
+ *  Sample transport from the CubeSatSim telemetry to rpitx
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <arpa/inet.h>
+#include "txlink.h"
+#include "../afsk/status.h"
+
+// Drops the connection and the samples waiting for it
+static void lose(txlink_t *t) {
+    if (t->fd >= 0)
+        close(t->fd);
+    t->fd = -1;
+    t->dropped += t->count;
+    t->head = 0;
+    t->count = 0;
+}
+
+// Sends the waiting samples, then as much of data as the socket takes,
+// in one call.  Returns the bytes of data sent, or -1 with errno set.
+static ssize_t send_some(txlink_t *t, const unsigned char *data, size_t len) {
+    struct iovec iov[3];
+    struct msghdr msg;
+    size_t first = t->size - t->head, offered = t->count + len, done;
+    int n = 0;
+    ssize_t ret;
+
+    if (first > t->count)
+        first = t->count;
+    if (first > 0) {
+        iov[n].iov_base = &t->ring[t->head];
+        iov[n++].iov_len = first;
+    }
+    if (t->count > first) {
+        iov[n].iov_base = t->ring;
+        iov[n++].iov_len = t->count - first;
+    }
+    if (len > 0) {
+        iov[n].iov_base = (void *) data;
+        iov[n++].iov_len = len;
+    }
+    if (n == 0)
+        return 0;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = n;
+    ret = sendmsg(t->fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (ret < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+    done = (size_t) ret;
+    t->sent += ret;
+    if (done < offered)
+        t->partial++;
+    if (done < t->count) {
+        t->head = (t->head + done) % t->size;
+        t->count -= done;
+        return 0;
+    }
+    done -= t->count;
+    t->head = 0;
+    t->count = 0;
+    return (ssize_t) done;
+}
+
+// Waits until the receiver can take more
+static int wait_writable(txlink_t *t) {
+    struct pollfd p = { t->fd, POLLOUT, 0 };
+    int ret;
+
+    t->stalls++;
+    do {
+        ret = poll(&p, 1, t->timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    if (ret == 0) {
+        return -PQWS_TIMEOUT;
+    }
+    if (ret < 0 || (p.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+        return -PQWS_INVALID_PARAM;
+    }
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Sets up a link, not connected yet
+ * @param t the link
+ * @param host IPv4 address of the receiver
+ * @param port TCP port of the receiver
+ * @param ring_size bytes kept while the receiver is behind
+ * @param timeout_ms longest wait for the receiver before the connection is
+ * dropped
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int txlink_init(txlink_t *t, const char *host, int port, size_t ring_size,
+        int timeout_ms) {
+    if (!t) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(t, 0, sizeof(*t));
+    t->fd = -1;
+    t->addr.sin_family = AF_INET;
+    t->addr.sin_port = htons((unsigned short) port);
+    if (!host || inet_pton(AF_INET, host, &t->addr.sin_addr) <= 0 || ring_size == 0 || timeout_ms < 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    t->ring = malloc(ring_size);
+    if (!t->ring) {
+        return -PQWS_INVALID_PARAM;
+    }
+    t->size = ring_size;
+    t->timeout_ms = timeout_ms;
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Drops the connection and frees the ring
+ * @param t the link
+ */
+void txlink_free(txlink_t *t) {
+    txlink_close(t);
+    free(t->ring);
+    t->ring = NULL;
+}
+
+/**
+ * Connects to the receiver unless connected already
+ * @param t the link
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM with errno set
+ */
+int txlink_connect(txlink_t *t) {
+    if (t->fd >= 0) {
+        return PQWS_SUCCESS;
+    }
+    t->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (t->fd < 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (connect(t->fd, (struct sockaddr *) &t->addr, sizeof(t->addr)) < 0
+            || fcntl(t->fd, F_SETFL, fcntl(t->fd, F_GETFL) | O_NONBLOCK) < 0) {
+        int err = errno;
+
+        close(t->fd);
+        t->fd = -1;
+        errno = err;
+        return -PQWS_INVALID_PARAM;
+    }
+    t->connections++;
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Drops the connection, and the samples the receiver has not taken
+ * @param t the link
+ */
+void txlink_close(txlink_t *t) {
+    lose(t);
+}
+
+/**
+ * Sends samples, keeping what the socket does not take for the next call.
+ * Waits while the ring is too full for the rest.  Without a connection the
+ * samples are dropped.
+ * @param t the link
+ * @param data the samples
+ * @param len their bytes
+ * @return len, 0 if there is no connection, or -PQWS_INVALID_PARAM or
+ * -PQWS_TIMEOUT if the connection was lost
+ */
+int txlink_write(txlink_t *t, const void *data, size_t len) {
+    const unsigned char *p = data;
+    size_t left = len;
+    ssize_t n;
+    int ret;
+
+    t->queued += len;
+    if (t->fd < 0) {
+        t->dropped += len;
+        return 0;
+    }
+    while (left > 0) {
+        n = send_some(t, p, left);
+        if (n < 0) {
+            t->dropped += left;
+            lose(t);
+            return -PQWS_INVALID_PARAM;
+        }
+        p += n;
+        left -= (size_t) n;
+        if (left <= t->size - t->count) {
+            size_t tail = (t->head + t->count) % t->size;
+            size_t first = (left < t->size - tail) ? left : t->size - tail;
+
+            memcpy(&t->ring[tail], p, first);
+            memcpy(t->ring, p + first, left - first);
+            t->count += left;
+            break;
+        }
+        if ((ret = wait_writable(t)) != PQWS_SUCCESS) {
+            t->dropped += left;
+            lose(t);
+            return ret;
+        }
+    }
+    return (int) len;
+}
+
+/**
+ * Waits until the receiver has taken every waiting sample
+ * @param t the link
+ * @return PQWS_SUCCESS, or -PQWS_INVALID_PARAM or -PQWS_TIMEOUT if the
+ * connection was lost
+ */
+int txlink_flush(txlink_t *t) {
+    int ret;
+
+    while (t->fd >= 0 && t->count > 0) {
+        if (send_some(t, NULL, 0) < 0) {
+            lose(t);
+            return -PQWS_INVALID_PARAM;
+        }
+        if (t->count > 0 && (ret = wait_writable(t)) != PQWS_SUCCESS) {
+            lose(t);
+            return ret;
+        }
+    }
+    return (t->fd >= 0) ? PQWS_SUCCESS : -PQWS_INVALID_PARAM;
+}
@@ -0,0 +1,61 @@
+/*
+ *  Sample transport from the CubeSatSim telemetry to rpitx
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TXLINK_H_
+#define TXLINK_H_
+
+#include <stddef.h>
+#include <netinet/in.h>
+
+/**
+ * A TCP connection to the process that puts the samples on the air.  The
+ * socket is nonblocking: what it does not take at once waits in a ring and
+ * goes out ahead of the next samples in the same gathered send, so samples
+ * are copied only when the receiver is behind.  A writer that would
+ * overflow the ring waits for the receiver, for at most timeout_ms at a
+ * time, rather than dropping samples in the middle of a frame.  A
+ * connection that fails or stalls for longer is closed and its waiting
+ * samples are dropped; txlink_connect() opens a new one, so the receiver
+ * can be restarted.
+ */
+typedef struct {
+    int fd;                     //!< -1 while not connected
+    struct sockaddr_in addr;
+    unsigned char *ring;        //!< samples the socket has not taken yet
+    size_t size;
+    size_t head;                //!< the oldest waiting byte
+    size_t count;               //!< bytes waiting
+    int timeout_ms;             //!< longest wait for the receiver
+    int connections;            //!< connections opened
+    long long queued;           //!< bytes handed to txlink_write()
+    long long sent;             //!< bytes the socket took
+    long long dropped;          //!< bytes lost with a connection or without one
+    long partial;               //!< sends the socket took only part of
+    long stalls;                //!< waits for the receiver to drain
+} txlink_t;
+
+int txlink_init(txlink_t *t, const char *host, int port, size_t ring_size,
+        int timeout_ms);
+void txlink_free(txlink_t *t);
+int txlink_connect(txlink_t *t);
+void txlink_close(txlink_t *t);
+int txlink_write(txlink_t *t, const void *data, size_t len);
+int txlink_flush(txlink_t *t);
+
+#endif /* TXLINK_H_ */
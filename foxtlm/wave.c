@@ -0,0 +1,462 @@
+/*
+ *  Waveform templates for the CubeSatSim FSK and BPSK modulators
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "wave.h"
+#include "nco.h"
+#include "../afsk/status.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define WAVE_HAVE_SSE2 1
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define WAVE_HAVE_NEON 1
+#endif
+
+// The BPSK carrier at sample index i of a frame, the phase of which is
+// exactly i turns of the oscillator step: the subcarrier, or cos and sin
+// for complex baseband
+static void carrier_full(const wave_t *w, int i, short int *out) {
+    unsigned int phase = w->nco.step * (unsigned int) i;
+
+    if (w->channels == 2) {
+        out[0] = nco_at(&w->nco, phase + 0x40000000u, w->amplitude);
+        out[1] = nco_at(&w->nco, phase, w->amplitude);
+    } else {
+        out[0] = nco_at(&w->nco, phase, w->amplitude);
+    }
+}
+
+// The carrier of the samples period of samples from sample index i on
+static void carrier_period(const wave_t *w, int i, int samples, short int *out) {
+    nco_t nco = w->nco;
+    int j;
+
+    if (w->channels == 1) {
+        nco.phase = w->nco.step * (unsigned int) i;
+        nco_block(&nco, out, samples, w->amplitude);
+    } else {
+        for (j = 0; j < samples; j++)
+            carrier_full(w, i + j, &out[2 * j]);
+    }
+}
+
+// Root raised cosine impulse response, t in symbol periods, unit energy
+// per symbol
+static double rrc(double t, double beta) {
+    double x = 4 * beta * t;
+
+    if (fabs(t) < 1e-9)
+        return 1 - beta + 4 * beta / M_PI;
+    if (fabs(fabs(x) - 1) < 1e-9)
+        return beta / sqrt(2) * ((1 + 2 / M_PI) * sin(M_PI / (4 * beta))
+                + (1 - 2 / M_PI) * cos(M_PI / (4 * beta)));
+    return (sin(M_PI * t * (1 - beta)) + x * cos(M_PI * t * (1 + beta)))
+            / (M_PI * t * (1 - x * x));
+}
+
+/**
+ * @return 1 if the vector pulse shaping is compiled in for this CPU,
+ * otherwise 0
+ */
+int wave_simd_supported(void) {
+#if defined(WAVE_HAVE_SSE2) || defined(WAVE_HAVE_NEON)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Builds the BPSK pulse shaping filter, a root raised cosine sampled half
+ * a sample off its peak so that every branch is symmetric with another.
+ * The symbols come out span / 2 periods after they are sent.
+ * @param w a BPSK template set
+ * @param rolloff the excess bandwidth, above 0 and at most 1
+ * @param span the pulse length in symbols, 2 to WAVE_MAX_SPAN
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int wave_shape(wave_t *w, float rolloff, int span) {
+    int j, m, n, ch;
+    float *taps;
+    double peak = 0;
+
+    if (!w || !w->bpsk || !(rolloff > 0 && rolloff <= 1) || span < 2 || span > WAVE_MAX_SPAN) {
+        return -PQWS_INVALID_PARAM;
+    }
+    n = w->samples;
+    ch = w->channels;
+    taps = malloc(span * n * ch * sizeof(float));
+    if (!taps) {
+        return -PQWS_INVALID_PARAM;
+    }
+    for (m = 0; m < span; m++) {
+        for (j = 0; j < n; j++)
+            taps[(m * n + j) * ch] = (float) rrc((m * n + j + 0.5) / n - span / 2.0, rolloff);
+    }
+
+    // the largest output is every symbol lined up with the sign of its tap
+    for (j = 0; j < n; j++) {
+        double sum = 0;
+
+        for (m = 0; m < span; m++)
+            sum += fabs(taps[(m * n + j) * ch]);
+        if (sum > peak)
+            peak = sum;
+    }
+    // the same weight for every channel of a sample
+    for (j = 0; j < span * n * ch; j += ch) {
+        float tap = (float) (taps[j] / peak);
+
+        for (m = 0; m < ch; m++)
+            taps[j + m] = tap;
+    }
+
+    free(w->taps);
+    w->taps = taps;
+    w->rolloff = rolloff;
+    w->span = span;
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Chooses the format of the samples.  Complex baseband is for BPSK only.
+ * @param w the template set, the taps are rebuilt to suit
+ * @param format a wave_format_t
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM
+ */
+int wave_set_format(wave_t *w, wave_format_t format) {
+    int channels = (format == WAVE_REAL) ? 1 : 2;
+
+    if (!w || (format != WAVE_REAL && format != WAVE_IQ_S16 && format != WAVE_IQ_F32)
+            || (!w->bpsk && format != WAVE_REAL)) {
+        return -PQWS_INVALID_PARAM;
+    }
+    w->format = format;
+    w->channels = channels;
+    w->width = channels * ((format == WAVE_IQ_F32) ? sizeof(float) : sizeof(short int));
+    if (!w->bpsk) {
+        return PQWS_SUCCESS;
+    }
+    if (wave_shape(w, w->rolloff, w->span) != PQWS_SUCCESS) {
+        return -PQWS_INVALID_PARAM;
+    }
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Builds the sample templates for one modulation mode
+ * @param w the template set to fill in
+ * @param bpsk non-zero for BPSK, zero for FSK
+ * @param amplitude the full scale amplitude
+ * @param freq_Hz the BPSK subcarrier frequency
+ * @param s_rate the output sample rate
+ * @param samples the number of samples per bit
+ * @param smaller the number of samples in the FSK ramp
+ * @return PQWS_SUCCESS or the negative of an error code
+ */
+int wave_init(wave_t *w, int bpsk, float amplitude, float freq_Hz, int s_rate,
+        int samples, int smaller) {
+    int i;
+
+    if (!w || samples <= 0 || samples > WAVE_MAX_SAMPLES || smaller < 0
+            || smaller > samples) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(w, 0, sizeof(*w));
+
+    w->amplitude = amplitude;
+    w->freq_Hz = freq_Hz;
+    w->s_rate = s_rate;
+    w->bpsk = bpsk;
+    w->samples = samples;
+    w->smaller = smaller;
+    w->simd = wave_simd_supported();
+    w->format = WAVE_REAL;
+    w->channels = 1;
+    w->width = sizeof(short int);
+
+    if (bpsk) {
+        nco_init(&w->nco, freq_Hz, s_rate, 1);
+        if (wave_shape(w, WAVE_ROLLOFF, WAVE_SPAN) != PQWS_SUCCESS) {
+            wave_free(w);
+            return -PQWS_INVALID_PARAM;
+        }
+    } else {
+        w->ramp = malloc((smaller + 1) * sizeof(short int));
+        if (!w->ramp) {
+            return -PQWS_INVALID_PARAM;
+        }
+        for (i = 0; i < smaller; i++)
+            w->ramp[i] = (short int) (0.1 * 1 * i / smaller);
+        w->level = (short int) (0.25 * amplitude * 1);
+    }
+    return PQWS_SUCCESS;
+}
+
+void wave_free(wave_t *w) {
+    free(w->taps);
+    free(w->ramp);
+    w->ramp = NULL;
+    w->taps = NULL;
+}
+
+// Shapes values first to n - 1 of a period: the pulses of the last count
+// symbols, each negated where its bit of history is set, times the carrier.
+// The values go to fout as floats if it is set, otherwise to out.  Every
+// kernel sums the branches in the same order and rounds to nearest even, so
+// they all give the same samples.
+static void shape_scalar(const float *taps, int n, int count,
+        unsigned int history, const short int *c, short int *out, float *fout,
+        int first) {
+    int j, m;
+
+    for (j = first; j < n; j++) {
+        float acc = 0;
+
+        for (m = 0; m < count; m++)
+            acc += ((history >> m) & 1) ? -taps[m * n + j] : taps[m * n + j];
+        if (fout)
+            fout[j] = acc * c[j] * (1.0f / 32768);
+        else
+            out[j] = (short int) lrintf(acc * c[j]);
+    }
+}
+
+#ifdef WAVE_HAVE_SSE2
+static void shape_sse2(const float *taps, int n, int count,
+        unsigned int history, const short int *c, short int *out, float *fout) {
+    int j, m;
+
+    for (j = 0; j + 4 <= n; j += 4) {
+        __m128 acc = _mm_setzero_ps();
+        __m128i v;
+
+        for (m = 0; m < count; m++) {
+            __m128 sign = _mm_castsi128_ps(_mm_set1_epi32((int) (((history >> m) & 1u) << 31)));
+
+            acc = _mm_add_ps(acc, _mm_xor_ps(_mm_loadu_ps(&taps[m * n + j]), sign));
+        }
+        v = _mm_loadl_epi64((const __m128i *) &c[j]);
+        acc = _mm_mul_ps(acc, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16)));
+        if (fout) {
+            _mm_storeu_ps(&fout[j], _mm_mul_ps(acc, _mm_set1_ps(1.0f / 32768)));
+        } else {
+            v = _mm_cvtps_epi32(acc);
+            _mm_storel_epi64((__m128i *) &out[j], _mm_packs_epi32(v, v));
+        }
+    }
+    shape_scalar(taps, n, count, history, c, out, fout, j);
+}
+#endif
+
+#ifdef WAVE_HAVE_NEON
+static void shape_neon(const float *taps, int n, int count,
+        unsigned int history, const short int *c, short int *out, float *fout) {
+    int j, m;
+
+    for (j = 0; j + 4 <= n; j += 4) {
+        float32x4_t acc = vdupq_n_f32(0);
+
+        for (m = 0; m < count; m++) {
+            uint32x4_t sign = vdupq_n_u32(((history >> m) & 1u) << 31);
+
+            acc = vaddq_f32(acc, vreinterpretq_f32_u32(veorq_u32(
+                    vreinterpretq_u32_f32(vld1q_f32(&taps[m * n + j])), sign)));
+        }
+        acc = vmulq_f32(acc, vcvtq_f32_s32(vmovl_s16(vld1_s16(&c[j]))));
+        if (fout) {
+            vst1q_f32(&fout[j], vmulq_f32(acc, vdupq_n_f32(1.0f / 32768)));
+            continue;
+        }
+#if defined(__aarch64__)
+        vst1_s16(&out[j], vqmovn_s32(vcvtnq_s32_f32(acc)));
+#else
+        // 1.5 * 2^23 pushes the fraction out, rounding to nearest even
+        acc = vsubq_f32(vaddq_f32(acc, vdupq_n_f32(12582912.0f)), vdupq_n_f32(12582912.0f));
+        vst1_s16(&out[j], vqmovn_s32(vcvtq_s32_f32(acc)));
+#endif
+    }
+    shape_scalar(taps, n, count, history, c, out, fout, j);
+}
+#endif
+
+static void shape(const wave_t *w, int count, unsigned int history,
+        const short int *c, void *out) {
+    int n = w->samples * w->channels;
+    float *fout = (w->format == WAVE_IQ_F32) ? out : NULL;
+
+#ifdef WAVE_HAVE_SSE2
+    if (w->simd) {
+        shape_sse2(w->taps, n, count, history, c, out, fout);
+        return;
+    }
+#endif
+#ifdef WAVE_HAVE_NEON
+    if (w->simd) {
+        shape_neon(w->taps, n, count, history, c, out, fout);
+        return;
+    }
+#endif
+    shape_scalar(w->taps, n, count, history, c, out, fout, 0);
+}
+
+/**
+ * Writes the samples of the next bit period of a stream
+ * @param s the stream
+ * @param out where to write the samples, in the format of the templates
+ */
+void wave_write_bit(const wave_stream_t *s, void *out) {
+    const wave_t *w = s->w;
+    short int *o = out;
+    int j, n;
+
+    if (w->bpsk) {
+        short int carrier[WAVE_MAX_SAMPLES * WAVE_MAX_CHANNELS];
+
+        carrier_period(w, s->ctr, w->samples, carrier);
+        shape(w, (s->symbols < w->span) ? s->symbols : w->span, s->history, carrier, out);
+        return;
+    }
+
+    // samples still inside the ramp
+    n = s->flip_ctr + w->smaller - s->ctr;
+    if (n < 0)
+        n = 0;
+    if (n > w->samples)
+        n = w->samples;
+    for (j = 0; j < n; j++) {
+        int d = s->ctr + j - s->flip_ctr;
+        o[j] = (d >= 0) ? (short int) (s->phase * w->ramp[d]) : (short int) (0.1 * s->phase * d / w->smaller);
+    }
+    for (; j < w->samples; j++)
+        o[j] = (short int) (s->phase * w->level);
+}
+
+/**
+ * Starts a stream of samples
+ * @param s the stream
+ * @param w the template set to synthesize from
+ * @param sink the function receiving every completed chunk
+ * @param arg passed back to the sink
+ */
+void wave_stream_init(wave_stream_t *s, const wave_t *w, wave_sink_t sink,
+        void *arg) {
+    s->w = w;
+    s->sink = sink;
+    s->arg = arg;
+    s->ctr = 0;
+    s->flip_ctr = 0;
+    s->phase = 1;
+    s->history = 0;
+    s->symbols = 1;
+    s->n = 0;
+    s->sent = 0;
+}
+
+/**
+ * Moves the stream state past one bit period without synthesizing it, then
+ * applies the next bit: FSK takes the phase of the bit, BPSK flips the
+ * phase on a zero.
+ * @param s the stream
+ * @param data the value of the next bit
+ */
+void wave_stream_skip(wave_stream_t *s, int data) {
+    const wave_t *w = s->w;
+
+    s->ctr += w->samples;
+    if (!w->bpsk) {
+        s->phase = ((data != 0) * 2) - 1;
+    } else {
+        if (data == 0)
+            s->phase *= -1;
+        s->history = (s->history << 1) | (s->phase < 0);
+        if (s->symbols < WAVE_MAX_SPAN)
+            s->symbols++;
+    }
+}
+
+/**
+ * Synthesizes one bit period with the current phase, then applies the next
+ * bit as wave_stream_skip() does.
+ * @param s the stream
+ * @param data the value of the next bit
+ * @return the result of the sink if a chunk was completed, otherwise 0
+ */
+int wave_stream_bit(wave_stream_t *s, int data) {
+    const wave_t *w = s->w;
+    unsigned char *chunk = (unsigned char *) &s->chunk;
+    int ret = 0;
+
+    wave_write_bit(s, &chunk[s->n * w->width]);
+    s->n += w->samples;
+    wave_stream_skip(s, data);
+
+    if (s->n >= WAVE_CHUNK_SAMPLES) {
+        if (s->sink)
+            ret = s->sink(s->arg, chunk, WAVE_CHUNK_SAMPLES);
+        s->sent += WAVE_CHUNK_SAMPLES;
+        s->n -= WAVE_CHUNK_SAMPLES;
+        memmove(chunk, &chunk[WAVE_CHUNK_SAMPLES * w->width], s->n * w->width);
+    }
+    return ret;
+}
+
+/**
+ * Ends a transmission.  The period of the last bit is only synthesized
+ * with the next bit, and a BPSK symbol only reaches the peak of its pulse
+ * span / 2 periods later, so this synthesizes that many more periods of
+ * idle bits, which keep the phase.  Call wave_stream_flush() after it.
+ * @param s the stream
+ * @return the result of the sink if it failed, otherwise 0
+ */
+int wave_stream_drain(wave_stream_t *s) {
+    const wave_t *w = s->w;
+    int i, ret = 0, periods = 1 + (w->bpsk ? w->span / 2 : 0);
+
+    for (i = 0; i < periods; i++) {
+        int r = wave_stream_bit(s, 1);
+
+        if (r < 0)
+            ret = r;
+    }
+    return ret;
+}
+
+/**
+ * Hands any samples still waiting in the stream to the sink
+ * @param s the stream
+ * @return the result of the sink, or 0 if nothing was waiting
+ */
+int wave_stream_flush(wave_stream_t *s) {
+    int ret = 0;
+
+    if (s->n > 0) {
+        if (s->sink)
+            ret = s->sink(s->arg, &s->chunk, s->n);
+        s->sent += s->n;
+        s->n = 0;
+    }
+    return ret;
+}
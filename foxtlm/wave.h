@@ -0,0 +1,124 @@
+/*
+ *  Waveform templates for the CubeSatSim FSK and BPSK modulators
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAVE_H_
+#define WAVE_H_
+
+#include "nco.h"
+
+#define WAVE_CHUNK_SAMPLES      2048    // 4 KB of samples per output chunk
+#define WAVE_MAX_SAMPLES        480     // longest bit period, 100 bps at 48 kHz
+#define WAVE_MAX_SPAN           32      // longest BPSK pulse, symbols
+#define WAVE_SPAN               8       // default BPSK pulse length, symbols
+#define WAVE_ROLLOFF            0.5f    // default BPSK root raised cosine rolloff
+#define WAVE_MAX_CHANNELS       2       // I and Q
+
+/**
+ * Output sample formats.  Complex samples are interleaved I, Q.
+ */
+typedef enum {
+    WAVE_REAL,          //!< 16 bit real audio on the subcarrier
+    WAVE_IQ_S16,        //!< 16 bit complex baseband, BPSK only
+    WAVE_IQ_F32         //!< float complex baseband, the 16 bit samples / 32768
+} wave_format_t;
+
+/**
+ * Sample blocks for every symbol state, built once at startup so that frame
+ * synthesis is reduced to block copies.
+ *
+ * The BPSK carrier comes from a fixed-point oscillator, so sample i of a
+ * frame has a phase of exactly i oscillator steps however long the frame.
+ * It is generated a bit period at a time, so the templates take the same
+ * few kilobytes whatever the frame length and sample format.  Only the +1
+ * phase is generated; the -1 phase is its exact negation.
+ *
+ * BPSK symbols are shaped by a root raised cosine pulse span symbols long,
+ * kept as a polyphase filter: taps[m * samples + j] is the weight of the
+ * symbol m periods back in sample j of the current period.  The taps are
+ * scaled so that no sequence of symbols can exceed the full amplitude.
+ *
+ * With a complex baseband format the carrier is exp(i 2 pi freq_Hz t)
+ * and, like the taps, has one value per channel of every sample, so the
+ * subcarrier becomes an offset from the RF frequency and zero puts the
+ * signal on it.
+ */
+typedef struct {
+    int bpsk;           //!< non-zero for BPSK, zero for FSK
+    float amplitude;    //!< full scale amplitude
+    float freq_Hz;      //!< BPSK subcarrier frequency
+    nco_t nco;          //!< BPSK subcarrier oscillator
+    int s_rate;         //!< output sample rate
+    int samples;        //!< samples per bit
+    int smaller;        //!< samples in the FSK ramp
+    int format;         //!< a wave_format_t
+    int channels;       //!< values per sample, 1 or 2
+    int width;          //!< bytes per sample
+    float rolloff;      //!< BPSK pulse rolloff, 0 to 1
+    int span;           //!< BPSK pulse length, symbols
+    float *taps;        //!< BPSK pulse, span polyphase branches of samples
+    int simd;           //!< use the vector shaping if compiled in
+    short int *ramp;    //!< FSK ramp for the first samples after flip_ctr
+    short int level;    //!< FSK level for phase +1
+} wave_t;
+
+/**
+ * Receives each chunk of samples, count of w->width bytes each, as soon as
+ * it has been synthesized.  Returns the number of bytes accepted or -1 on
+ * error.
+ */
+typedef int (*wave_sink_t)(void *arg, const void *samples, int count);
+
+/**
+ * Streaming synthesizer state.  Samples are produced one bit period at a
+ * time into chunk[] and handed to the sink in WAVE_CHUNK_SAMPLES blocks, so
+ * a frame never has to be rendered in full before it is sent.
+ */
+typedef struct {
+    const wave_t *w;
+    wave_sink_t sink;
+    void *arg;
+    int ctr;            //!< sample index from the start of the frame
+    int flip_ctr;       //!< sample index the FSK ramp starts from
+    int phase;          //!< phase (+1 or -1) of the next bit period
+    unsigned int history;       //!< BPSK phases, bit m set if m periods back was -1
+    int symbols;        //!< BPSK periods in history, at most WAVE_MAX_SPAN
+    int n;              //!< samples waiting in chunk[]
+    long sent;          //!< samples handed to the sink
+    union {
+        short int s[(WAVE_CHUNK_SAMPLES + WAVE_MAX_SAMPLES) * WAVE_MAX_CHANNELS];
+        float f[(WAVE_CHUNK_SAMPLES + WAVE_MAX_SAMPLES) * WAVE_MAX_CHANNELS];
+    } chunk;
+} wave_stream_t;
+
+int wave_init(wave_t *w, int bpsk, float amplitude, float freq_Hz, int s_rate,
+        int samples, int smaller);
+int wave_shape(wave_t *w, float rolloff, int span);
+int wave_set_format(wave_t *w, wave_format_t format);
+int wave_simd_supported(void);
+void wave_free(wave_t *w);
+
+void wave_stream_init(wave_stream_t *s, const wave_t *w, wave_sink_t sink,
+        void *arg);
+void wave_write_bit(const wave_stream_t *s, void *out);
+void wave_stream_skip(wave_stream_t *s, int data);
+int wave_stream_bit(wave_stream_t *s, int data);
+int wave_stream_drain(wave_stream_t *s);
+int wave_stream_flush(wave_stream_t *s);
+
+#endif /* WAVE_H_ */
@@ -0,0 +1,268 @@
+/*
+ *  Whole orbit data store for the CubeSatSim telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "wod.h"
+#include "../afsk/status.h"
+
+#define WOD_MAGIC       0x444f5746u     // "FWOD"
+#define HEADER_SIZE     64              // the header, then the slots
+
+// The start of the file
+typedef struct {
+    unsigned int magic;
+    unsigned int format;        //!< of the records, from the caller
+    unsigned int record_size;
+    unsigned int capacity;
+    unsigned int sent;          //!< sequence number of the oldest record not drained
+} header_t;
+
+// The start of a slot, followed by the record.  Sequence numbers start at 1,
+// a slot never written has 0.
+typedef struct {
+    unsigned int seq;
+    unsigned int check;
+} slot_t;
+
+_Static_assert(sizeof(header_t) <= HEADER_SIZE, "HEADER_SIZE");
+
+// FNV-1a over the sequence number and the record
+static unsigned int checksum(unsigned int seq, const unsigned char *record,
+        size_t len) {
+    unsigned int h = (2166136261u ^ seq) * 16777619u;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        h = (h ^ record[i]) * 16777619u;
+    return h;
+}
+
+static inline header_t *header(const wod_t *w) {
+    return (header_t *) w->map;
+}
+
+static inline slot_t *slot(const wod_t *w, unsigned int seq) {
+    return (slot_t *) &w->map[HEADER_SIZE + (seq % w->capacity) * w->slot_size];
+}
+
+static inline int intact(const wod_t *w, const slot_t *s, unsigned int seq) {
+    return s->seq == seq
+            && s->check == checksum(seq, (const unsigned char *) (s + 1), w->record_size);
+}
+
+// Sequence number of the oldest record still kept and not drained
+static unsigned int first_unsent(const wod_t *w) {
+    unsigned int oldest = (w->head > w->capacity) ? w->head - w->capacity : 1;
+    unsigned int sent = header(w)->sent;
+
+    return (sent > oldest) ? sent : oldest;
+}
+
+/**
+ * Opens a store, creating it if needed.  A file of another format, record
+ * size or capacity is started over.
+ * @param w the store
+ * @param path the file
+ * @param format a version of the records, changed whenever their layout does
+ * @param record_size bytes per record
+ * @param capacity records kept
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the file cannot be mapped
+ */
+int wod_open(wod_t *w, const char *path, unsigned int format,
+        size_t record_size, unsigned int capacity) {
+    struct stat st;
+    header_t *h;
+    unsigned int i;
+    int fresh;
+
+    if (!w) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    if (!path || record_size == 0 || capacity == 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    w->record_size = record_size;
+    w->slot_size = (sizeof(slot_t) + record_size + 7) & ~(size_t) 7;
+    w->capacity = capacity;
+    w->map_size = HEADER_SIZE + capacity * w->slot_size;
+
+    w->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (w->fd < 0 || fstat(w->fd, &st) != 0) {
+        wod_close(w);
+        return -PQWS_INVALID_PARAM;
+    }
+    fresh = (st.st_size != (off_t) w->map_size);
+    if (fresh && (ftruncate(w->fd, 0) != 0 || ftruncate(w->fd, (off_t) w->map_size) != 0)) {
+        wod_close(w);
+        return -PQWS_INVALID_PARAM;
+    }
+    w->map = mmap(NULL, w->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, w->fd, 0);
+    if (w->map == MAP_FAILED) {
+        w->map = NULL;
+        wod_close(w);
+        return -PQWS_INVALID_PARAM;
+    }
+
+    h = header(w);
+    if (fresh || h->magic != WOD_MAGIC || h->format != format
+            || h->record_size != record_size || h->capacity != capacity) {
+        memset(w->map, 0, w->map_size);
+        h->magic = WOD_MAGIC;
+        h->format = format;
+        h->record_size = (unsigned int) record_size;
+        h->capacity = capacity;
+        h->sent = 1;
+        w->dirty = 1;
+    }
+
+    // carry on after the newest intact record
+    w->head = 1;
+    for (i = 0; i < capacity; i++) {
+        const slot_t *s = (const slot_t *) &w->map[HEADER_SIZE + i * w->slot_size];
+
+        if (s->seq >= w->head && s->seq % capacity == i && intact(w, s, s->seq))
+            w->head = s->seq + 1;
+    }
+    if (h->sent > w->head)
+        h->sent = w->head;
+    if (wod_sync(w) != PQWS_SUCCESS) {
+        wod_close(w);
+        return -PQWS_INVALID_PARAM;
+    }
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Writes the store out and closes it
+ * @param w the store
+ */
+void wod_close(wod_t *w) {
+    if (w->map) {
+        wod_sync(w);
+        munmap(w->map, w->map_size);
+        w->map = NULL;
+    }
+    if (w->fd >= 0)
+        close(w->fd);
+    w->fd = -1;
+}
+
+/**
+ * Appends a record, overwriting the oldest one when the store is full.
+ * Only memory is written, the record reaches the file at the next
+ * wod_sync() or when the kernel writes the page back.
+ * @param w the store
+ * @param record record_size bytes
+ */
+void wod_append(wod_t *w, const void *record) {
+    slot_t *s = slot(w, w->head);
+
+    // a power failure before the checksum is written leaves a torn record
+    // that wod_open() drops
+    s->seq = 0;
+    memcpy(s + 1, record, w->record_size);
+    s->check = checksum(w->head, record, w->record_size);
+    s->seq = w->head++;
+    w->dirty = 1;
+}
+
+/**
+ * @param w the store
+ * @return the number of records not drained yet
+ */
+unsigned int wod_pending(const wod_t *w) {
+    return w->head - first_unsent(w);
+}
+
+/**
+ * Copies the oldest records not drained yet, leaving them in the store
+ * @param w the store
+ * @param records where to copy them
+ * @param max the most records to copy
+ * @return the number of records copied
+ */
+int wod_peek(const wod_t *w, void *records, int max) {
+    unsigned int seq = first_unsent(w);
+    unsigned char *out = records;
+    int n = 0;
+
+    for (; n < max && seq != w->head; seq++) {
+        const slot_t *s = slot(w, seq);
+
+        if (intact(w, s, seq)) {
+            memcpy(&out[n * w->record_size], s + 1, w->record_size);
+            n++;
+        }
+    }
+    return n;
+}
+
+/**
+ * Marks the oldest records not drained yet as drained
+ * @param w the store
+ * @param count the number of records, as wod_peek() counted them
+ */
+void wod_consume(wod_t *w, int count) {
+    unsigned int seq = first_unsent(w);
+    int n = 0;
+
+    for (; n < count && seq != w->head; seq++) {
+        if (intact(w, slot(w, seq), seq))
+            n++;
+    }
+    header(w)->sent = seq;
+    w->dirty = 1;
+}
+
+/**
+ * Takes the oldest records not drained yet
+ * @param w the store
+ * @param records where to copy them
+ * @param max the most records to take
+ * @return the number of records copied
+ */
+int wod_drain(wod_t *w, void *records, int max) {
+    int n = wod_peek(w, records, max);
+
+    wod_consume(w, n);
+    return n;
+}
+
+/**
+ * Writes the changes since the last call to the file, which bounds what a
+ * power failure can lose to the records appended since
+ * @param w the store
+ * @return PQWS_SUCCESS or -PQWS_INVALID_PARAM if the file cannot be written
+ */
+int wod_sync(wod_t *w) {
+    if (!w->map) {
+        return -PQWS_INVALID_PARAM;
+    }
+    if (w->dirty && msync(w->map, w->map_size, MS_SYNC) != 0) {
+        return -PQWS_INVALID_PARAM;
+    }
+    w->dirty = 0;
+    return PQWS_SUCCESS;
+}
@@ -0,0 +1,54 @@
+/*
+ *  Whole orbit data store for the CubeSatSim telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WOD_H_
+#define WOD_H_
+
+#include <stddef.h>
+
+/**
+ * A ring of fixed size records in a file mapped into memory, so it outlives
+ * the process and the power.  Appending only writes to the mapping; the
+ * file catches up when wod_sync() is called.  Once the ring is full the
+ * oldest records are overwritten.  Every record carries its sequence number
+ * and a checksum, and records torn by a power failure are dropped when the
+ * store is opened again.
+ */
+typedef struct {
+    int fd;
+    unsigned char *map;         //!< the file, NULL when not open
+    size_t map_size;
+    size_t record_size;         //!< bytes per record
+    size_t slot_size;           //!< bytes per record with its sequence number
+    unsigned int capacity;      //!< records kept
+    unsigned int head;          //!< sequence number of the next record
+    int dirty;                  //!< changed since the last wod_sync()
+} wod_t;
+
+int wod_open(wod_t *w, const char *path, unsigned int format,
+        size_t record_size, unsigned int capacity);
+void wod_close(wod_t *w);
+void wod_append(wod_t *w, const void *record);
+unsigned int wod_pending(const wod_t *w);
+int wod_peek(const wod_t *w, void *records, int max);
+void wod_consume(wod_t *w, int count);
+int wod_drain(wod_t *w, void *records, int max);
+int wod_sync(wod_t *w);
+
+#endif /* WOD_H_ */
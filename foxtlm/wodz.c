@@ -0,0 +1,262 @@
+/*
+ *  Compressed whole orbit data payloads for the CubeSatSim telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include "wodz.h"
+#include "../afsk/status.h"
+
+#define ESCAPE          12      // unary prefix of a difference sent in full
+#define RESCALE         32      // samples before the running mean is halved
+
+// A bit stream, least significant bit of each byte first
+typedef struct {
+    unsigned char *buf;
+    int bits;                   //!< size of the stream
+    int pos;
+} stream_t;
+
+// What both ends know of each field
+typedef struct {
+    unsigned int prev[PLAN_MAX_OPS];        //!< field in the record before
+    unsigned long long sum[PLAN_MAX_OPS];   //!< of the recent zig-zag differences
+    unsigned int n[PLAN_MAX_OPS];           //!< differences in sum
+} model_t;
+
+static inline unsigned int field_mask(int bits) {
+    return (unsigned int) ((1ULL << bits) - 1);
+}
+
+// The bits of a value in the field of step op
+static inline unsigned int field_of(const plan_op_t *op, const unsigned int *values) {
+    int skip = (op->shift - op->rotate) & 63;
+
+    return (unsigned int) (values[op->source] >> skip) & field_mask(op->bits);
+}
+
+static inline int put(stream_t *s, unsigned int v, int n) {
+    int i;
+
+    if (s->pos + n > s->bits) {
+        return -PQWS_INVALID_PARAM;
+    }
+    for (i = 0; i < n; i++, s->pos++) {
+        if ((v >> i) & 1)
+            s->buf[s->pos >> 3] |= (unsigned char) (1 << (s->pos & 7));
+        else
+            s->buf[s->pos >> 3] &= (unsigned char) ~(1 << (s->pos & 7));
+    }
+    return PQWS_SUCCESS;
+}
+
+static inline int get(stream_t *s, unsigned int *v, int n) {
+    int i;
+
+    if (s->pos + n > s->bits) {
+        return -PQWS_INVALID_PARAM;
+    }
+    *v = 0;
+    for (i = 0; i < n; i++, s->pos++)
+        *v |= (unsigned int) ((s->buf[s->pos >> 3] >> (s->pos & 7)) & 1) << i;
+    return PQWS_SUCCESS;
+}
+
+// The Rice parameter: the smallest k with n << k at least sum, below the
+// width of the field
+static inline int rice_k(const model_t *m, int f, int bits) {
+    int k = 0;
+
+    while (k < bits - 1 && ((unsigned long long) m->n[f] << k) < m->sum[f])
+        k++;
+    return k;
+}
+
+static inline void update(model_t *m, int f, unsigned int zz) {
+    m->sum[f] += zz;
+    if (++m->n[f] == RESCALE) {
+        m->sum[f] >>= 1;
+        m->n[f] >>= 1;
+    }
+}
+
+static void model_init(model_t *m, const plan_t *p) {
+    int f;
+
+    for (f = 0; f < p->count; f++) {
+        m->sum[f] = 2;
+        m->n[f] = 1;
+    }
+}
+
+// The difference of a field from the record before, a signed number of the
+// width of the field, mapped 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+static inline unsigned int zigzag(unsigned int v, unsigned int prev, int bits) {
+    unsigned int d = (v - prev) & field_mask(bits);
+    int neg = (d >> (bits - 1)) & 1;
+
+    return neg ? ((field_mask(bits) - d) << 1) | 1 : d << 1;
+}
+
+static inline unsigned int unzigzag(unsigned int zz, unsigned int prev, int bits) {
+    unsigned int d = (zz & 1) ? field_mask(bits) - (zz >> 1) : zz >> 1;
+
+    return (prev + d) & field_mask(bits);
+}
+
+static int encode_record(stream_t *s, model_t *m, const plan_t *p,
+        const unsigned int *values, int key) {
+    int f;
+
+    for (f = 0; f < p->count; f++) {
+        const plan_op_t *op = &p->op[f];
+        unsigned int v = field_of(op, values), zz, q;
+        int k;
+
+        if (key) {
+            if (put(s, v, op->bits) != PQWS_SUCCESS) {
+                return -PQWS_INVALID_PARAM;
+            }
+        } else {
+            zz = zigzag(v, m->prev[f], op->bits);
+            k = rice_k(m, f, op->bits);
+            q = zz >> k;
+            if (q < ESCAPE) {
+                if (put(s, field_mask(q), q + 1) != PQWS_SUCCESS
+                        || put(s, zz, k) != PQWS_SUCCESS) {
+                    return -PQWS_INVALID_PARAM;
+                }
+            } else if (put(s, field_mask(ESCAPE), ESCAPE) != PQWS_SUCCESS
+                    || put(s, zz, op->bits) != PQWS_SUCCESS) {
+                return -PQWS_INVALID_PARAM;
+            }
+            update(m, f, zz);
+        }
+        m->prev[f] = v;
+    }
+    return PQWS_SUCCESS;
+}
+
+static int decode_record(stream_t *s, model_t *m, const plan_t *p, int key) {
+    int f;
+
+    for (f = 0; f < p->count; f++) {
+        const plan_op_t *op = &p->op[f];
+        unsigned int v, zz, q = 0, bit;
+        int k;
+
+        if (key) {
+            if (get(s, &v, op->bits) != PQWS_SUCCESS) {
+                return -PQWS_INVALID_PARAM;
+            }
+        } else {
+            k = rice_k(m, f, op->bits);
+            do {
+                if (get(s, &bit, 1) != PQWS_SUCCESS) {
+                    return -PQWS_INVALID_PARAM;
+                }
+            } while (bit && ++q < ESCAPE);
+            if (q < ESCAPE) {
+                if (get(s, &zz, k) != PQWS_SUCCESS) {
+                    return -PQWS_INVALID_PARAM;
+                }
+                zz |= q << k;
+            } else if (get(s, &zz, op->bits) != PQWS_SUCCESS) {
+                return -PQWS_INVALID_PARAM;
+            }
+            v = unzigzag(zz, m->prev[f], op->bits);
+            update(m, f, zz);
+        }
+        m->prev[f] = v;
+    }
+    return PQWS_SUCCESS;
+}
+
+/**
+ * Compresses as many records as fit into a block
+ * @param p the plan of the records, with at most 32 bits a step
+ * @param records count records, PLAN_SOURCES values each, oldest first
+ * @param count the number of records, at most 255
+ * @param out the block
+ * @param len the bytes of the block, the bits past the records are zero
+ * @return the number of records in the block, oldest first, or
+ * -PQWS_INVALID_PARAM
+ */
+int wodz_encode(const plan_t *p, const unsigned int *records, int count,
+        unsigned char *out, int len) {
+    stream_t s = { out, len * 8, WODZ_HEADER_BITS };
+    model_t m, saved;
+    int r, end;
+
+    if (!p || !records || !out || count < 0 || count > 255 || len * 8 < WODZ_HEADER_BITS) {
+        return -PQWS_INVALID_PARAM;
+    }
+    memset(out, 0, len);
+    model_init(&m, p);
+    for (r = 0; r < count; r++) {
+        end = s.pos;
+        saved = m;
+        if (encode_record(&s, &m, p, &records[r * PLAN_SOURCES], r == 0) != PQWS_SUCCESS) {
+            // the record does not fit, leave the block as it was before it
+            m = saved;
+            for (; s.pos > end; s.pos--)
+                s.buf[(s.pos - 1) >> 3] &= (unsigned char) ~(1 << ((s.pos - 1) & 7));
+            break;
+        }
+    }
+    out[0] = WODZ_FORMAT;
+    out[1] = (unsigned char) r;
+    return r;
+}
+
+/**
+ * Expands a block into payloads as plan_pack() would have packed the records
+ * @param p the plan the block was compressed with
+ * @param in the block
+ * @param len the bytes of the block
+ * @param payloads where to put the payloads
+ * @param payload_len the bytes of a payload
+ * @param max the most payloads to expand
+ * @return the number of payloads, or -PQWS_INVALID_PARAM if the block is
+ * not a WODZ_FORMAT block of this plan
+ */
+int wodz_decode(const plan_t *p, const unsigned char *in, int len,
+        unsigned char *payloads, int payload_len, int max) {
+    stream_t s = { (unsigned char *) in, len * 8, WODZ_HEADER_BITS };
+    model_t m;
+    int r, f, count;
+
+    if (!p || !in || !payloads || len * 8 < WODZ_HEADER_BITS || in[0] != WODZ_FORMAT) {
+        return -PQWS_INVALID_PARAM;
+    }
+    count = (in[1] < max) ? in[1] : max;
+    model_init(&m, p);
+    for (r = 0; r < count; r++) {
+        stream_t out = { &payloads[r * payload_len], payload_len * 8, 0 };
+
+        if (decode_record(&s, &m, p, r == 0) != PQWS_SUCCESS) {
+            return -PQWS_INVALID_PARAM;
+        }
+        memset(out.buf, 0, payload_len);
+        for (f = 0; f < p->count; f++) {
+            out.pos = p->op[f].word * 64 + p->op[f].shift;
+            if (put(&out, m.prev[f], p->op[f].bits) != PQWS_SUCCESS)
+                break;
+        }
+    }
+    return count;
+}
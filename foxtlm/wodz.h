@@ -0,0 +1,47 @@
+/*
+ *  Compressed whole orbit data payloads for the CubeSatSim telemetry
+ *
+ *  Copyright Alan B. Johnston
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WODZ_H_
+#define WODZ_H_
+
+#include "plan.h"
+
+#define WODZ_FORMAT             1
+#define WODZ_HEADER_BITS        16      // format and record count, as in CubeSatSim_PSK_wodcompressed.csv
+
+/**
+ * A block of WOD records packed by a plan, as laid out in
+ * CubeSatSim_PSK_wodcompressed.csv: a byte with WODZ_FORMAT, a byte with
+ * the number of records, then the records, least significant bit first.
+ *
+ * The fields are the steps of the plan, so fields that are always zero
+ * take no bits at all.  The first record of a block is a keyframe with
+ * every field in full; each of the others has, for each field, the
+ * difference from the record before, zig-zag mapped to a small number and
+ * Rice coded.  The Rice parameter of each field follows the mean of its
+ * recent differences on both sides, so it costs no bits, and a difference
+ * too large for it is sent in full after an escape.  Every block starts
+ * with a keyframe, so a lost frame loses only its own records.
+ */
+int wodz_encode(const plan_t *p, const unsigned int *records, int count,
+        unsigned char *out, int len);
+int wodz_decode(const plan_t *p, const unsigned char *in, int len,
+        unsigned char *payloads, int payload_len, int max);
+
+#endif /* WODZ_H_ */
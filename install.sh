@@ -82,6 +82,10 @@ sudo cp ~/CubeSatSim/systemd/rpitx.service /etc/systemd/system/rpitx.service
 
 sudo systemctl enable rpitx
 
+sudo cp ~/CubeSatSim/systemd/sensord.service /etc/systemd/system/sensord.service
+
+sudo systemctl enable sensord
+
 
 sudo cp /boot/config.txt /boot/config.txt.0
 
@@ -34,10 +34,20 @@ else
   echo "no changes to rpitx.service"
 fi
 
+if [[ $(grep 'sensord.service' /home/pi/CubeSatSim/.updated) ]]; then
+  echo "copying sensord.service"
+  sudo cp systemd/sensord.service /etc/systemd/system/sensord.service
+  FLAG=1
+else
+  echo "no changes to sensord.service"
+fi
+
 if [ $FLAG -eq 1 ]; then
   echo "systemctl daemon-reload"
   sudo systemctl daemon-reload 
+  sudo systemctl enable sensord
 else
-  echo "systemctl restart cubesatsim"
+  echo "systemctl restart sensord cubesatsim"
+  sudo systemctl restart sensord
   sudo systemctl restart cubesatsim
 fi